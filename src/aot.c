@@ -0,0 +1,647 @@
+#include "common.h"
+#include "aot.h"
+#include "compile.h"
+#include "expand.h"
+#include "init.h"
+#include "read.h"
+
+#include <ctype.h>
+#include <limits.h>
+#include <math.h>
+
+/*
+ * Compiles a program ahead of time into a standalone executable. Each form
+ * of the standard library and of the program is compiled to bytecode as
+ * usual, then every code object is translated into a C function that does
+ * what the dispatch loop in vm.c would do with it, so nothing is decoded
+ * or dispatched at run time. The functions work on the VM's own stack,
+ * frames and inline caches, leaving calls, closures and new environments
+ * to the vm_* operations, so native and interpreted procedures call each
+ * other freely. The C is built against bin/libfig.a.
+ */
+
+/* holds src/ with the runtime headers and bin/ with libfig.a */
+#ifndef FIG_HOME
+#define FIG_HOME "/usr/local/Cellar/fig/"VERSION
+#endif
+
+#define MAX_COMMAND_LENGTH 4096
+
+typedef struct {
+    FILE *out;
+    int ncodes;     /* code objects translated so far */
+    int statics;    /* stack slot of the list of statics, newest first */
+    int nstatics;
+    int *forms;     /* code object of each top level form */
+    int nforms;
+} unit_t;
+
+/*
+ * Statics are objects the executable makes once at startup: uninterned
+ * symbols, which must keep their identity across code objects, and the
+ * builtins folded constants depend on, as they were before the program
+ * could redefine them. Returns the index of 'object' in S.
+ */
+static int static_index(VM *vm, unit_t *u, obj_t *object) {
+    int i = u->nstatics;
+    for (obj_t *l = vm->stack[u->statics]; !is_the_empty_list(l); l = cdr(l)) {
+        i--;
+        if (car(l) == object) {
+            return i;
+        }
+    }
+    vm->stack[u->statics] = mk_cons(vm, object, vm->stack[u->statics]);
+    return u->nstatics++;
+}
+
+static void emit_string(FILE *out, char *str) {
+    fputc('"', out);
+    for (unsigned char *s = (unsigned char *)str; *s; s++) {
+        if (*s == '"' || *s == '\\') {
+            fprintf(out, "\\%c", *s);
+        } else if (isprint(*s)) {
+            fputc(*s, out);
+        } else {
+            fprintf(out, "\\%03o", *s);
+        }
+    }
+    fputc('"', out);
+}
+
+static void emit_long(FILE *out, long n) {
+    if (n == LONG_MIN) {
+        fputs("LONG_MIN", out);
+    } else {
+        fprintf(out, "%ldL", n);
+    }
+}
+
+/* Emits a C expression that makes a copy of 'datum'. */
+static void emit_datum(VM *vm, unit_t *u, obj_t *datum) {
+    FILE *out = u->out;
+
+    if (!datum) {
+        fputs("NULL", out);
+        return;
+    }
+
+    switch (obj_type(datum)) {
+    case OBJ_NUM:
+        fputs("mk_num_from_long(vm, ", out);
+        emit_long(out, num_numer(datum));
+        fputs(", ", out);
+        emit_long(out, num_denom(datum));
+        fputs(")", out);
+        break;
+    case OBJ_BIG:
+    case OBJ_RATIO: {
+        char *digits = num_to_string(datum);
+        fputs("mk_num_from_str(vm, ", out);
+        emit_string(out, digits);
+        fprintf(out, ", 0, %d)", datum->type == OBJ_RATIO);
+        free(digits);
+        break;
+    }
+    case OBJ_DOUBLE:
+        /* in hex, which C reads back exactly */
+        if (isnan(datum->dbl)) {
+            fputs("mk_double(vm, NAN)", out);
+        } else if (isinf(datum->dbl)) {
+            fprintf(out, "mk_double(vm, %sINFINITY)", datum->dbl < 0 ? "-" : "");
+        } else {
+            fprintf(out, "mk_double(vm, %a)", datum->dbl);
+        }
+        break;
+    case OBJ_SYM:
+        if (table_get(symbol_table, datum->sym, datum->hash) == datum) {
+            fputs("mk_sym(vm, ", out);
+            emit_string(out, datum->sym);
+            fputs(")", out);
+        } else {
+            fprintf(out, "S[%d]", static_index(vm, u, datum));
+        }
+        break;
+    case OBJ_BUILTIN:
+        fprintf(out, "S[%d]", static_index(vm, u, datum));
+        break;
+    case OBJ_STR:
+        fputs("mk_string(vm, ", out);
+        emit_string(out, datum->str);
+        fputs(")", out);
+        break;
+    case OBJ_CHAR:
+        fprintf(out, "mk_char(vm, %d)", char_value(datum));
+        break;
+    case OBJ_BOOL:
+        fputs(datum == true ? "true" : "false", out);
+        break;
+    case OBJ_NIL:
+        fputs("the_empty_list", out);
+        break;
+    case OBJ_ERR:
+        fputs("mk_err(vm, ", out);
+        emit_string(out, datum->err);
+        fputs(")", out);
+        break;
+    case OBJ_PAIR:
+        fputs("mk_cons(vm, ", out);
+        emit_datum(vm, u, car(datum));
+        fputs(", ", out);
+        emit_datum(vm, u, cdr(datum));
+        fputs(")", out);
+        break;
+    case OBJ_VEC:
+        fprintf(out, "vec(vm, %d", datum->size);
+        for (int i = 0; i < datum->size; i++) {
+            fputs(", ", out);
+            emit_datum(vm, u, datum->objects[i]);
+        }
+        fputs(")", out);
+        break;
+    default:
+        raise(vm, "cannot compile a constant of type '%s'",
+              type_name(obj_type(datum)));
+    }
+}
+
+/* Emits statements storing a copy of 'datum' in 'dest', a field of the
+ * code object 'code' being made. The spine of a list is built a pair at a
+ * time so long lists don't nest. */
+static void emit_assign(VM *vm, unit_t *u, char *dest, obj_t *datum) {
+    FILE *out = u->out;
+
+    int n = 0;
+    obj_t *tail = datum;
+    for (; tail && is_pair(tail); tail = cdr(tail)) {
+        n++;
+    }
+
+    fprintf(out, "    %s = ", dest);
+    emit_datum(vm, u, tail);
+    fputs(";\n", out);
+    fprintf(out, "    write_barrier(vm, code, %s);\n", dest);
+
+    if (n) {
+        obj_t **items = malloc(sizeof(obj_t *) * n);
+        int i = 0;
+        for (tail = datum; i < n; tail = cdr(tail)) {
+            items[i++] = car(tail);
+        }
+        while (i--) {
+            fputs("    vm->sp = sp;\n", out);
+            fprintf(out, "    %s = mk_cons(vm, ", dest);
+            emit_datum(vm, u, items[i]);
+            fprintf(out, ", %s);\n", dest);
+            fprintf(out, "    write_barrier(vm, code, %s);\n", dest);
+        }
+        free(items);
+    }
+    fputs("    vm->sp = sp;\n", out);
+}
+
+/* native code ------------------------------------------------------------- */
+
+static int operand_count(opcode op) {
+    switch (op) {
+    case OP_POP:
+    case OP_LEAVE:
+    case OP_RETURN:
+        return 0;
+    case OP_LOCAL:
+    case OP_SET_LOCAL:
+    case OP_STORE:
+    case OP_CALLEE:
+    case OP_JUMP_IF_EQV:
+    case OP_CALL:
+    case OP_TAIL_CALL:
+        return 2;
+    case OP_FOLDED:
+    case OP_ENTER:
+        return 3;
+    default:
+        return 1;
+    }
+}
+
+/* Returns the address the instruction at 'ip' may continue at, or -1. */
+static int jump_target(int *ip) {
+    switch (ip[0]) {
+    case OP_JUMP:
+    case OP_JUMP_IF_FALSE:
+    case OP_JUMP_IF_FALSE_OR_POP:
+    case OP_JUMP_IF_TRUE_OR_POP:
+        return ip[1];
+    case OP_JUMP_IF_EQV:
+        return ip[2];
+    case OP_FOLDED:
+        return ip[3];
+    default:
+        return -1;
+    }
+}
+
+/* Emits the frame 'depth' links out from the current one. */
+static void emit_env(FILE *out, int depth) {
+    fputs("frame->env", out);
+    while (depth--) {
+        fputs("->parent", out);
+    }
+}
+
+/* Emits the check that slot 'slot' of that frame has been defined. */
+static void emit_assigned_check(FILE *out, int depth, int slot) {
+    fputs("    if (", out);
+    emit_env(out, depth);
+    fprintf(out, "->slots[%d] == IMM_UNASSIGNED) {\n", slot);
+    fputs("        vm_unassigned(vm, ", out);
+    emit_env(out, depth);
+    fprintf(out, ", %d);\n    }\n", slot);
+}
+
+static void emit_instruction(FILE *out, int *ip) {
+    switch (ip[0]) {
+    case OP_CONST:
+        fprintf(out, "    push(vm, K[%d]);\n", ip[1]);
+        break;
+    case OP_LOCAL:
+        emit_assigned_check(out, ip[1], ip[2]);
+        fputs("    push(vm, ", out);
+        emit_env(out, ip[1]);
+        fprintf(out, "->slots[%d]);\n", ip[2]);
+        break;
+    case OP_SET_LOCAL:
+        emit_assigned_check(out, ip[1], ip[2]);
+        fputs("    frame_store(vm, ", out);
+        emit_env(out, ip[1]);
+        fprintf(out, ", %d, vm->stack[vm->sp - 1]);\n", ip[2]);
+        fputs("    vm->stack[vm->sp - 1] = NULL;\n", out);
+        break;
+    case OP_STORE:
+        fputs("    frame_store(vm, ", out);
+        emit_env(out, ip[1]);
+        fprintf(out, ", %d, vm->stack[--vm->sp]);\n", ip[2]);
+        break;
+    case OP_UNASSIGN:
+        fprintf(out, "    frame->env->slots[%d] = IMM_UNASSIGNED;\n", ip[1]);
+        break;
+    case OP_GLOBAL:
+        fprintf(out, "    if (!K[%d]->bound) {\n", ip[1]);
+        fprintf(out, "        raise(vm, \"unbound symbol '%%s'\", K[%d]->sym);\n",
+                ip[1]);
+        fprintf(out, "    }\n    push(vm, K[%d]->value);\n", ip[1]);
+        break;
+    case OP_CALLEE:
+        fprintf(out, "    vm_callee(vm, K[%d], &I[%d]);\n", ip[1], ip[2]);
+        break;
+    case OP_SET_GLOBAL:
+    case OP_DEFINE:
+        fprintf(out, "    %s(vm, universe, K[%d], vm->stack[vm->sp - 1]);\n",
+                ip[0] == OP_DEFINE ? "env_define" : "env_set", ip[1]);
+        fputs("    vm->stack[vm->sp - 1] = NULL;\n", out);
+        break;
+    case OP_POP:
+        fputs("    vm->sp--;\n", out);
+        break;
+    case OP_FOLDED:
+        fprintf(out, "    if (vm_folded(vm, K[%d], &I[%d])) {\n", ip[1], ip[2]);
+        fprintf(out, "        goto L%d;\n    }\n", ip[3]);
+        break;
+    case OP_JUMP:
+        fprintf(out, "    goto L%d;\n", ip[1]);
+        break;
+    case OP_JUMP_IF_FALSE:
+        fputs("    if (is_false(vm->stack[--vm->sp])) {\n", out);
+        fprintf(out, "        goto L%d;\n    }\n", ip[1]);
+        break;
+    case OP_JUMP_IF_FALSE_OR_POP:
+    case OP_JUMP_IF_TRUE_OR_POP:
+        fprintf(out, "    if (%sis_false(vm->stack[vm->sp - 1])) {\n",
+                ip[0] == OP_JUMP_IF_TRUE_OR_POP ? "!" : "");
+        fprintf(out, "        goto L%d;\n    }\n    vm->sp--;\n", ip[1]);
+        break;
+    case OP_JUMP_IF_EQV:
+        fprintf(out, "    if (is_eqv(vm->stack[vm->sp - 1], K[%d])) {\n", ip[1]);
+        fprintf(out, "        goto L%d;\n    }\n", ip[2]);
+        break;
+    case OP_ENTER:
+        fprintf(out, "    vm_enter(vm, frame, K[%d], %d, %d);\n", ip[1], ip[2],
+                ip[3]);
+        break;
+    case OP_REBIND:
+        fprintf(out, "    vm_rebind(vm, frame, %d);\n", ip[1]);
+        break;
+    case OP_LEAVE:
+        fputs("    frame->env = frame->env->parent;\n", out);
+        break;
+    case OP_CLOSURE:
+        fprintf(out, "    vm_closure(vm, frame, K[%d]);\n", ip[1]);
+        break;
+    case OP_LIST:
+        fprintf(out, "    vm_list(vm, %d);\n", ip[1]);
+        break;
+    case OP_CALL:
+        fprintf(out, "    vm_call(vm, %d, &I[%d]);\n", ip[1], ip[2]);
+        break;
+    case OP_TAIL_CALL:
+        /* a call to itself loops; any other goes back to execute() */
+        fprintf(out, "    if (!vm_tail_call(vm, frame, %d, &I[%d])) {\n",
+                ip[1], ip[2]);
+        fputs("        return 0;\n    }\n", out);
+        fputs("    if (frame->code == self) {\n        goto L0;\n    }\n", out);
+        fputs("    return 1;\n", out);
+        break;
+    case OP_RETURN:
+        fputs("    return 0;\n", out);
+        break;
+    }
+}
+
+static void emit_native(unit_t *u, code_t *c, int id) {
+    FILE *out = u->out;
+
+    char *targets = calloc(c->count + 1, 1);
+    int tail_calls = 0;
+    for (int pc = 0; pc < c->count; pc += 1 + operand_count(c->instrs[pc])) {
+        int target = jump_target(&c->instrs[pc]);
+        if (target >= 0) {
+            targets[target] = 1;
+        }
+        if (c->instrs[pc] == OP_TAIL_CALL) {
+            tail_calls = targets[0] = 1;
+        }
+    }
+
+    fprintf(out, "static int code_%d(VM *vm, frame_t *frame) {\n", id);
+    if (tail_calls) {
+        fputs("    obj_t *self = frame->code;\n", out);
+    }
+    if (c->nconsts) {
+        fputs("    obj_t **K = frame->code->bytecode->consts;\n", out);
+    }
+    if (c->nics) {
+        fputs("    ic_t *I = frame->code->bytecode->ics;\n", out);
+    }
+    fputs("\n", out);
+
+    for (int pc = 0; pc < c->count; pc += 1 + operand_count(c->instrs[pc])) {
+        if (targets[pc]) {
+            fprintf(out, "L%d:\n", pc);
+        }
+        emit_instruction(out, &c->instrs[pc]);
+    }
+    if (targets[c->count]) {
+        fprintf(out, "L%d:\n    return 0;\n", c->count);
+    }
+    fputs("}\n\n", out);
+
+    free(targets);
+}
+
+/* Emits a function making the code object for 'code', whose constants that
+ * are themselves code have the numbers in 'nested'. */
+static void emit_make_code(VM *vm, unit_t *u, code_t *c, int id, int *nested) {
+    FILE *out = u->out;
+
+    fprintf(out, "static obj_t *make_code_%d(VM *vm) {\n", id);
+    fputs("    obj_t *code = mk_code(vm);\n", out);
+    fputs("    code_t *c = code->bytecode;\n", out);
+    fputs("    int sp = vm->sp;\n\n", out);
+
+    fprintf(out, "    c->nparams = %d;\n", c->nparams);
+    fprintf(out, "    c->rest = %d;\n", c->rest);
+    fprintf(out, "    c->nlocals = %d;\n", c->nlocals);
+    fprintf(out, "    c->native = code_%d;\n", id);
+    if (c->nconsts) {
+        fprintf(out, "    c->consts = calloc(%d, sizeof(obj_t *));\n",
+                c->nconsts);
+        fprintf(out, "    c->nconsts = c->consts_capacity = %d;\n", c->nconsts);
+    }
+    if (c->nics) {
+        fprintf(out, "    c->ics = calloc(%d, sizeof(ic_t));\n", c->nics);
+        fprintf(out, "    c->nics = %d;\n", c->nics);
+    }
+
+    if (c->name) {
+        emit_assign(vm, u, "c->name", c->name);
+    }
+    emit_assign(vm, u, "c->params", c->params);
+    emit_assign(vm, u, "c->names", c->names);
+
+    char dest[32];
+    for (int i = 0; i < c->nconsts; i++) {
+        if (nested[i] >= 0) {
+            fprintf(out, "    c->consts[%d] = make_code_%d(vm);\n", i,
+                    nested[i]);
+            fprintf(out, "    write_barrier(vm, code, c->consts[%d]);\n", i);
+            fputs("    vm->sp = sp;\n", out);
+        } else {
+            snprintf(dest, sizeof(dest), "c->consts[%d]", i);
+            emit_assign(vm, u, dest, c->consts[i]);
+        }
+    }
+
+    fputs("    return code;\n}\n\n", out);
+}
+
+/* Translates 'code' and the code objects in its constant pool, returning
+ * its number. */
+static int emit_code(VM *vm, unit_t *u, obj_t *code) {
+    code_t *c = code->bytecode;
+
+    int *nested = malloc(sizeof(int) * (c->nconsts + 1));
+    for (int i = 0; i < c->nconsts; i++) {
+        obj_t *object = c->consts[i];
+        nested[i] = object && is_code(object) ? emit_code(vm, u, object) : -1;
+    }
+
+    int id = u->ncodes++;
+    emit_native(u, c, id);
+    emit_make_code(vm, u, c, id, nested);
+
+    free(nested);
+    return id;
+}
+
+/* program ----------------------------------------------------------------- */
+
+static void translate_file(VM *vm, unit_t *u, char *fname) {
+    FILE *infile = fopen(fname, "r");
+    if (!infile) {
+        raise(vm, "could not find file '%s'", fname);
+    }
+
+    Reader *rdr = reader_new(infile);
+
+    while (!feof(infile)) {
+        int sp = vm->sp;
+        obj_t *ast = read(vm, rdr);
+        popn(vm, vm->sp - sp);
+
+        push(vm, ast);
+        ast = expand(vm, ast);
+        if (ast) {
+            u->forms = realloc(u->forms, sizeof(int) * (u->nforms + 1));
+            u->forms[u->nforms++] = emit_code(vm, u, compile(vm, ast));
+        }
+        popn(vm, vm->sp - sp);
+    }
+
+    reader_delete(rdr);
+}
+
+static void emit_prelude(unit_t *u, char *fname) {
+    FILE *out = u->out;
+
+    fputs("/* Generated by fig --compile from ", out);
+    emit_string(out, fname);
+    fputs(". */\n\n", out);
+    fputs("#include \"common.h\"\n", out);
+    fputs("#include \"compile.h\"\n", out);
+    fputs("#include \"init.h\"\n\n", out);
+    fputs("#include <limits.h>\n", out);
+    fputs("#include <math.h>\n", out);
+    fputs("#include <stdarg.h>\n\n", out);
+    fputs("static obj_t **S;\n\n", out);
+
+    fputs("static obj_t *vec(VM *vm, int size, ...) {\n", out);
+    fputs("    obj_t **objects = malloc(sizeof(obj_t *) * size);\n", out);
+    fputs("    va_list ap;\n", out);
+    fputs("    va_start(ap, size);\n", out);
+    fputs("    for (int i = 0; i < size; i++) {\n", out);
+    fputs("        objects[i] = va_arg(ap, obj_t *);\n", out);
+    fputs("    }\n", out);
+    fputs("    va_end(ap);\n\n", out);
+    fputs("    obj_t *vec = mk_vec(vm, objects, size);\n", out);
+    fputs("    push(vm, vec);\n", out);
+    fputs("    return vec;\n", out);
+    fputs("}\n\n", out);
+}
+
+static void emit_main(VM *vm, unit_t *u) {
+    FILE *out = u->out;
+
+    obj_t **statics = malloc(sizeof(obj_t *) * (u->nstatics + 1));
+    int i = u->nstatics;
+    for (obj_t *l = vm->stack[u->statics]; !is_the_empty_list(l); l = cdr(l)) {
+        statics[--i] = car(l);
+    }
+
+    fputs("static void make_statics(VM *vm) {\n", out);
+    fprintf(out, "    S = malloc(sizeof(obj_t *) * %d);\n", u->nstatics + 1);
+    fputs("    push(vm, the_empty_list);\n", out);
+    fputs("    int root = vm->sp - 1;\n\n", out);
+    for (i = 0; i < u->nstatics; i++) {
+        fprintf(out, "    S[%d] = ", i);
+        if (is_symbol(statics[i])) {
+            fputs("mk_gensym(vm, ", out);
+            emit_string(out, statics[i]->sym);
+            fputs(");\n", out);
+        } else {
+            fputs("mk_sym(vm, ", out);
+            emit_string(out, statics[i]->bname);
+            fputs(")->value;\n", out);
+        }
+        fprintf(out, "    vm->stack[root] = mk_cons(vm, S[%d], vm->stack[root]);\n",
+                i);
+        fputs("    vm->sp = root + 1;\n", out);
+    }
+    fputs("}\n\n", out);
+    free(statics);
+
+    fputs("static obj_t *(*forms[])(VM *vm) = {\n", out);
+    for (i = 0; i < u->nforms; i++) {
+        fprintf(out, "    make_code_%d,\n", u->forms[i]);
+    }
+    fputs("};\n\n", out);
+
+    fputs("int main(void) {\n", out);
+    fputs("    init_runtime();\n\n", out);
+    fputs("    if (setjmp(exc_env)) {\n", out);
+    fputs("        println(exc);\n", out);
+    fputs("        return 1;\n", out);
+    fputs("    }\n\n", out);
+    fputs("    make_statics(vm);\n", out);
+    fputs("    int sp = vm->sp;\n\n", out);
+    fprintf(out, "    for (int i = 0; i < %d; i++) {\n", u->nforms);
+    fputs("        execute(vm, forms[i](vm), universe);\n", out);
+    fputs("        vm->sp = sp;\n", out);
+    fputs("    }\n\n", out);
+    fputs("    return 0;\n", out);
+    fputs("}\n", out);
+}
+
+/*
+ * Compiles the program in 'fname' to an executable named 'out', or after
+ * 'fname' without its extension. The C is left next to it as out.c if it
+ * fails to build. Returns an exit status.
+ */
+int compile_program(VM *vm, char *fname, char *out) {
+    char exe[MAX_STRING_LENGTH];
+    if (!out) {
+        snprintf(exe, sizeof(exe), "%s", fname);
+        char *ext = strrchr(exe, '.');
+        if (ext && strcmp(ext, ".fig") == 0) {
+            *ext = '\0';
+        } else {
+            strncat(exe, ".out", sizeof(exe) - strlen(exe) - 1);
+        }
+        out = exe;
+    }
+
+    char cfile[MAX_STRING_LENGTH + 2];
+    snprintf(cfile, sizeof(cfile), "%s.c", out);
+
+    unit_t *u = calloc(1, sizeof(unit_t));
+    u->out = fopen(cfile, "w");
+    if (!u->out) {
+        fprintf(stderr, "could not write '%s'\n", cfile);
+        free(u);
+        return 1;
+    }
+
+    int sp = vm->sp;
+
+    jmp_buf outer;
+    memcpy(outer, exc_env, sizeof(jmp_buf));
+
+    if (setjmp(exc_env)) {
+        println(exc);
+        vm->sp = sp;
+        memcpy(exc_env, outer, sizeof(jmp_buf));
+        fclose(u->out);
+        remove(cfile);
+        free(u->forms);
+        free(u);
+        return 1;
+    }
+
+    push(vm, the_empty_list);
+    u->statics = vm->sp - 1;
+
+    emit_prelude(u, fname);
+    translate_file(vm, u, STDLIB);
+    translate_file(vm, u, fname);
+    emit_main(vm, u);
+
+    memcpy(exc_env, outer, sizeof(jmp_buf));
+    vm->sp = sp;
+    fclose(u->out);
+    free(u->forms);
+    free(u);
+
+    char *cc = getenv("CC") ? getenv("CC") : "cc";
+    char *home = getenv("FIG_HOME") ? getenv("FIG_HOME") : FIG_HOME;
+
+    char command[MAX_COMMAND_LENGTH];
+    snprintf(command, sizeof(command),
+             "%s -O2 -fcommon -I'%s/src' -o '%s' '%s' '%s/bin/libfig.a' -lm",
+             cc, home, out, cfile, home);
+
+    if (system(command) != 0) {
+        fprintf(stderr, "could not build '%s' from '%s'\n", out, cfile);
+        return 1;
+    }
+
+    remove(cfile);
+    return 0;
+}
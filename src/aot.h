@@ -0,0 +1,10 @@
+#ifndef AOT_H
+#define AOT_H
+
+#include "object.h"
+
+typedef struct VM VM;
+
+int compile_program(VM *vm, char *fname, char *out);
+
+#endif
@@ -7,31 +7,23 @@
             raise(vm, fmt, ##__VA_ARGS__);                             \
     }
 
-#define ARG_NUMCHECK(vm, args, name, num)                                      \
+#define ARG_NUMCHECK(vm, argc, name, num)                                      \
     {                                                                          \
-        int count = 0;                                                         \
-        obj_t *tmp = args;                                                     \
-        while (tmp != the_empty_list) {                                        \
-            count++;                                                           \
-            tmp = cdr(tmp);                                                    \
-        }                                                                      \
-        if (count != num) {                                                    \
+        if (argc != num) {                                                     \
             raise(                                                     \
                 vm,                                                            \
                 "incorrect argument count for %s. expected %d, got %d", name,  \
-                num, count);                                                   \
+                num, argc);                                                    \
         }                                                                      \
     }
 
-#define ARG_TYPECHECK(vm, args, name, typ)                                     \
+#define ARG_TYPECHECK(vm, argc, argv, name, typ)                               \
     {                                                                          \
-        obj_t *tmp = args;                                                     \
-        while (tmp != the_empty_list) {                                        \
-            if (car(tmp)->type != typ) {                                       \
+        for (int i = 0; i < argc; i++) {                                       \
+            if (obj_type(argv[i]) != typ) {                                    \
                 raise(vm, "%s can only operate on type %s", name,      \
                               type_name(typ));                                 \
             }                                                                  \
-            tmp = cdr(tmp);                                                    \
         }                                                                      \
     }
 
@@ -0,0 +1,504 @@
+#include "bignum.h"
+
+#include <limits.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef unsigned __int128 dlimb_t;
+
+/* the largest power of ten in a limb, for converting to and from decimal */
+#define DECIMAL_BASE 10000000000000000000UL
+#define DECIMAL_DIGITS 19
+
+/* Allocates 'n' zeroed limbs and a spare, so that none is still an
+ * allocation. */
+static limb_t *limbs_new(int n) {
+    limb_t *limbs = calloc(n + 1, sizeof(limb_t));
+    if (!limbs) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+    return limbs;
+}
+
+/* Drops leading zero limbs. */
+static void trim(big_t *a) {
+    while (a->len && a->limbs[a->len - 1] == 0) {
+        a->len--;
+    }
+    if (a->len == 0) {
+        a->sign = 1;
+    }
+}
+
+static int trimmed_len(const limb_t *a, int n) {
+    while (n && a[n - 1] == 0) {
+        n--;
+    }
+    return n;
+}
+
+/* Stein's algorithm: common factors of two are taken out with shifts,
+ * and odd ones by subtraction, so there is no division. */
+limb_t gcd_limb(limb_t a, limb_t b) {
+    if (a == 0)
+        return b;
+    if (b == 0)
+        return a;
+
+    int shift = __builtin_ctzll(a | b);
+    a >>= __builtin_ctzll(a);
+    do {
+        b >>= __builtin_ctzll(b);
+        if (a > b) {
+            limb_t t = a;
+            a = b;
+            b = t;
+        }
+        b -= a;
+    } while (b);
+
+    return a << shift;
+}
+
+/*
+ * Magnitudes. Each takes its operands as limb arrays with lengths, and
+ * writes a result the caller has made room for.
+ */
+
+static int mag_cmp(const limb_t *a, int an, const limb_t *b, int bn) {
+    if (an != bn) {
+        return an > bn ? 1 : -1;
+    }
+    for (int i = an - 1; i >= 0; i--) {
+        if (a[i] != b[i]) {
+            return a[i] > b[i] ? 1 : -1;
+        }
+    }
+    return 0;
+}
+
+/* a += b, where an >= bn. Returns the carry out of a. */
+static limb_t mag_add_to(limb_t *a, int an, const limb_t *b, int bn) {
+    limb_t carry = 0;
+    int i;
+    for (i = 0; i < bn; i++) {
+        dlimb_t t = (dlimb_t)a[i] + b[i] + carry;
+        a[i] = (limb_t)t;
+        carry = (limb_t)(t >> 64);
+    }
+    for (; carry && i < an; i++) {
+        carry = ++a[i] == 0;
+    }
+    return carry;
+}
+
+/* a -= b, where a >= b. */
+static void mag_sub_from(limb_t *a, int an, const limb_t *b, int bn) {
+    limb_t borrow = 0;
+    int i;
+    for (i = 0; i < bn; i++) {
+        limb_t x = a[i], y = b[i];
+        a[i] = x - y - borrow;
+        borrow = x < y || (x == y && borrow);
+    }
+    for (; borrow && i < an; i++) {
+        borrow = a[i]-- == 0;
+    }
+}
+
+/* r = a * b, with r of an + bn limbs. */
+static void mag_mul_school(limb_t *r, const limb_t *a, int an, const limb_t *b,
+                           int bn) {
+    memset(r, 0, (an + bn) * sizeof(limb_t));
+    for (int i = 0; i < an; i++) {
+        limb_t carry = 0;
+        for (int j = 0; j < bn; j++) {
+            dlimb_t t = (dlimb_t)a[i] * b[j] + r[i + j] + carry;
+            r[i + j] = (limb_t)t;
+            carry = (limb_t)(t >> 64);
+        }
+        r[i + bn] = carry;
+    }
+}
+
+/*
+ * r = a * b, with r of an + bn limbs. Karatsuba's method splits both at m
+ * limbs into a1:a0 and b1:b0 and gets the middle term from one product,
+ *
+ *   a1*b0 + a0*b1 = (a1 + a0)(b1 + b0) - a1*b1 - a0*b0,
+ *
+ * so three half-size multiplications do the work of four.
+ */
+static void mag_mul(limb_t *r, const limb_t *a, int an, const limb_t *b,
+                    int bn) {
+    if (an < bn) {
+        const limb_t *t = a;
+        a = b;
+        b = t;
+        int n = an;
+        an = bn;
+        bn = n;
+    }
+    if (bn < KARATSUBA_THRESHOLD) {
+        mag_mul_school(r, a, an, b, bn);
+        return;
+    }
+
+    int m = (an + 1) / 2;
+    if (bn <= m) {
+        /* b is too short to split: r = a0*b + a1*b shifted m limbs */
+        limb_t *high = limbs_new(an - m + bn);
+        mag_mul(r, a, m, b, bn);
+        memset(r + m + bn, 0, (an - m) * sizeof(limb_t));
+        mag_mul(high, a + m, an - m, b, bn);
+        mag_add_to(r + m, an + bn - m, high, an - m + bn);
+        free(high);
+        return;
+    }
+
+    /* a0*b0 goes in the low 2m limbs of r and a1*b1 above it */
+    mag_mul(r, a, m, b, m);
+    mag_mul(r + 2 * m, a + m, an - m, b + m, bn - m);
+
+    limb_t *sa = limbs_new(m + 1), *sb = limbs_new(m + 1);
+    memcpy(sa, a, m * sizeof(limb_t));
+    memcpy(sb, b, m * sizeof(limb_t));
+    sa[m] = mag_add_to(sa, m, a + m, an - m);
+    sb[m] = mag_add_to(sb, m, b + m, bn - m);
+    int san = trimmed_len(sa, m + 1), sbn = trimmed_len(sb, m + 1);
+
+    limb_t *mid = limbs_new(2 * m + 2);
+    if (san && sbn) {
+        mag_mul(mid, sa, san, sb, sbn);
+    }
+    mag_sub_from(mid, 2 * m + 2, r, 2 * m);
+    mag_sub_from(mid, 2 * m + 2, r + 2 * m, an + bn - 2 * m);
+    mag_add_to(r + m, an + bn - m, mid,
+               trimmed_len(mid, 2 * m + 2));
+
+    free(sa);
+    free(sb);
+    free(mid);
+}
+
+/* q = a / d, returning a % d. q has an limbs. */
+static limb_t mag_divmod_limb(limb_t *q, const limb_t *a, int an, limb_t d) {
+    dlimb_t rem = 0;
+    for (int i = an - 1; i >= 0; i--) {
+        dlimb_t cur = rem << 64 | a[i];
+        q[i] = (limb_t)(cur / d);
+        rem = cur % d;
+    }
+    return (limb_t)rem;
+}
+
+/*
+ * Knuth's algorithm D: q = a / b and r = a % b, for an >= bn >= 2 with a
+ * nonzero top limb of b. q has an - bn + 1 limbs and r has bn. Both are
+ * shifted so the divisor's top bit is set, which keeps each estimate of a
+ * quotient limb from two of the dividend's within two of the truth.
+ */
+static void mag_divmod(limb_t *q, limb_t *r, const limb_t *a, int an,
+                       const limb_t *b, int bn) {
+    int s = __builtin_clzll(b[bn - 1]);
+    limb_t *v = limbs_new(bn), *u = limbs_new(an + 1);
+
+    for (int i = bn - 1; i > 0; i--) {
+        v[i] = b[i] << s | (s ? b[i - 1] >> (64 - s) : 0);
+    }
+    v[0] = b[0] << s;
+    u[an] = s ? a[an - 1] >> (64 - s) : 0;
+    for (int i = an - 1; i > 0; i--) {
+        u[i] = a[i] << s | (s ? a[i - 1] >> (64 - s) : 0);
+    }
+    u[0] = a[0] << s;
+
+    for (int j = an - bn; j >= 0; j--) {
+        dlimb_t top = (dlimb_t)u[j + bn] << 64 | u[j + bn - 1];
+        dlimb_t qhat = top / v[bn - 1];
+        dlimb_t rhat = top % v[bn - 1];
+        while (qhat >> 64 ||
+               qhat * v[bn - 2] > (rhat << 64 | u[j + bn - 2])) {
+            qhat--;
+            rhat += v[bn - 1];
+            if (rhat >> 64) {
+                break;
+            }
+        }
+
+        /* u -= qhat * v, which may leave u one v too small */
+        __int128 k = 0, t;
+        for (int i = 0; i < bn; i++) {
+            dlimb_t p = qhat * v[i];
+            t = (__int128)u[i + j] - k - (limb_t)p;
+            u[i + j] = (limb_t)t;
+            k = (__int128)(p >> 64) - (t >> 64);
+        }
+        t = (__int128)u[j + bn] - k;
+        u[j + bn] = (limb_t)t;
+
+        q[j] = (limb_t)qhat;
+        if (t < 0) {
+            q[j]--;
+            u[j + bn] += mag_add_to(u + j, bn, v, bn);
+        }
+    }
+
+    if (r) {
+        for (int i = 0; i < bn - 1; i++) {
+            r[i] = u[i] >> s | (s ? u[i + 1] << (64 - s) : 0);
+        }
+        r[bn - 1] = u[bn - 1] >> s;
+    }
+
+    free(v);
+    free(u);
+}
+
+/*
+ * Integers.
+ */
+
+big_t big_from_long(long n) {
+    big_t a;
+    limb_t space;
+    big_borrow_long(&a, n, &space);
+    a.limbs = limbs_new(1);
+    a.limbs[0] = space;
+    return a;
+}
+
+big_t big_pow2(int k) {
+    big_t a = {limbs_new(k / 64 + 1), k / 64 + 1, 1};
+    a.limbs[k / 64] = (limb_t)1 << (k % 64);
+    return a;
+}
+
+big_t big_copy(const big_t *a) {
+    big_t c = *a;
+    c.limbs = limbs_new(a->len);
+    memcpy(c.limbs, a->limbs, a->len * sizeof(limb_t));
+    return c;
+}
+
+void big_free(big_t *a) {
+    free(a->limbs);
+    a->limbs = NULL;
+    a->len = 0;
+    a->sign = 1;
+}
+
+/* Reads a run of decimal digits, DECIMAL_DIGITS at a time. */
+big_t big_from_digits(const char *digits, int n) {
+    big_t a = {limbs_new(n / DECIMAL_DIGITS + 1), 0, 1};
+
+    int chunk = n % DECIMAL_DIGITS ? n % DECIMAL_DIGITS : DECIMAL_DIGITS;
+    for (int i = 0; i < n; i += chunk, chunk = DECIMAL_DIGITS) {
+        limb_t scale = 1, value = 0;
+        for (int j = 0; j < chunk; j++) {
+            scale *= 10;
+            value = value * 10 + (digits[i + j] - '0');
+        }
+
+        limb_t carry = value;
+        for (int j = 0; j < a.len; j++) {
+            dlimb_t t = (dlimb_t)a.limbs[j] * scale + carry;
+            a.limbs[j] = (limb_t)t;
+            carry = (limb_t)(t >> 64);
+        }
+        if (carry) {
+            a.limbs[a.len++] = carry;
+        }
+    }
+
+    return a;
+}
+
+/* Stores 'a' in 'n' and returns 1 if it fits in a long. */
+int big_to_long(const big_t *a, long *n) {
+    if (a->len == 0) {
+        *n = 0;
+        return 1;
+    }
+    if (a->len > 1) {
+        return 0;
+    }
+
+    limb_t m = a->limbs[0];
+    if (a->sign > 0 ? m > (limb_t)LONG_MAX : m > (limb_t)LONG_MAX + 1) {
+        return 0;
+    }
+    *n = a->sign > 0 ? (long)m : (long)-m;
+    return 1;
+}
+
+int big_bit_length(const big_t *a) {
+    if (a->len == 0) {
+        return 0;
+    }
+    return 64 * a->len - __builtin_clzll(a->limbs[a->len - 1]);
+}
+
+/* Rounds just once: the top 64 bits, with the lowest set if any bit below
+ * them is, are converted to the nearest double. */
+double big_to_double(const big_t *a) {
+    int bits = big_bit_length(a);
+    if (bits <= 64) {
+        return a->len ? a->sign * (double)a->limbs[0] : 0.0;
+    }
+
+    int shift = bits - 64, limb = shift / 64, offset = shift % 64;
+    limb_t top = a->limbs[limb] >> offset;
+    int sticky = 0;
+    if (offset) {
+        top |= a->limbs[limb + 1] << (64 - offset);
+        sticky = (a->limbs[limb] & (((limb_t)1 << offset) - 1)) != 0;
+    }
+    for (int i = 0; i < limb && !sticky; i++) {
+        sticky = a->limbs[i] != 0;
+    }
+
+    return a->sign * ldexp((double)(top | sticky), shift);
+}
+
+/* Divides out DECIMAL_BASE repeatedly and prints the remainders from the
+ * most significant, the later ones zero-padded. */
+char *big_to_string(const big_t *a) {
+    int n = a->len;
+    limb_t *q = limbs_new(n);
+    memcpy(q, a->limbs, n * sizeof(limb_t));
+
+    limb_t *chunks = limbs_new(n * 2 + 1);
+    int nchunks = 0;
+    while (n) {
+        chunks[nchunks++] = mag_divmod_limb(q, q, n, DECIMAL_BASE);
+        n = trimmed_len(q, n);
+    }
+
+    char *str = malloc(nchunks * DECIMAL_DIGITS + 3);
+    char *p = str;
+    if (a->sign < 0) {
+        *p++ = '-';
+    }
+    p += sprintf(p, "%lu", nchunks ? (unsigned long)chunks[nchunks - 1] : 0UL);
+    for (int i = nchunks - 2; i >= 0; i--) {
+        p += sprintf(p, "%019lu", (unsigned long)chunks[i]);
+    }
+
+    free(q);
+    free(chunks);
+    return str;
+}
+
+int big_cmp(const big_t *a, const big_t *b) {
+    if (a->sign != b->sign) {
+        return a->sign;
+    }
+    return a->sign * mag_cmp(a->limbs, a->len, b->limbs, b->len);
+}
+
+/* Adds 'b' to 'a' with b's sign multiplied by 'bsign'. */
+static big_t add_signed(const big_t *a, const big_t *b, int bsign) {
+    bsign *= b->sign;
+    if (a->sign == bsign) {
+        const big_t *x = a->len >= b->len ? a : b;
+        const big_t *y = x == a ? b : a;
+        big_t r = {limbs_new(x->len + 1), x->len + 1, a->sign};
+        memcpy(r.limbs, x->limbs, x->len * sizeof(limb_t));
+        r.limbs[x->len] = mag_add_to(r.limbs, x->len, y->limbs, y->len);
+        trim(&r);
+        return r;
+    }
+
+    int c = mag_cmp(a->limbs, a->len, b->limbs, b->len);
+    const big_t *x = c >= 0 ? a : b;
+    const big_t *y = x == a ? b : a;
+    big_t r = {limbs_new(x->len), x->len, c >= 0 ? a->sign : bsign};
+    memcpy(r.limbs, x->limbs, x->len * sizeof(limb_t));
+    mag_sub_from(r.limbs, r.len, y->limbs, y->len);
+    trim(&r);
+    return r;
+}
+
+big_t big_add(const big_t *a, const big_t *b) { return add_signed(a, b, 1); }
+
+big_t big_sub(const big_t *a, const big_t *b) { return add_signed(a, b, -1); }
+
+big_t big_mul(const big_t *a, const big_t *b) {
+    if (a->len == 0 || b->len == 0) {
+        return (big_t){limbs_new(0), 0, 1};
+    }
+    big_t r = {limbs_new(a->len + b->len), a->len + b->len, a->sign * b->sign};
+    mag_mul(r.limbs, a->limbs, a->len, b->limbs, b->len);
+    trim(&r);
+    return r;
+}
+
+/* Truncating division, so the remainder takes the sign of 'a', as with C's
+ * / and %. Either of 'q' and 'r' may be NULL. 'b' must not be zero. */
+void big_divmod(const big_t *a, const big_t *b, big_t *q, big_t *r) {
+    big_t quot = {NULL, 0, a->sign * b->sign};
+    big_t rem = {NULL, 0, a->sign};
+
+    if (mag_cmp(a->limbs, a->len, b->limbs, b->len) < 0) {
+        quot.limbs = limbs_new(0);
+        rem = big_copy(a);
+    } else if (b->len == 1) {
+        quot.limbs = limbs_new(a->len);
+        quot.len = a->len;
+        rem.limbs = limbs_new(1);
+        rem.limbs[0] = mag_divmod_limb(quot.limbs, a->limbs, a->len,
+                                       b->limbs[0]);
+        rem.len = 1;
+    } else {
+        quot.len = a->len - b->len + 1;
+        quot.limbs = limbs_new(quot.len);
+        rem.len = b->len;
+        rem.limbs = limbs_new(rem.len);
+        mag_divmod(quot.limbs, rem.limbs, a->limbs, a->len, b->limbs, b->len);
+    }
+
+    trim(&quot);
+    trim(&rem);
+    if (q) {
+        *q = quot;
+    } else {
+        big_free(&quot);
+    }
+    if (r) {
+        *r = rem;
+    } else {
+        big_free(&rem);
+    }
+}
+
+/* Euclid's algorithm on the magnitudes, finished by Stein's once both
+ * fit in a limb. */
+big_t big_gcd(const big_t *a, const big_t *b) {
+    big_t x = big_copy(a), y = big_copy(b);
+    x.sign = y.sign = 1;
+
+    while (y.len && (x.len > 1 || y.len > 1)) {
+        big_t r;
+        big_divmod(&x, &y, NULL, &r);
+        big_free(&x);
+        x = y;
+        y = r;
+    }
+
+    if (y.len == 0) {
+        big_free(&y);
+        return x;
+    }
+
+    limb_t g = gcd_limb(x.len ? x.limbs[0] : 0, y.limbs[0]);
+    big_free(&x);
+    big_free(&y);
+
+    big_t r = {limbs_new(1), g != 0, 1};
+    r.limbs[0] = g;
+    return r;
+}
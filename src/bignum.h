@@ -0,0 +1,62 @@
+#ifndef BIGNUM_H
+#define BIGNUM_H
+
+#include <stdint.h>
+
+/*
+ * Arbitrary-precision integers, held as a sign and a magnitude of 64-bit
+ * limbs, least significant first, with no leading zero limbs. Zero has no
+ * limbs and a positive sign.
+ *
+ * Operations return fresh integers the caller must big_free(); their
+ * arguments are left alone, so an integer can borrow limbs it doesn't own
+ * as long as nobody frees it.
+ */
+typedef uint64_t limb_t;
+
+typedef struct big_t {
+    limb_t *limbs;
+    int len;
+    int sign; /* 1 or -1 */
+} big_t;
+
+/* multiplication recurses by Karatsuba's method once both operands have
+ * this many limbs, and is done the schoolbook way below it */
+#define KARATSUBA_THRESHOLD 32
+
+limb_t gcd_limb(limb_t a, limb_t b);
+
+big_t big_from_long(long n);
+big_t big_from_digits(const char *digits, int n);
+big_t big_pow2(int k);
+big_t big_copy(const big_t *a);
+void big_free(big_t *a);
+
+int big_bit_length(const big_t *a);
+int big_to_long(const big_t *a, long *n);
+double big_to_double(const big_t *a);
+char *big_to_string(const big_t *a);
+
+int big_cmp(const big_t *a, const big_t *b);
+
+big_t big_add(const big_t *a, const big_t *b);
+big_t big_sub(const big_t *a, const big_t *b);
+big_t big_mul(const big_t *a, const big_t *b);
+void big_divmod(const big_t *a, const big_t *b, big_t *q, big_t *r);
+big_t big_gcd(const big_t *a, const big_t *b);
+
+static inline int big_is_zero(const big_t *a) { return a->len == 0; }
+
+static inline int big_is_one(const big_t *a) {
+    return a->len == 1 && a->limbs[0] == 1 && a->sign > 0;
+}
+
+/* Makes 'a' borrow 'space' for the value of 'n'. */
+static inline void big_borrow_long(big_t *a, long n, limb_t *space) {
+    a->limbs = space;
+    a->sign = n < 0 ? -1 : 1;
+    *space = n < 0 ? -(limb_t)n : (limb_t)n;
+    a->len = n != 0;
+}
+
+#endif
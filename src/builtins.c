@@ -1,372 +1,1026 @@
 #include "assert.h"
 #include "builtins.h"
 #include "numbers.h"
+#include "numvec.h"
 #include "read.h"
 
 #include <ctype.h>
+#include <math.h>
 
 /* ------------------ math ----------------------- */
 
-obj_t *builtin_plus(VM *vm, obj_t *args) {
-    obj_t *res = mk_num_from_long(vm, 0l, 1l);
-    while (!is_the_empty_list(args)) {
-        obj_t *x = car(args);
+/* The arithmetic builtins check their arguments and leave the rest to
+ * num_fold(), which allocates nothing but the result. */
+
+obj_t *builtin_plus(VM *vm, int argc, obj_t **argv) {
+    if (argc == 0) {
+        return mk_fixnum(0);
+    }
+
+    for (int i = 0; i < argc; i++) {
+        obj_t *x = argv[i];
         if (!is_num(x)) {
-            raise(vm, "invalid argument of type '%s' passed to '+'", type_name(x->type));
+            raise(vm, "invalid argument of type '%s' passed to '+'", type_name(obj_type(x)));
         }
-        res = num_add(vm, res, x);
-        args = cdr(args);
     }
-    return res;
+    return argc == 1 ? argv[0] : num_fold(vm, FOLD_ADD, argc, argv);
 }
 
-obj_t *builtin_minus(VM *vm, obj_t *args) {
-    if (args == the_empty_list) {
+obj_t *builtin_minus(VM *vm, int argc, obj_t **argv) {
+    if (argc == 0) {
         raise(vm, "incorrect argument count for '-'");
     }
 
-    obj_t *res = car(args);
-    if (!is_num(res)) {
-        raise(vm, "invalid argument passed to '-'");
+    for (int i = 0; i < argc; i++) {
+        if (!is_num(argv[i])) {
+            raise(vm, "invalid argument passed to '-'");
+        }
     }
 
     /* unary minus */
-    if (is_the_empty_list(cdr(args))) {
-        long numer = -1 * res->numer;
-        long denom = res->denom;
-        return mk_num_from_long(vm, numer, denom);
-    }
-
-    args = cdr(args);
-    while (!is_the_empty_list(args)) {
-        obj_t *x = car(args);
-        if (!is_num(x)) {
-            raise(vm, "invalid argument passed to '-'");
+    obj_t *res = argv[0];
+    if (argc == 1) {
+        if (is_double(res)) {
+            return mk_double(vm, -res->dbl);
         }
-        res = num_sub(vm, res, x);
-        args = cdr(args);
+        return num_sub(vm, mk_fixnum(0), res);
     }
 
-    return res;
+    return num_fold(vm, FOLD_SUB, argc, argv);
 }
 
-obj_t *builtin_times(VM *vm, obj_t *args) {
-    obj_t *res = mk_num_from_long(vm, 1l, 1l);
-    while (!is_the_empty_list(args)) {
-        obj_t *x = car(args);
-        if (!is_num(x)) {
+obj_t *builtin_times(VM *vm, int argc, obj_t **argv) {
+    if (argc == 0) {
+        return mk_fixnum(1);
+    }
+
+    for (int i = 0; i < argc; i++) {
+        if (!is_num(argv[i])) {
             raise(vm, "invalid argument passed to '*'");
         }
-        res = num_mul(vm, res, x);
-        args = cdr(args);
     }
-
-    return res;
+    return argc == 1 ? argv[0] : num_fold(vm, FOLD_MUL, argc, argv);
 }
 
-obj_t *builtin_divide(VM *vm, obj_t *args) {
-    if (args == the_empty_list) {
+obj_t *builtin_divide(VM *vm, int argc, obj_t **argv) {
+    if (argc == 0) {
         raise(vm, "incorrect argument count for '/'");
     }
 
-    obj_t *res = car(args);
-    if (!is_num(res)) {
-        raise(vm, "invalid argument passed to '/'");
-    }
-
-    args = cdr(args);
-    while (!is_the_empty_list(args)) {
-        obj_t *x = car(args);
+    for (int i = 0; i < argc; i++) {
+        obj_t *x = argv[i];
         if (!is_num(x)) {
             raise(vm, "invalid argument passed to '/'");
         }
-        if (x->numer == 0) {
+        if ((i > 0 || argc == 1) && x == mk_fixnum(0)) {
             raise(vm, "division by zero");
         }
-        res = num_div(vm, res, x);
-        args = cdr(args);
     }
-
-    return res;
+    /* (/ x) is the reciprocal of x */
+    if (argc == 1) {
+        return num_div(vm, mk_fixnum(1), argv[0]);
+    }
+    return num_fold(vm, FOLD_DIV, argc, argv);
 }
 
-obj_t *builtin_remainder(VM *vm, obj_t *args) {
-    if (args == the_empty_list) {
+obj_t *builtin_remainder(VM *vm, int argc, obj_t **argv) {
+    if (argc == 0) {
         raise(vm, "incorrect argument count for 'mod'");
     }
 
-    obj_t *res = car(args);
-    if (!is_num(res) || res->denom != 1) {
+    obj_t *res = argv[0];
+    if (!is_integer(res)) {
         raise(vm, "invalid argument passed to 'mod'");
     }
 
-    args = cdr(args);
-    while (!is_the_empty_list(args)) {
-        obj_t *x = car(args);
-        if (!is_num(res) || res->denom != 1) {
+    for (int i = 1; i < argc; i++) {
+        obj_t *x = argv[i];
+        if (!is_integer(x)) {
             raise(vm, "invalid argument passed to 'mod'");
         }
-        if (res->numer == 0) {
+        if (x == mk_fixnum(0)) {
             raise(vm, "division by zero");
         }
         res = num_mod(vm, res, x);
-        args = cdr(args);
     }
 
     return res;
 }
 
-/* ------------------ comparison/equality ----------------------- */
+obj_t *builtin_exact_to_inexact(VM *vm, int argc, obj_t **argv) {
+    ARG_NUMCHECK(vm, argc, "exact->inexact", 1);
+    FIG_ASSERT(vm, is_num(argv[0]),
+               "invalid argument passed to 'exact->inexact'");
+    return num_inexact(vm, argv[0]);
+}
+
+obj_t *builtin_inexact_to_exact(VM *vm, int argc, obj_t **argv) {
+    ARG_NUMCHECK(vm, argc, "inexact->exact", 1);
+    FIG_ASSERT(vm, is_num(argv[0]),
+               "invalid argument passed to 'inexact->exact'");
+    return num_exact(vm, argv[0]);
+}
+
+/* Applies 'fn' to the single number in argv, made a double. */
+static obj_t *apply_double(VM *vm, int argc, obj_t **argv, char *name,
+                           double (*fn)(double)) {
+    ARG_NUMCHECK(vm, argc, name, 1);
+    if (!is_num(argv[0])) {
+        raise(vm, "invalid argument passed to '%s'", name);
+    }
+    return mk_double(vm, fn(num_to_double(argv[0])));
+}
 
-obj_t *builtin_gt(VM *vm, obj_t *args) {
-    ARG_TYPECHECK(vm, args, "gt", OBJ_NUM);
-    ARG_NUMCHECK(vm, args, "gt", 2);
+obj_t *builtin_exp(VM *vm, int argc, obj_t **argv) {
+    return apply_double(vm, argc, argv, "exp", exp);
+}
+
+obj_t *builtin_sin(VM *vm, int argc, obj_t **argv) {
+    return apply_double(vm, argc, argv, "sin", sin);
+}
+
+obj_t *builtin_cos(VM *vm, int argc, obj_t **argv) {
+    return apply_double(vm, argc, argv, "cos", cos);
+}
+
+obj_t *builtin_tan(VM *vm, int argc, obj_t **argv) {
+    return apply_double(vm, argc, argv, "tan", tan);
+}
+
+obj_t *builtin_asin(VM *vm, int argc, obj_t **argv) {
+    return apply_double(vm, argc, argv, "asin", asin);
+}
 
-    obj_t *a = car(args);
-    obj_t *b = cadr(args);
+obj_t *builtin_acos(VM *vm, int argc, obj_t **argv) {
+    return apply_double(vm, argc, argv, "acos", acos);
+}
 
-    return num_gt(vm, a, b);
+/* (log z) or (log z base) */
+obj_t *builtin_log(VM *vm, int argc, obj_t **argv) {
+    if (argc == 1) {
+        return apply_double(vm, argc, argv, "log", log);
+    }
+    ARG_NUMCHECK(vm, argc, "log", 2);
+    FIG_ASSERT(vm, is_num(argv[0]) && is_num(argv[1]),
+               "invalid argument passed to 'log'");
+    return mk_double(vm, log(num_to_double(argv[0])) /
+                             log(num_to_double(argv[1])));
 }
 
-obj_t *builtin_gte(VM *vm, obj_t *args) {
-    ARG_TYPECHECK(vm, args, "gte", OBJ_NUM);
-    ARG_NUMCHECK(vm, args, "gte", 2);
+/* (atan z) or (atan y x) */
+obj_t *builtin_atan(VM *vm, int argc, obj_t **argv) {
+    if (argc == 1) {
+        return apply_double(vm, argc, argv, "atan", atan);
+    }
+    ARG_NUMCHECK(vm, argc, "atan", 2);
+    FIG_ASSERT(vm, is_num(argv[0]) && is_num(argv[1]),
+               "invalid argument passed to 'atan'");
+    return mk_double(vm, atan2(num_to_double(argv[0]), num_to_double(argv[1])));
+}
 
-    obj_t *a = car(args);
-    obj_t *b = cadr(args);
+/* Returns the square root of 'n' if it is a perfect square, else -1. */
+static long exact_sqrt(long n) {
+    if (n < 0) {
+        return -1;
+    }
+    long root = (long)sqrt((double)n);
+    while (root * root > n) {
+        root--;
+    }
+    while ((root + 1) * (root + 1) <= n) {
+        root++;
+    }
+    return root * root == n ? root : -1;
+}
 
-    return num_gte(vm, a, b);
+/* Exact when the argument is a fraction of perfect squares. */
+obj_t *builtin_sqrt(VM *vm, int argc, obj_t **argv) {
+    ARG_NUMCHECK(vm, argc, "sqrt", 1);
+    obj_t *x = argv[0];
+    if (is_fixnum(x) || obj_type(x) == OBJ_NUM) {
+        long numer = exact_sqrt(num_numer(x));
+        long denom = exact_sqrt(num_denom(x));
+        if (numer >= 0 && denom > 0) {
+            return mk_num_from_long(vm, numer, denom);
+        }
+    }
+    return apply_double(vm, argc, argv, "sqrt", sqrt);
 }
 
-obj_t *builtin_lt(VM *vm, obj_t *args) {
-    ARG_TYPECHECK(vm, args, "lt", OBJ_NUM);
-    ARG_NUMCHECK(vm, args, "lt", 2);
+/* Exact when an exact base is raised to a fixnum power, by squaring. */
+obj_t *builtin_expt(VM *vm, int argc, obj_t **argv) {
+    ARG_NUMCHECK(vm, argc, "expt", 2);
+    obj_t *base = argv[0], *power = argv[1];
+    FIG_ASSERT(vm, is_num(base) && is_num(power),
+               "invalid argument passed to 'expt'");
 
-    obj_t *a = car(args);
-    obj_t *b = cadr(args);
+    if (is_double(base) || !is_fixnum(power)) {
+        return mk_double(vm, pow(num_to_double(base), num_to_double(power)));
+    }
+
+    long n = fixnum_value(power);
+    if (n < 0 && base == mk_fixnum(0)) {
+        raise(vm, "division by zero");
+    }
 
-    return num_lt(vm, a, b);
+    obj_t *result = mk_fixnum(1);
+    for (long k = n < 0 ? -n : n; k; k >>= 1) {
+        if (k & 1) {
+            result = num_mul(vm, result, base);
+        }
+        if (k > 1) {
+            base = num_mul(vm, base, base);
+        }
+    }
+    return n < 0 ? num_div(vm, mk_fixnum(1), result) : result;
 }
 
-obj_t *builtin_lte(VM *vm, obj_t *args) {
-    ARG_TYPECHECK(vm, args, "lte", OBJ_NUM);
-    ARG_NUMCHECK(vm, args, "lte", 2);
+/* ------------------ comparison/equality ----------------------- */
 
-    obj_t *a = car(args);
-    obj_t *b = cadr(args);
+/* (< a b c ...) holds if each argument is less than the next, and so on.
+ * Every argument is checked to be a number before any are compared, and
+ * comparing stops at the first pair out of order. */
+static obj_t *compare_chain(VM *vm, int argc, obj_t **argv, char *name,
+                            int accept) {
+    if (argc == 0) {
+        raise(vm, "incorrect argument count for '%s'", name);
+    }
+    for (int i = 0; i < argc; i++) {
+        FIG_ASSERT(vm, is_num(argv[i]), "%s can only operate on type number",
+                   name);
+    }
+    return num_ordered(argc, argv, accept) ? true : false;
+}
 
-    return num_lte(vm, a, b);
+obj_t *builtin_gt(VM *vm, int argc, obj_t **argv) {
+    return compare_chain(vm, argc, argv, "gt", NUM_GREATER);
 }
 
-obj_t *builtin_numeq(VM *vm, obj_t *args) {
-    ARG_TYPECHECK(vm, args, "=", OBJ_NUM);
-    ARG_NUMCHECK(vm, args, "=", 2);
+obj_t *builtin_gte(VM *vm, int argc, obj_t **argv) {
+    return compare_chain(vm, argc, argv, "gte", NUM_GREATER | NUM_EQUAL);
+}
 
-    obj_t *a = car(args);
-    obj_t *b = cadr(args);
+obj_t *builtin_lt(VM *vm, int argc, obj_t **argv) {
+    return compare_chain(vm, argc, argv, "lt", NUM_LESS);
+}
+
+obj_t *builtin_lte(VM *vm, int argc, obj_t **argv) {
+    return compare_chain(vm, argc, argv, "lte", NUM_LESS | NUM_EQUAL);
+}
 
-    return num_eq(vm, a, b);
+obj_t *builtin_numeq(VM *vm, int argc, obj_t **argv) {
+    return compare_chain(vm, argc, argv, "=", NUM_EQUAL);
 }
 
 /* -------------------- type predicates ------------------ */
 
-obj_t *builtin_is_null(VM *vm, obj_t *args) {
-    ARG_NUMCHECK(vm, args, "null?", 1);
-    return car(args) == the_empty_list ? true : false;
+obj_t *builtin_is_null(VM *vm, int argc, obj_t **argv) {
+    ARG_NUMCHECK(vm, argc, "null?", 1);
+    return argv[0] == the_empty_list ? true : false;
 }
 
-obj_t *builtin_is_boolean(VM *vm, obj_t *args) {
-    ARG_NUMCHECK(vm, args, "boolean?", 1);
-    return is_boolean(car(args)) ? true : false;
+obj_t *builtin_is_boolean(VM *vm, int argc, obj_t **argv) {
+    ARG_NUMCHECK(vm, argc, "boolean?", 1);
+    return is_boolean(argv[0]) ? true : false;
 }
 
-obj_t *builtin_is_symbol(VM *vm, obj_t *args) {
-    ARG_NUMCHECK(vm, args, "symbol?", 1);
-    return is_symbol(car(args)) ? true : false;
+obj_t *builtin_is_symbol(VM *vm, int argc, obj_t **argv) {
+    ARG_NUMCHECK(vm, argc, "symbol?", 1);
+    return is_symbol(argv[0]) ? true : false;
 }
 
-obj_t *builtin_is_num(VM *vm, obj_t *args) {
-    ARG_NUMCHECK(vm, args, "number?", 1);
-    obj_t *num = car(args);
+obj_t *builtin_is_num(VM *vm, int argc, obj_t **argv) {
+    ARG_NUMCHECK(vm, argc, "number?", 1);
+    obj_t *num = argv[0];
     return is_num(num) ? true : false;
 }
 
-obj_t *builtin_is_integer(VM *vm, obj_t *args) {
-    ARG_NUMCHECK(vm, args, "integer?", 1);
-    obj_t *num = car(args);
+obj_t *builtin_is_exact(VM *vm, int argc, obj_t **argv) {
+    ARG_NUMCHECK(vm, argc, "exact?", 1);
+    FIG_ASSERT(vm, is_num(argv[0]), "invalid argument passed to 'exact?'");
+    return is_double(argv[0]) ? false : true;
+}
+
+obj_t *builtin_is_inexact(VM *vm, int argc, obj_t **argv) {
+    ARG_NUMCHECK(vm, argc, "inexact?", 1);
+    FIG_ASSERT(vm, is_num(argv[0]), "invalid argument passed to 'inexact?'");
+    return is_double(argv[0]) ? true : false;
+}
+
+obj_t *builtin_is_integer(VM *vm, int argc, obj_t **argv) {
+    ARG_NUMCHECK(vm, argc, "integer?", 1);
+    obj_t *num = argv[0];
     return is_integer(num) ? true : false;
 }
 
-obj_t *builtin_is_char(VM *vm, obj_t *args) {
-    ARG_NUMCHECK(vm, args, "char?", 1);
-    return is_char(car(args)) ? true : false;
+obj_t *builtin_is_char(VM *vm, int argc, obj_t **argv) {
+    ARG_NUMCHECK(vm, argc, "char?", 1);
+    return is_char(argv[0]) ? true : false;
 }
 
-obj_t *builtin_is_string(VM *vm, obj_t *args) {
-    ARG_NUMCHECK(vm, args, "string?", 1);
-    return is_string(car(args)) ? true : false;
+obj_t *builtin_is_string(VM *vm, int argc, obj_t **argv) {
+    ARG_NUMCHECK(vm, argc, "string?", 1);
+    return is_string(argv[0]) ? true : false;
 }
 
-obj_t *builtin_is_pair(VM *vm, obj_t *args) {
-    ARG_NUMCHECK(vm, args, "pair?", 1);
-    return is_pair(car(args)) ? true : false;
+obj_t *builtin_is_pair(VM *vm, int argc, obj_t **argv) {
+    ARG_NUMCHECK(vm, argc, "pair?", 1);
+    return is_pair(argv[0]) ? true : false;
 }
 
-obj_t *builtin_is_list(VM *vm, obj_t *args) {
-    ARG_NUMCHECK(vm, args, "list?", 1);
-    return is_list(car(args)) ? true : false;
+obj_t *builtin_is_list(VM *vm, int argc, obj_t **argv) {
+    ARG_NUMCHECK(vm, argc, "list?", 1);
+    return is_list(argv[0]) ? true : false;
 }
 
-obj_t *builtin_is_vector(VM *vm, obj_t *args) {
-    ARG_NUMCHECK(vm, args, "vector?", 1);
-    return is_vector(car(args)) ? true : false;
+obj_t *builtin_is_vector(VM *vm, int argc, obj_t **argv) {
+    ARG_NUMCHECK(vm, argc, "vector?", 1);
+    return is_vector(argv[0]) ? true : false;
 }
 
-obj_t *builtin_is_proc(VM *vm, obj_t *args) {
-    ARG_NUMCHECK(vm, args, "proc?", 1);
-    return is_builtin(car(args)) ? true : false;
+obj_t *builtin_is_proc(VM *vm, int argc, obj_t **argv) {
+    ARG_NUMCHECK(vm, argc, "proc?", 1);
+    return is_builtin(argv[0]) ? true : false;
 }
 
 /* ------------------------ pairs/lists ------------------------ */
 
-obj_t *builtin_cons(VM *vm, obj_t *args) {
-    ARG_NUMCHECK(vm, args, "cons", 2);
-    obj_t *car_obj = car(args);
-    obj_t *cdr_obj = cadr(args);
+obj_t *builtin_cons(VM *vm, int argc, obj_t **argv) {
+    ARG_NUMCHECK(vm, argc, "cons", 2);
+    obj_t *car_obj = argv[0];
+    obj_t *cdr_obj = argv[1];
     return mk_cons(vm, car_obj, cdr_obj);
 }
 
-obj_t *builtin_car(VM *vm, obj_t *args) {
-    ARG_NUMCHECK(vm, args, "car", 1);
-    ARG_TYPECHECK(vm, args, "car", OBJ_PAIR);
-    return caar(args);
+obj_t *builtin_car(VM *vm, int argc, obj_t **argv) {
+    ARG_NUMCHECK(vm, argc, "car", 1);
+    ARG_TYPECHECK(vm, argc, argv, "car", OBJ_PAIR);
+    return car(argv[0]);
 }
 
-obj_t *builtin_cdr(VM *vm, obj_t *args) {
-    ARG_NUMCHECK(vm, args, "cdr", 1);
-    ARG_TYPECHECK(vm, args, "cdr", OBJ_PAIR);
-    return cdar(args);
+obj_t *builtin_cdr(VM *vm, int argc, obj_t **argv) {
+    ARG_NUMCHECK(vm, argc, "cdr", 1);
+    ARG_TYPECHECK(vm, argc, argv, "cdr", OBJ_PAIR);
+    return cdr(argv[0]);
 }
 
-obj_t *builtin_setcar(VM *vm, obj_t *args) {
-    ARG_NUMCHECK(vm, args, "set-car!", 2);
-    FIG_ASSERT(vm, is_pair(car(args)), "invalid argument passed to set-car!");
-    obj_t *arg = car(args);
-    arg->car = cadr(args);
+obj_t *builtin_setcar(VM *vm, int argc, obj_t **argv) {
+    ARG_NUMCHECK(vm, argc, "set-car!", 2);
+    FIG_ASSERT(vm, is_pair(argv[0]), "invalid argument passed to set-car!");
+    set_car(argv[0], argv[1]);
     return NULL;
 }
 
-obj_t *builtin_setcdr(VM *vm, obj_t *args) {
-    ARG_NUMCHECK(vm, args, "set-cdr!", 2);
-    FIG_ASSERT(vm, is_pair(car(args)), "invalid argument passed to set-cdr!");
-    obj_t *arg = car(args);
-    arg->cdr = cadr(args);
+obj_t *builtin_setcdr(VM *vm, int argc, obj_t **argv) {
+    ARG_NUMCHECK(vm, argc, "set-cdr!", 2);
+    FIG_ASSERT(vm, is_pair(argv[0]), "invalid argument passed to set-cdr!");
+    set_cdr(argv[0], argv[1]);
     return NULL;
 }
 
+/* takes its arguments as a list, see register_list_builtin */
 obj_t *builtin_list(VM *vm, obj_t *args) {
-    push(vm, args);
     return args;
 }
 
 /* ---------------------- vectors ----------------------------*/
 
-obj_t *builtin_make_vector(VM *vm, obj_t *args) {
-    if (!is_the_empty_list(cdr(args)) && !is_the_empty_list(cddr(args))) {
+obj_t *builtin_make_vector(VM *vm, int argc, obj_t **argv) {
+    if (argc != 1 && argc != 2) {
         raise(vm, "incorrect argument count to 'make-vector'");
     }
 
-    obj_t *size = car(args);
-    if (!is_integer(size)) {
+    obj_t *size = argv[0];
+    if (!is_fixnum(size)) {
         raise(vm, "invalid argument passed to 'make-vector'");
     }
 
-    obj_t **objects = malloc(sizeof(obj_t *) * size->numer);
+    long n = num_numer(size);
+    obj_t *fill = argc == 1 ? mk_fixnum(0) : argv[1];
 
-    if (is_the_empty_list(cdr(args))) {
-        for (int i = 0; i < size->numer; i++) {
-            objects[i] = mk_num_from_long(vm, 0l, 1l);
-        }
-    } else {
-        obj_t *fill = cadr(args);
-        for (int i = 0; i < size->numer; i++) {
-            objects[i] = fill;
-        }
+    obj_t **objects = malloc(sizeof(obj_t *) * n);
+    for (long i = 0; i < n; i++) {
+        objects[i] = fill;
     }
 
-    return mk_vec(vm, objects, size->numer);
+    obj_t *vec = mk_vec(vm, objects, n);
+    push(vm, vec);
+    return vec;
 }
 
-obj_t *builtin_vector_length(VM *vm, obj_t *args) {
-    ARG_NUMCHECK(vm, args, "vector-length", 1);
-    obj_t *vec = car(args);
+obj_t *builtin_vector_length(VM *vm, int argc, obj_t **argv) {
+    ARG_NUMCHECK(vm, argc, "vector-length", 1);
+    obj_t *vec = argv[0];
     return mk_num_from_long(vm, vec->size, 1l);
 }
 
-obj_t *builtin_vector_ref(VM *vm, obj_t *args) {
-    ARG_NUMCHECK(vm, args, "vector-ref", 2);
+obj_t *builtin_vector_ref(VM *vm, int argc, obj_t **argv) {
+    ARG_NUMCHECK(vm, argc, "vector-ref", 2);
 
-    obj_t *vec = car(args);
+    obj_t *vec = argv[0];
     if (!is_vector(vec)) {
         raise(vm, "invalid argument passed to 'vector-ref'");
     }
 
-    obj_t *k = cadr(args);
-    if (!is_integer(k)) {
+    obj_t *k = argv[1];
+    if (!is_fixnum(k)) {
         raise(vm, "invalid argument passed to 'vector-ref'");
     }
 
-    if (k->numer < 0 || k->numer >= vec->size) {
+    long i = num_numer(k);
+    if (i < 0 || i >= vec->size) {
         raise(vm, "index out of bounds in 'vector-ref'");
     }
 
-    return vec->objects[k->numer];
+    return vec->objects[i];
 }
 
-obj_t *builtin_vector_set(VM *vm, obj_t *args) {
-    ARG_NUMCHECK(vm, args, "vector-set!", 3);
+obj_t *builtin_vector_set(VM *vm, int argc, obj_t **argv) {
+    ARG_NUMCHECK(vm, argc, "vector-set!", 3);
 
-    obj_t *vec = car(args);
+    obj_t *vec = argv[0];
     if (!is_vector(vec)) {
         raise(vm, "invalid argument passed to 'vector-ref'");
     }
 
-    obj_t *k = cadr(args);
-    if (!is_integer(k)) {
+    obj_t *k = argv[1];
+    if (!is_fixnum(k)) {
         raise(vm, "invalid argument passed to 'vector-ref'");
     }
 
-    if (k->numer < 0 || k->numer >= vec->size) {
+    long i = num_numer(k);
+    if (i < 0 || i >= vec->size) {
         raise(vm, "index out of bounds in 'vector-ref'");
     }
 
-    obj_t *obj = caddr(args);
-    vec->objects[k->numer] = obj;
+    obj_t *obj = argv[2];
+    vec->objects[i] = obj;
+    write_barrier(vm, vec, obj);
+
+    return NULL;
+}
+
+/* ---------------------- numeric vectors ----------------------------*/
+
+/*
+ * An f64vector holds doubles and an s64vector 64-bit integers, unboxed.
+ * Any number can be stored in an f64vector, as the nearest double, but
+ * only exact integers that fit in an s64vector, and arithmetic on
+ * s64vectors raises an error where a result wouldn't fit. The bulk
+ * operations take vectors of one length and leave their work to the
+ * kernels in numvec.c.
+ */
+
+static void check_numvec(VM *vm, obj_t *vec, object_type type, char *name) {
+    if (obj_type(vec) != type) {
+        raise(vm, "invalid argument passed to '%s'", name);
+    }
+}
+
+static void check_lengths(VM *vm, obj_t *a, obj_t *b, char *name) {
+    if (a->count != b->count) {
+        raise(vm, "vectors of different lengths passed to '%s'", name);
+    }
+}
+
+static double to_f64(VM *vm, obj_t *x, char *name) {
+    if (!is_num(x)) {
+        raise(vm, "invalid argument passed to '%s'", name);
+    }
+    return num_to_double(x);
+}
+
+static int64_t to_s64(VM *vm, obj_t *x, char *name) {
+    long n;
+    if (is_fixnum(x)) {
+        return fixnum_value(x);
+    }
+    if (obj_type(x) != OBJ_BIG || !big_to_long(&x->big, &n)) {
+        raise(vm, "invalid argument passed to '%s'", name);
+    }
+    return n;
+}
+
+static void numvec_store(VM *vm, obj_t *vec, long i, obj_t *x, char *name) {
+    if (vec->type == OBJ_F64VEC) {
+        vec->f64[i] = to_f64(vm, x, name);
+    } else {
+        vec->s64[i] = to_s64(vm, x, name);
+    }
+}
+
+static obj_t *numvec_element(VM *vm, obj_t *vec, long i) {
+    if (vec->type == OBJ_F64VEC) {
+        return mk_double(vm, vec->f64[i]);
+    }
+    return mk_integer(vm, vec->s64[i]);
+}
+
+static obj_t *mk_int128(VM *vm, __int128 n) {
+    if (n >= LONG_MIN && n <= LONG_MAX) {
+        return mk_integer(vm, (long)n);
+    }
+
+    unsigned __int128 magnitude = n < 0 ? -(unsigned __int128)n : n;
+    limb_t *limbs = malloc(sizeof(limb_t) * 2);
+    limbs[0] = (limb_t)magnitude;
+    limbs[1] = (limb_t)(magnitude >> 64);
+    big_t big = {limbs, limbs[1] ? 2 : 1, n < 0 ? -1 : 1};
+    return mk_bignum(vm, big);
+}
+
+static long vector_index(VM *vm, obj_t *vec, obj_t *k, char *name) {
+    if (!is_fixnum(k)) {
+        raise(vm, "invalid argument passed to '%s'", name);
+    }
+    long i = fixnum_value(k);
+    if (i < 0 || i >= vec->count) {
+        raise(vm, "index out of bounds in '%s'", name);
+    }
+    return i;
+}
+
+/* (make-f64vector n [fill]) */
+static obj_t *make_numvec(VM *vm, int argc, obj_t **argv, object_type type,
+                          char *name) {
+    if (argc != 1 && argc != 2) {
+        raise(vm, "incorrect argument count to '%s'", name);
+    }
+    if (!is_fixnum(argv[0]) || fixnum_value(argv[0]) < 0) {
+        raise(vm, "invalid argument passed to '%s'", name);
+    }
+
+    long n = fixnum_value(argv[0]);
+    obj_t *vec = mk_numvec(vm, type, n);
+    if (argc == 2 && type == OBJ_F64VEC) {
+        f64_fill(vec->f64, to_f64(vm, argv[1], name), n);
+    } else if (argc == 2) {
+        s64_fill(vec->s64, to_s64(vm, argv[1], name), n);
+    }
+    return vec;
+}
+
+/* (f64vector x ...) */
+static obj_t *numvec_of(VM *vm, int argc, obj_t **argv, object_type type,
+                        char *name) {
+    obj_t *vec = mk_numvec(vm, type, argc);
+    for (int i = 0; i < argc; i++) {
+        numvec_store(vm, vec, i, argv[i], name);
+    }
+    return vec;
+}
+
+static obj_t *numvec_length(VM *vm, int argc, obj_t **argv, object_type type,
+                            char *name) {
+    ARG_NUMCHECK(vm, argc, name, 1);
+    check_numvec(vm, argv[0], type, name);
+    return mk_integer(vm, argv[0]->count);
+}
+
+static obj_t *numvec_ref(VM *vm, int argc, obj_t **argv, object_type type,
+                         char *name) {
+    ARG_NUMCHECK(vm, argc, name, 2);
+    check_numvec(vm, argv[0], type, name);
+    return numvec_element(vm, argv[0], vector_index(vm, argv[0], argv[1], name));
+}
+
+static obj_t *numvec_set(VM *vm, int argc, obj_t **argv, object_type type,
+                         char *name) {
+    ARG_NUMCHECK(vm, argc, name, 3);
+    check_numvec(vm, argv[0], type, name);
+    long i = vector_index(vm, argv[0], argv[1], name);
+    numvec_store(vm, argv[0], i, argv[2], name);
+    return NULL;
+}
+
+/* Conses up the elements from the last, keeping only the list so far on
+ * the stack. */
+static obj_t *numvec_to_list(VM *vm, int argc, obj_t **argv, object_type type,
+                             char *name) {
+    ARG_NUMCHECK(vm, argc, name, 1);
+    check_numvec(vm, argv[0], type, name);
+
+    obj_t *vec = argv[0];
+    obj_t *list = the_empty_list;
+    int sp = vm->sp;
+    for (long i = vec->count; i-- > 0;) {
+        list = mk_cons(vm, numvec_element(vm, vec, i), list);
+        popn(vm, vm->sp - sp);
+        push(vm, list);
+    }
+    return list;
+}
+
+/* (f64vector-fill! v x) */
+static obj_t *numvec_fill(VM *vm, int argc, obj_t **argv, object_type type,
+                          char *name) {
+    ARG_NUMCHECK(vm, argc, name, 2);
+    obj_t *vec = argv[0];
+    check_numvec(vm, vec, type, name);
+    if (type == OBJ_F64VEC) {
+        f64_fill(vec->f64, to_f64(vm, argv[1], name), vec->count);
+    } else {
+        s64_fill(vec->s64, to_s64(vm, argv[1], name), vec->count);
+    }
+    return NULL;
+}
+
+static obj_t *numvec_copy(VM *vm, int argc, obj_t **argv, object_type type,
+                          char *name) {
+    ARG_NUMCHECK(vm, argc, name, 1);
+    check_numvec(vm, argv[0], type, name);
+    obj_t *copy = mk_numvec(vm, type, argv[0]->count);
+    memcpy(copy->f64, argv[0]->f64, sizeof(double) * argv[0]->count);
+    return copy;
+}
+
+/* (f64vector-copy! to from) */
+static obj_t *numvec_copy_into(VM *vm, int argc, obj_t **argv,
+                               object_type type, char *name) {
+    ARG_NUMCHECK(vm, argc, name, 2);
+    check_numvec(vm, argv[0], type, name);
+    check_numvec(vm, argv[1], type, name);
+    check_lengths(vm, argv[0], argv[1], name);
+    memmove(argv[0]->f64, argv[1]->f64, sizeof(double) * argv[1]->count);
+    return NULL;
+}
+
+/* (f64vector-add! to a b) and (f64vector-mul! to a b) store the sums or
+ * products of the elements of 'a' and 'b' in 'to', which may be either. */
+static obj_t *numvec_elementwise(VM *vm, int argc, obj_t **argv,
+                                 object_type type, char *name, int multiply) {
+    ARG_NUMCHECK(vm, argc, name, 3);
+    for (int i = 0; i < 3; i++) {
+        check_numvec(vm, argv[i], type, name);
+    }
+    check_lengths(vm, argv[0], argv[1], name);
+    check_lengths(vm, argv[0], argv[2], name);
+
+    obj_t *to = argv[0], *a = argv[1], *b = argv[2];
+    if (type == OBJ_F64VEC) {
+        (multiply ? f64_mul : f64_add)(to->f64, a->f64, b->f64, to->count);
+    } else if ((multiply ? s64_mul : s64_add)(to->s64, a->s64, b->s64,
+                                               to->count)) {
+        raise(vm, "integer overflow in '%s'", name);
+    }
+    return NULL;
+}
+
+/* (f64vector-scale! to v k) */
+static obj_t *numvec_scale(VM *vm, int argc, obj_t **argv, object_type type,
+                           char *name) {
+    ARG_NUMCHECK(vm, argc, name, 3);
+    check_numvec(vm, argv[0], type, name);
+    check_numvec(vm, argv[1], type, name);
+    check_lengths(vm, argv[0], argv[1], name);
+
+    obj_t *to = argv[0], *v = argv[1];
+    if (type == OBJ_F64VEC) {
+        f64_scale(to->f64, v->f64, to_f64(vm, argv[2], name), to->count);
+    } else if (s64_scale(to->s64, v->s64, to_s64(vm, argv[2], name),
+                         to->count)) {
+        raise(vm, "integer overflow in '%s'", name);
+    }
+    return NULL;
+}
+
+/* The dot product of s64vectors is exact, finished with bignums should it
+ * outgrow 128 bits. */
+static obj_t *numvec_dot(VM *vm, int argc, obj_t **argv, object_type type,
+                         char *name) {
+    ARG_NUMCHECK(vm, argc, name, 2);
+    check_numvec(vm, argv[0], type, name);
+    check_numvec(vm, argv[1], type, name);
+    check_lengths(vm, argv[0], argv[1], name);
+
+    obj_t *a = argv[0], *b = argv[1];
+    if (type == OBJ_F64VEC) {
+        return mk_double(vm, f64_dot(a->f64, b->f64, a->count));
+    }
+
+    __int128 dot;
+    if (!s64_dot(a->s64, b->s64, a->count, &dot)) {
+        return mk_int128(vm, dot);
+    }
+
+    big_t sum = big_from_long(0);
+    for (long i = 0; i < a->count; i++) {
+        limb_t x_space, y_space;
+        big_t x, y;
+        big_borrow_long(&x, a->s64[i], &x_space);
+        big_borrow_long(&y, b->s64[i], &y_space);
+        big_t product = big_mul(&x, &y);
+        big_t next = big_add(&sum, &product);
+        big_free(&product);
+        big_free(&sum);
+        sum = next;
+    }
+    return mk_bignum(vm, sum);
+}
+
+/* (f64vector-sum v), which is exact for an s64vector */
+static obj_t *numvec_sum(VM *vm, int argc, obj_t **argv, object_type type,
+                         char *name) {
+    ARG_NUMCHECK(vm, argc, name, 1);
+    check_numvec(vm, argv[0], type, name);
+
+    obj_t *vec = argv[0];
+    if (type == OBJ_F64VEC) {
+        return mk_double(vm, f64_sum(vec->f64, vec->count));
+    }
+    return mk_int128(vm, s64_sum(vec->s64, vec->count));
+}
+
+/* (f64vector-min v) or, with 'greatest', (f64vector-max v) */
+static obj_t *numvec_extreme(VM *vm, int argc, obj_t **argv, object_type type,
+                             char *name, int greatest) {
+    ARG_NUMCHECK(vm, argc, name, 1);
+    check_numvec(vm, argv[0], type, name);
+
+    obj_t *vec = argv[0];
+    if (vec->count == 0) {
+        raise(vm, "empty vector passed to '%s'", name);
+    }
+    if (type == OBJ_F64VEC) {
+        return mk_double(vm, (greatest ? f64_max : f64_min)(vec->f64,
+                                                            vec->count));
+    }
+    return mk_integer(vm, (greatest ? s64_max : s64_min)(vec->s64, vec->count));
+}
+
+obj_t *builtin_is_f64vector(VM *vm, int argc, obj_t **argv) {
+    ARG_NUMCHECK(vm, argc, "f64vector?", 1);
+    return obj_type(argv[0]) == OBJ_F64VEC ? true : false;
+}
+
+obj_t *builtin_make_f64vector(VM *vm, int argc, obj_t **argv) {
+    return make_numvec(vm, argc, argv, OBJ_F64VEC, "make-f64vector");
+}
+
+obj_t *builtin_f64vector(VM *vm, int argc, obj_t **argv) {
+    return numvec_of(vm, argc, argv, OBJ_F64VEC, "f64vector");
+}
+
+obj_t *builtin_f64vector_length(VM *vm, int argc, obj_t **argv) {
+    return numvec_length(vm, argc, argv, OBJ_F64VEC, "f64vector-length");
+}
+
+obj_t *builtin_f64vector_ref(VM *vm, int argc, obj_t **argv) {
+    return numvec_ref(vm, argc, argv, OBJ_F64VEC, "f64vector-ref");
+}
+
+obj_t *builtin_f64vector_set(VM *vm, int argc, obj_t **argv) {
+    return numvec_set(vm, argc, argv, OBJ_F64VEC, "f64vector-set!");
+}
+
+obj_t *builtin_f64vector_to_list(VM *vm, int argc, obj_t **argv) {
+    return numvec_to_list(vm, argc, argv, OBJ_F64VEC, "f64vector->list");
+}
+
+obj_t *builtin_f64vector_fill(VM *vm, int argc, obj_t **argv) {
+    return numvec_fill(vm, argc, argv, OBJ_F64VEC, "f64vector-fill!");
+}
+
+obj_t *builtin_f64vector_copy(VM *vm, int argc, obj_t **argv) {
+    return numvec_copy(vm, argc, argv, OBJ_F64VEC, "f64vector-copy");
+}
+
+obj_t *builtin_f64vector_copy_into(VM *vm, int argc, obj_t **argv) {
+    return numvec_copy_into(vm, argc, argv, OBJ_F64VEC, "f64vector-copy!");
+}
+
+obj_t *builtin_f64vector_add(VM *vm, int argc, obj_t **argv) {
+    return numvec_elementwise(vm, argc, argv, OBJ_F64VEC, "f64vector-add!", 0);
+}
+
+obj_t *builtin_f64vector_mul(VM *vm, int argc, obj_t **argv) {
+    return numvec_elementwise(vm, argc, argv, OBJ_F64VEC, "f64vector-mul!", 1);
+}
+
+obj_t *builtin_f64vector_scale(VM *vm, int argc, obj_t **argv) {
+    return numvec_scale(vm, argc, argv, OBJ_F64VEC, "f64vector-scale!");
+}
+
+obj_t *builtin_f64vector_dot(VM *vm, int argc, obj_t **argv) {
+    return numvec_dot(vm, argc, argv, OBJ_F64VEC, "f64vector-dot");
+}
+
+obj_t *builtin_f64vector_sum(VM *vm, int argc, obj_t **argv) {
+    return numvec_sum(vm, argc, argv, OBJ_F64VEC, "f64vector-sum");
+}
+
+obj_t *builtin_f64vector_min(VM *vm, int argc, obj_t **argv) {
+    return numvec_extreme(vm, argc, argv, OBJ_F64VEC, "f64vector-min", 0);
+}
+
+obj_t *builtin_f64vector_max(VM *vm, int argc, obj_t **argv) {
+    return numvec_extreme(vm, argc, argv, OBJ_F64VEC, "f64vector-max", 1);
+}
+
+obj_t *builtin_is_s64vector(VM *vm, int argc, obj_t **argv) {
+    ARG_NUMCHECK(vm, argc, "s64vector?", 1);
+    return obj_type(argv[0]) == OBJ_S64VEC ? true : false;
+}
+
+obj_t *builtin_make_s64vector(VM *vm, int argc, obj_t **argv) {
+    return make_numvec(vm, argc, argv, OBJ_S64VEC, "make-s64vector");
+}
+
+obj_t *builtin_s64vector(VM *vm, int argc, obj_t **argv) {
+    return numvec_of(vm, argc, argv, OBJ_S64VEC, "s64vector");
+}
+
+obj_t *builtin_s64vector_length(VM *vm, int argc, obj_t **argv) {
+    return numvec_length(vm, argc, argv, OBJ_S64VEC, "s64vector-length");
+}
+
+obj_t *builtin_s64vector_ref(VM *vm, int argc, obj_t **argv) {
+    return numvec_ref(vm, argc, argv, OBJ_S64VEC, "s64vector-ref");
+}
+
+obj_t *builtin_s64vector_set(VM *vm, int argc, obj_t **argv) {
+    return numvec_set(vm, argc, argv, OBJ_S64VEC, "s64vector-set!");
+}
+
+obj_t *builtin_s64vector_to_list(VM *vm, int argc, obj_t **argv) {
+    return numvec_to_list(vm, argc, argv, OBJ_S64VEC, "s64vector->list");
+}
+
+obj_t *builtin_s64vector_fill(VM *vm, int argc, obj_t **argv) {
+    return numvec_fill(vm, argc, argv, OBJ_S64VEC, "s64vector-fill!");
+}
+
+obj_t *builtin_s64vector_copy(VM *vm, int argc, obj_t **argv) {
+    return numvec_copy(vm, argc, argv, OBJ_S64VEC, "s64vector-copy");
+}
+
+obj_t *builtin_s64vector_copy_into(VM *vm, int argc, obj_t **argv) {
+    return numvec_copy_into(vm, argc, argv, OBJ_S64VEC, "s64vector-copy!");
+}
+
+obj_t *builtin_s64vector_add(VM *vm, int argc, obj_t **argv) {
+    return numvec_elementwise(vm, argc, argv, OBJ_S64VEC, "s64vector-add!", 0);
+}
+
+obj_t *builtin_s64vector_mul(VM *vm, int argc, obj_t **argv) {
+    return numvec_elementwise(vm, argc, argv, OBJ_S64VEC, "s64vector-mul!", 1);
+}
+
+obj_t *builtin_s64vector_scale(VM *vm, int argc, obj_t **argv) {
+    return numvec_scale(vm, argc, argv, OBJ_S64VEC, "s64vector-scale!");
+}
+
+obj_t *builtin_s64vector_dot(VM *vm, int argc, obj_t **argv) {
+    return numvec_dot(vm, argc, argv, OBJ_S64VEC, "s64vector-dot");
+}
+
+obj_t *builtin_s64vector_sum(VM *vm, int argc, obj_t **argv) {
+    return numvec_sum(vm, argc, argv, OBJ_S64VEC, "s64vector-sum");
+}
+
+obj_t *builtin_s64vector_min(VM *vm, int argc, obj_t **argv) {
+    return numvec_extreme(vm, argc, argv, OBJ_S64VEC, "s64vector-min", 0);
+}
+
+obj_t *builtin_s64vector_max(VM *vm, int argc, obj_t **argv) {
+    return numvec_extreme(vm, argc, argv, OBJ_S64VEC, "s64vector-max", 1);
+}
+
+/* ---------------------- strings ------------------------ */
+
+obj_t *builtin_string_length(VM *vm, int argc, obj_t **argv) {
+    ARG_NUMCHECK(vm, argc, "string-length", 1);
+    FIG_ASSERT(vm, is_string(argv[0]),
+               "invalid argument passed to 'string-length'");
+    return mk_num_from_long(vm, argv[0]->len, 1);
+}
+
+obj_t *builtin_string_ref(VM *vm, int argc, obj_t **argv) {
+    ARG_NUMCHECK(vm, argc, "string-ref", 2);
+
+    obj_t *str = argv[0];
+    obj_t *k = argv[1];
+    if (!is_string(str) || !is_fixnum(k)) {
+        raise(vm, "invalid argument passed to 'string-ref'");
+    }
+
+    long i = num_numer(k);
+    if (i < 0 || i >= str->len) {
+        raise(vm, "index out of bounds in 'string-ref'");
+    }
+
+    return mk_char(vm, str->str[i]);
+}
+
+/* (substring s start [end]) shares the storage of 's' when the substring
+ * runs to its end, and copies otherwise. */
+obj_t *builtin_substring(VM *vm, int argc, obj_t **argv) {
+    if (argc != 2 && argc != 3) {
+        raise(vm, "incorrect argument count to 'substring'");
+    }
+
+    obj_t *str = argv[0];
+    for (int i = 1; i < argc; i++) {
+        if (!is_fixnum(argv[i])) {
+            raise(vm, "invalid argument passed to 'substring'");
+        }
+    }
+    if (!is_string(str)) {
+        raise(vm, "invalid argument passed to 'substring'");
+    }
+
+    long start = num_numer(argv[1]);
+    long end = argc == 3 ? num_numer(argv[2]) : str->len;
+    if (start < 0 || start > end || end > str->len) {
+        raise(vm, "index out of bounds in 'substring'");
+    }
+
+    if (end < str->len) {
+        return mk_string_len(vm, str->str + start, end - start);
+    }
+    return start ? mk_string_view(vm, str, start) : str;
+}
+
+obj_t *builtin_string_append(VM *vm, int argc, obj_t **argv) {
+    ARG_TYPECHECK(vm, argc, argv, "string-append", OBJ_STR);
+
+    int len = 0;
+    for (int i = 0; i < argc; i++) {
+        len += argv[i]->len;
+    }
+
+    obj_t *result = mk_string_len(vm, "", 0);
+    result->str = realloc(result->str, len + 1);
+    result->capacity = len + 1;
+    for (int i = 0; i < argc; i++) {
+        memcpy(result->str + result->len, argv[i]->str, argv[i]->len);
+        result->len += argv[i]->len;
+    }
+    result->str[len] = '\0';
+
+    return result;
+}
+
+/* (string-builder) makes an empty builder, which
+ * (string-builder-append! b x ...) extends with strings and characters in
+ * amortized constant time per character, and (string-builder->string b)
+ * copies out. */
+obj_t *builtin_string_builder(VM *vm, int argc, obj_t **argv) {
+    ARG_NUMCHECK(vm, argc, "string-builder", 0);
+    return mk_builder(vm);
+}
+
+obj_t *builtin_string_builder_append(VM *vm, int argc, obj_t **argv) {
+    if (argc < 1 || !is_builder(argv[0])) {
+        raise(vm, "invalid argument passed to 'string-builder-append!'");
+    }
+
+    obj_t *builder = argv[0];
+    for (int i = 1; i < argc; i++) {
+        obj_t *x = argv[i];
+        if (is_string(x)) {
+            builder_append(builder, x->str, x->len);
+        } else if (is_char(x)) {
+            char c = char_value(x);
+            builder_append(builder, &c, 1);
+        } else {
+            raise(vm, "invalid argument of type '%s' passed to "
+                      "'string-builder-append!'",
+                  type_name(obj_type(x)));
+        }
+    }
 
     return NULL;
 }
 
+obj_t *builtin_string_builder_to_string(VM *vm, int argc, obj_t **argv) {
+    ARG_NUMCHECK(vm, argc, "string-builder->string", 1);
+    FIG_ASSERT(vm, is_builder(argv[0]),
+               "invalid argument passed to 'string-builder->string'");
+    return mk_string_len(vm, argv[0]->str, argv[0]->len);
+}
+
 /* ---------------------- conversions ------------------------ */
 
-obj_t *builtin_char_to_int(VM *vm, obj_t *args) {
-    ARG_NUMCHECK(vm, args, "char->int", 1);
-    FIG_ASSERT(vm, is_char(car(args)), "invalid argument passed to char->int");
-    obj_t *arg = car(args);
-    return mk_num_from_long(vm, arg->character, 1l);
+obj_t *builtin_char_to_int(VM *vm, int argc, obj_t **argv) {
+    ARG_NUMCHECK(vm, argc, "char->int", 1);
+    FIG_ASSERT(vm, is_char(argv[0]), "invalid argument passed to char->int");
+    obj_t *arg = argv[0];
+    return mk_num_from_long(vm, char_value(arg), 1l);
 }
 
-obj_t *builtin_int_to_char(VM *vm, obj_t *args) {
-    ARG_NUMCHECK(vm, args, "int->char", 1);
-    obj_t *arg = car(args);
-    FIG_ASSERT(vm, is_integer(arg), "'invalid argument passed to int->char'");
-    return mk_char(vm, arg->numer);
+obj_t *builtin_int_to_char(VM *vm, int argc, obj_t **argv) {
+    ARG_NUMCHECK(vm, argc, "int->char", 1);
+    obj_t *arg = argv[0];
+    FIG_ASSERT(vm, is_fixnum(arg), "'invalid argument passed to int->char'");
+    return mk_char(vm, num_numer(arg));
 }
 
-obj_t *builtin_number_to_string(VM *vm, obj_t *args) {
-    ARG_NUMCHECK(vm, args, "number->string", 1);
-    FIG_ASSERT(vm, is_num(car(args)), "invalid argument passed to 'number->string'");
+obj_t *builtin_number_to_string(VM *vm, int argc, obj_t **argv) {
+    ARG_NUMCHECK(vm, argc, "number->string", 1);
+    FIG_ASSERT(vm, is_num(argv[0]), "invalid argument passed to 'number->string'");
 
-    obj_t *arg = car(args);
+    obj_t *arg = argv[0];
 
     char *num = num_to_string(arg);
     obj_t *result = mk_string(vm, num);
@@ -392,13 +1046,29 @@ static obj_t *parse_number(VM *vm, char *str) {
         is_fraction = 1;
     } else if (str[i] == '.') {
         is_decimal = 1;
-    } else if (str[i] != '\0') {
+    } else if (str[i] != '\0' && str[i] != 'e' && str[i] != 'E') {
         raise(vm, "invalid number syntax");
     }
 
-    i++;
-    while (isdigit(str[i])) {
+    if (is_fraction || is_decimal) {
         i++;
+        while (isdigit(str[i])) {
+            i++;
+        }
+    }
+
+    if ((str[i] == 'e' || str[i] == 'E') && !is_fraction) {
+        is_decimal = 1;
+        i++;
+        if (str[i] == '-' || str[i] == '+') {
+            i++;
+        }
+        if (!isdigit(str[i])) {
+            raise(vm, "invalid number syntax");
+        }
+        while (isdigit(str[i])) {
+            i++;
+        }
     }
 
     if (!is_delim(str[i])) {
@@ -409,111 +1079,180 @@ static obj_t *parse_number(VM *vm, char *str) {
 
 }
 
-obj_t *builtin_string_to_number(VM *vm, obj_t *args) {
-    ARG_NUMCHECK(vm, args, "string->number", 1);
-    FIG_ASSERT(vm, is_string(car(args)),
+obj_t *builtin_string_to_number(VM *vm, int argc, obj_t **argv) {
+    ARG_NUMCHECK(vm, argc, "string->number", 1);
+    FIG_ASSERT(vm, is_string(argv[0]),
                "invalid argument passed to 'string->number'");
 
-    obj_t *arg = car(args);
+    obj_t *arg = argv[0];
 
     return parse_number(vm, arg->str);
 }
 
-obj_t *builtin_symbol_to_string(VM *vm, obj_t *args) {
-    ARG_NUMCHECK(vm, args, "symbol->string", 1);
-    FIG_ASSERT(vm, is_symbol(car(args)),
+obj_t *builtin_symbol_to_string(VM *vm, int argc, obj_t **argv) {
+    ARG_NUMCHECK(vm, argc, "symbol->string", 1);
+    FIG_ASSERT(vm, is_symbol(argv[0]),
                "invalid argument passed to symbol->string");
-    obj_t *arg = car(args);
+    obj_t *arg = argv[0];
     return mk_string(vm, arg->sym);
 }
 
-obj_t *builtin_string_to_symbol(VM *vm, obj_t *args) {
-    ARG_NUMCHECK(vm, args, "symbol->string", 1);
-    FIG_ASSERT(vm, is_string(car(args)),
+obj_t *builtin_string_to_symbol(VM *vm, int argc, obj_t **argv) {
+    ARG_NUMCHECK(vm, argc, "symbol->string", 1);
+    FIG_ASSERT(vm, is_string(argv[0]),
                "invalid argument passed to string->symbol");
-    obj_t *arg = car(args);
-    return mk_sym(vm, arg->sym);
+    obj_t *arg = argv[0];
+    return mk_sym(vm, arg->str);
 }
 
-obj_t *builtin_is_equal(VM *vm, obj_t *args) {
-    ARG_NUMCHECK(vm, args, "eq?", 2);
+obj_t *builtin_is_equal(VM *vm, int argc, obj_t **argv) {
+    ARG_NUMCHECK(vm, argc, "eq?", 2);
 
-    obj_t *a = car(args);
-    obj_t *b = cadr(args);
+    obj_t *a = argv[0];
+    obj_t *b = argv[1];
 
-    if (a->type != b->type) {
+    if (obj_type(a) != obj_type(b)) {
         return false;
     }
 
-    switch (a->type) {
+    switch (obj_type(a)) {
     case OBJ_NUM:
+    case OBJ_BIG:
+    case OBJ_RATIO:
+    case OBJ_DOUBLE:
         return num_eq(vm, a, b);
-    case OBJ_CHAR:
-        return a->character == b->character ? true : false;
     default:
         return a == b ? true : false;
     }
 }
 
-obj_t *builtin_string_append(VM *vm, obj_t *args) {
-    ARG_TYPECHECK(vm, args, "string-append", OBJ_STR);
-    char buf[MAX_STRING_LENGTH];
-    int i = 0;
-    while (!is_the_empty_list(args)) {
-        char *sym = car(args)->sym;
-        while (*sym) {
-            buf[i++] = *sym++;
-        }
-        args = cdr(args);
-    }
-    buf[i] = '\0';
-
-    return mk_string(vm, buf);
-}
-
 void display(obj_t *object) {
-    switch (object->type) {
+    switch (obj_type(object)) {
         case OBJ_STR:
-            printf("%s", object->str);
+            fwrite(object->str, 1, object->len, stdout);
             break;
         default:
             print(object);
     }
 }
 
-obj_t *builtin_display(VM *vm, obj_t *args) {
-    FIG_ASSERT(vm, !is_the_empty_list(args), "invalid syntax display");
-    while (!is_the_empty_list(args)) {
-        display(car(args));
-        args = cdr(args);
+obj_t *builtin_display(VM *vm, int argc, obj_t **argv) {
+    FIG_ASSERT(vm, argc > 0, "invalid syntax display");
+    for (int i = 0; i < argc; i++) {
+        display(argv[i]);
         printf(" ");
     }
     printf("\n");
     return NULL;
 }
 
-obj_t *builtin_env(VM *vm, obj_t *args) {
-    FIG_ASSERT(vm, is_the_empty_list(args), "incorrect argument count in 'env'");
-    return universe;
+static obj_t *frame_bindings(VM *vm, obj_t *frame) {
+    obj_t *bindings = the_empty_list;
+    obj_t *names = frame->names;
+    for (int i = 0; i < frame->nslots; i++) {
+        obj_t *binding = mk_cons(vm, car(names), frame->slots[i]);
+        bindings = mk_cons(vm, binding, bindings);
+        names = cdr(names);
+    }
+    return bindings;
+}
+
+/* (env) lists the global bindings. (env proc) lists the bindings captured
+ * by a procedure, one association list per frame, innermost first. */
+obj_t *builtin_env(VM *vm, int argc, obj_t **argv) {
+    if (argc == 0) {
+        return global_bindings(vm);
+    }
+
+    ARG_NUMCHECK(vm, argc, "env", 1);
+    FIG_ASSERT(vm, is_fun(argv[0]), "invalid argument passed to 'env'");
+
+    int depth = 0;
+    for (obj_t *f = argv[0]->env; f != universe; f = f->parent) {
+        depth++;
+    }
+
+    obj_t *frames = the_empty_list;
+    while (depth--) {
+        obj_t *frame = argv[0]->env;
+        for (int i = 0; i < depth; i++) {
+            frame = frame->parent;
+        }
+        frames = mk_cons(vm, frame_bindings(vm, frame), frames);
+    }
+
+    return frames;
+}
+
+/* (macro-stats) reports how many macro uses have been expanded and the time
+ * spent expanding them, with a count for each macro:
+ * ((expansions . n) (microseconds . t) (macros (name . n) ...)) */
+obj_t *builtin_macro_stats(VM *vm, int argc, obj_t **argv) {
+    ARG_NUMCHECK(vm, argc, "macro-stats", 0);
+
+    obj_t *macros = the_empty_list;
+    for (size_t i = 0; i < symbol_table->size; i++) {
+        obj_t *symbol = symbol_table->slots[i];
+        if (symbol && symbol->bound && symbol->value &&
+            is_macro(symbol->value)) {
+            obj_t *uses = mk_num_from_long(vm, symbol->value->uses, 1);
+            macros = mk_cons(vm, mk_cons(vm, symbol, uses), macros);
+        }
+    }
+    macros = mk_cons(vm, mk_sym(vm, "macros"), macros);
+
+    obj_t *usec = mk_cons(vm, mk_sym(vm, "microseconds"),
+                          mk_num_from_long(vm, vm->expand_usec, 1));
+    obj_t *count = mk_cons(vm, mk_sym(vm, "expansions"),
+                           mk_num_from_long(vm, vm->expansions, 1));
+
+    obj_t *stats = mk_cons(vm, macros, the_empty_list);
+    stats = mk_cons(vm, usec, stats);
+    return mk_cons(vm, count, stats);
+}
+
+/* (gc-stats) reports the work of the collector so far and the size of the
+ * heap: ((minor . n) (major . n) (microseconds . t) (max-pause . t)
+ * (marked . n) (freed . n) (objects . n) (heap-bytes . n)) */
+obj_t *builtin_gc_stats(VM *vm, int argc, obj_t **argv) {
+    ARG_NUMCHECK(vm, argc, "gc-stats", 0);
+
+    gc_stats_t *gc = &vm->gc_stats;
+    char *names[] = {"minor",  "major", "microseconds", "max-pause",
+                     "marked", "freed", "objects",      "heap-bytes"};
+    long values[] = {gc->minor,  gc->major, gc->pause_usec,
+                     gc->max_pause_usec, gc->marked, gc->freed,
+                     vm->obj_count, vm->heap.npages * PAGE_SIZE};
+
+    obj_t *stats = the_empty_list;
+    for (int i = sizeof(values) / sizeof(long) - 1; i >= 0; i--) {
+        obj_t *stat = mk_cons(vm, mk_sym(vm, names[i]),
+                              mk_num_from_long(vm, values[i], 1));
+        stats = mk_cons(vm, stat, stats);
+    }
+
+    return stats;
 }
 
-obj_t *builtin_load(VM *vm, obj_t *args) {
-    obj_t *f = car(args);
+obj_t *builtin_load(VM *vm, int argc, obj_t **argv) {
+    ARG_NUMCHECK(vm, argc, "load", 1);
+    FIG_ASSERT(vm, is_string(argv[0]), "invalid argument passed to 'load'");
+    obj_t *f = argv[0];
     char *filename = f->str;
     obj_t *res = read_file(vm, filename);
     return res;
 }
 
-obj_t *builtin_exit(VM *vm, obj_t *args) {
+obj_t *builtin_exit(VM *vm, int argc, obj_t **argv) {
     cleanup(vm);
     exit(0);
     return NULL;
 }
 
-obj_t *builtin_raise(VM *vm, obj_t *args) {
-    FIG_ASSERT(vm, length(args) == 1, "incorrect argument count in 'raise'");
+obj_t *builtin_raise(VM *vm, int argc, obj_t **argv) {
+    FIG_ASSERT(vm, argc == 1, "incorrect argument count in 'raise'");
 
-    obj_t *msg = car(args);
+    obj_t *msg = argv[0];
     if (!is_string(msg)) {
         raise(vm, "first argument to raise must be of type string");
     }
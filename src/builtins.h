@@ -6,62 +6,120 @@
 typedef struct obj_t obj_t;
 typedef struct VM VM;
 
-obj_t *builtin_plus(VM *vm, obj_t *args);
-obj_t *builtin_minus(VM *vm, obj_t *args);
-obj_t *builtin_times(VM *vm, obj_t *args);
-obj_t *builtin_divide(VM *vm, obj_t *args);
-obj_t *builtin_remainder(VM *vm, obj_t *args);
-
-obj_t *builtin_gt(VM *vm, obj_t *args);
-obj_t *builtin_gte(VM *vm, obj_t *args);
-obj_t *builtin_lt(VM *vm, obj_t *args);
-obj_t *builtin_lte(VM *vm, obj_t *args);
-obj_t *builtin_numeq(VM *vm, obj_t *args);
-
-obj_t *builtin_is_null(VM *vm, obj_t *args);
-obj_t *builtin_is_boolean(VM *vm, obj_t *args);
-obj_t *builtin_is_symbol(VM *vm, obj_t *args);
-obj_t *builtin_is_num(VM *vm, obj_t *args);
-obj_t *builtin_is_integer(VM *vm, obj_t *args);
-obj_t *builtin_is_char(VM *vm, obj_t *args);
-obj_t *builtin_is_string(VM *vm, obj_t *args);
-obj_t *builtin_is_pair(VM *vm, obj_t *args);
-obj_t *builtin_is_list(VM *vm, obj_t *args);
-obj_t *builtin_is_vector(VM *vm, obj_t *args);
-obj_t *builtin_is_proc(VM *vm, obj_t *args);
-obj_t *builtin_is_equal(VM *vm, obj_t *args);
-
-obj_t *builtin_char_to_int(VM *vm, obj_t *args);
-obj_t *builtin_int_to_char(VM *vm, obj_t *args);
-obj_t *builtin_number_to_string(VM *vm, obj_t *args);
-obj_t *builtin_string_to_number(VM *vm, obj_t *args);
-obj_t *builtin_symbol_to_string(VM *vm, obj_t *args);
-obj_t *builtin_string_to_symbol(VM *vm, obj_t *args);
-
-obj_t *builtin_cons(VM *vm, obj_t *args);
-obj_t *builtin_car(VM *vm, obj_t *args);
-obj_t *builtin_cdr(VM *vm, obj_t *args);
+obj_t *builtin_plus(VM *vm, int argc, obj_t **argv);
+obj_t *builtin_minus(VM *vm, int argc, obj_t **argv);
+obj_t *builtin_times(VM *vm, int argc, obj_t **argv);
+obj_t *builtin_divide(VM *vm, int argc, obj_t **argv);
+obj_t *builtin_remainder(VM *vm, int argc, obj_t **argv);
+obj_t *builtin_exact_to_inexact(VM *vm, int argc, obj_t **argv);
+obj_t *builtin_inexact_to_exact(VM *vm, int argc, obj_t **argv);
+obj_t *builtin_exp(VM *vm, int argc, obj_t **argv);
+obj_t *builtin_log(VM *vm, int argc, obj_t **argv);
+obj_t *builtin_sin(VM *vm, int argc, obj_t **argv);
+obj_t *builtin_cos(VM *vm, int argc, obj_t **argv);
+obj_t *builtin_tan(VM *vm, int argc, obj_t **argv);
+obj_t *builtin_asin(VM *vm, int argc, obj_t **argv);
+obj_t *builtin_acos(VM *vm, int argc, obj_t **argv);
+obj_t *builtin_atan(VM *vm, int argc, obj_t **argv);
+obj_t *builtin_sqrt(VM *vm, int argc, obj_t **argv);
+obj_t *builtin_expt(VM *vm, int argc, obj_t **argv);
+
+obj_t *builtin_gt(VM *vm, int argc, obj_t **argv);
+obj_t *builtin_gte(VM *vm, int argc, obj_t **argv);
+obj_t *builtin_lt(VM *vm, int argc, obj_t **argv);
+obj_t *builtin_lte(VM *vm, int argc, obj_t **argv);
+obj_t *builtin_numeq(VM *vm, int argc, obj_t **argv);
+
+obj_t *builtin_is_null(VM *vm, int argc, obj_t **argv);
+obj_t *builtin_is_boolean(VM *vm, int argc, obj_t **argv);
+obj_t *builtin_is_symbol(VM *vm, int argc, obj_t **argv);
+obj_t *builtin_is_num(VM *vm, int argc, obj_t **argv);
+obj_t *builtin_is_integer(VM *vm, int argc, obj_t **argv);
+obj_t *builtin_is_exact(VM *vm, int argc, obj_t **argv);
+obj_t *builtin_is_inexact(VM *vm, int argc, obj_t **argv);
+obj_t *builtin_is_char(VM *vm, int argc, obj_t **argv);
+obj_t *builtin_is_string(VM *vm, int argc, obj_t **argv);
+obj_t *builtin_is_pair(VM *vm, int argc, obj_t **argv);
+obj_t *builtin_is_list(VM *vm, int argc, obj_t **argv);
+obj_t *builtin_is_vector(VM *vm, int argc, obj_t **argv);
+obj_t *builtin_is_proc(VM *vm, int argc, obj_t **argv);
+obj_t *builtin_is_equal(VM *vm, int argc, obj_t **argv);
+
+obj_t *builtin_char_to_int(VM *vm, int argc, obj_t **argv);
+obj_t *builtin_int_to_char(VM *vm, int argc, obj_t **argv);
+obj_t *builtin_number_to_string(VM *vm, int argc, obj_t **argv);
+obj_t *builtin_string_to_number(VM *vm, int argc, obj_t **argv);
+obj_t *builtin_symbol_to_string(VM *vm, int argc, obj_t **argv);
+obj_t *builtin_string_to_symbol(VM *vm, int argc, obj_t **argv);
+
+obj_t *builtin_cons(VM *vm, int argc, obj_t **argv);
+obj_t *builtin_car(VM *vm, int argc, obj_t **argv);
+obj_t *builtin_cdr(VM *vm, int argc, obj_t **argv);
 obj_t *builtin_list(VM *vm, obj_t *args);
-obj_t *builtin_setcar(VM *vm, obj_t *args);
-obj_t *builtin_setcdr(VM *vm, obj_t *args);
-
-obj_t *builtin_make_vector(VM *vm, obj_t *args);
-obj_t *builtin_vector_length(VM *vm, obj_t *args);
-obj_t *builtin_vector_set(VM *vm, obj_t *args);
-obj_t *builtin_vector_ref(VM *vm, obj_t *args);
-
-obj_t *builtin_string_append(VM *vm, obj_t *args);
-
-obj_t *builtin_display(VM *vm, obj_t *args);
-
-obj_t *builtin_env(VM *vm, obj_t *args);
+obj_t *builtin_setcar(VM *vm, int argc, obj_t **argv);
+obj_t *builtin_setcdr(VM *vm, int argc, obj_t **argv);
+
+obj_t *builtin_make_vector(VM *vm, int argc, obj_t **argv);
+obj_t *builtin_vector_length(VM *vm, int argc, obj_t **argv);
+obj_t *builtin_vector_set(VM *vm, int argc, obj_t **argv);
+obj_t *builtin_vector_ref(VM *vm, int argc, obj_t **argv);
+
+obj_t *builtin_is_f64vector(VM *vm, int argc, obj_t **argv);
+obj_t *builtin_make_f64vector(VM *vm, int argc, obj_t **argv);
+obj_t *builtin_f64vector(VM *vm, int argc, obj_t **argv);
+obj_t *builtin_f64vector_length(VM *vm, int argc, obj_t **argv);
+obj_t *builtin_f64vector_ref(VM *vm, int argc, obj_t **argv);
+obj_t *builtin_f64vector_set(VM *vm, int argc, obj_t **argv);
+obj_t *builtin_f64vector_to_list(VM *vm, int argc, obj_t **argv);
+obj_t *builtin_f64vector_fill(VM *vm, int argc, obj_t **argv);
+obj_t *builtin_f64vector_copy(VM *vm, int argc, obj_t **argv);
+obj_t *builtin_f64vector_copy_into(VM *vm, int argc, obj_t **argv);
+obj_t *builtin_f64vector_add(VM *vm, int argc, obj_t **argv);
+obj_t *builtin_f64vector_mul(VM *vm, int argc, obj_t **argv);
+obj_t *builtin_f64vector_scale(VM *vm, int argc, obj_t **argv);
+obj_t *builtin_f64vector_dot(VM *vm, int argc, obj_t **argv);
+obj_t *builtin_f64vector_sum(VM *vm, int argc, obj_t **argv);
+obj_t *builtin_f64vector_min(VM *vm, int argc, obj_t **argv);
+obj_t *builtin_f64vector_max(VM *vm, int argc, obj_t **argv);
+
+obj_t *builtin_is_s64vector(VM *vm, int argc, obj_t **argv);
+obj_t *builtin_make_s64vector(VM *vm, int argc, obj_t **argv);
+obj_t *builtin_s64vector(VM *vm, int argc, obj_t **argv);
+obj_t *builtin_s64vector_length(VM *vm, int argc, obj_t **argv);
+obj_t *builtin_s64vector_ref(VM *vm, int argc, obj_t **argv);
+obj_t *builtin_s64vector_set(VM *vm, int argc, obj_t **argv);
+obj_t *builtin_s64vector_to_list(VM *vm, int argc, obj_t **argv);
+obj_t *builtin_s64vector_fill(VM *vm, int argc, obj_t **argv);
+obj_t *builtin_s64vector_copy(VM *vm, int argc, obj_t **argv);
+obj_t *builtin_s64vector_copy_into(VM *vm, int argc, obj_t **argv);
+obj_t *builtin_s64vector_add(VM *vm, int argc, obj_t **argv);
+obj_t *builtin_s64vector_mul(VM *vm, int argc, obj_t **argv);
+obj_t *builtin_s64vector_scale(VM *vm, int argc, obj_t **argv);
+obj_t *builtin_s64vector_dot(VM *vm, int argc, obj_t **argv);
+obj_t *builtin_s64vector_sum(VM *vm, int argc, obj_t **argv);
+obj_t *builtin_s64vector_min(VM *vm, int argc, obj_t **argv);
+obj_t *builtin_s64vector_max(VM *vm, int argc, obj_t **argv);
+
+obj_t *builtin_string_length(VM *vm, int argc, obj_t **argv);
+obj_t *builtin_string_ref(VM *vm, int argc, obj_t **argv);
+obj_t *builtin_substring(VM *vm, int argc, obj_t **argv);
+obj_t *builtin_string_append(VM *vm, int argc, obj_t **argv);
+obj_t *builtin_string_builder(VM *vm, int argc, obj_t **argv);
+obj_t *builtin_string_builder_append(VM *vm, int argc, obj_t **argv);
+obj_t *builtin_string_builder_to_string(VM *vm, int argc, obj_t **argv);
+
+obj_t *builtin_display(VM *vm, int argc, obj_t **argv);
+
+obj_t *builtin_env(VM *vm, int argc, obj_t **argv);
+obj_t *builtin_macro_stats(VM *vm, int argc, obj_t **argv);
+obj_t *builtin_gc_stats(VM *vm, int argc, obj_t **argv);
 
 obj_t *read_file(VM *vm, char *fname);
 
-obj_t *builtin_load(VM *vm, obj_t *args);
+obj_t *builtin_load(VM *vm, int argc, obj_t **argv);
 
-obj_t *builtin_exit(VM *vm, obj_t *args);
+obj_t *builtin_exit(VM *vm, int argc, obj_t **argv);
 
-obj_t *builtin_raise(VM *vm, obj_t *args);
+obj_t *builtin_raise(VM *vm, int argc, obj_t **argv);
 
 #endif
\ No newline at end of file
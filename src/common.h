@@ -34,6 +34,27 @@ obj_t *if_sym;
 obj_t *lambda_sym;
 obj_t *begin_sym;
 
+obj_t *let_sym;
+obj_t *let_star_sym;
+obj_t *letrec_sym;
+obj_t *cond_sym;
+obj_t *case_sym;
+obj_t *and_sym;
+obj_t *or_sym;
+obj_t *when_sym;
+obj_t *unless_sym;
+obj_t *do_sym;
+obj_t *else_sym;
+obj_t *arrow_sym;
+
+obj_t *define_syntax_sym;
+obj_t *syntax_rules_sym;
+obj_t *ellipsis_sym;
+obj_t *underscore_sym;
+
+/* evaluate with the AST walker in eval.c instead of compiling to bytecode */
+int ast_eval;
+
 /* exception handling */
 jmp_buf exc_env;
 obj_t *exc;
@@ -0,0 +1,1245 @@
+#include "common.h"
+#include "compile.h"
+#include "assert.h"
+#include "builtins.h"
+
+/*
+ * Translates a form into bytecode for the dispatch loop in vm.c. Every
+ * expression compiles to code that leaves exactly one value on the stack.
+ *
+ * Variables are resolved while compiling: a name bound by an enclosing
+ * lambda becomes a (depth, slot) address into the frame chain, and any
+ * other name refers to the global environment.
+ */
+
+/* 'tail' flags: TAIL means the value is returned from the procedure,
+ * LOOP_TAIL that it ends an iteration of the innermost named let. */
+#define TAIL 1
+#define LOOP_TAIL 2
+
+struct scope_t;
+
+typedef struct loop_t {
+    obj_t *label;           /* name of the named let, NULL for do */
+    struct scope_t *scope;  /* scope binding the loop variables */
+    int nvars;
+    int head;               /* address of the first instruction of the body */
+    int rebind;             /* a closure may hold an iteration's variables,
+                               so each one needs a fresh frame */
+} loop_t;
+
+/*
+ * A scope is a lambda, or a let-like form nested inside one. A scope that
+ * owns a frame gets one at run time; any other keeps its variables in
+ * extra slots of the frame of its owner, so entering it costs nothing.
+ */
+typedef struct scope_t {
+    obj_t *code;              /* code object instructions are emitted into */
+    obj_t *names;             /* first of this scope's names in the frame */
+    int base;                 /* slot of that name */
+    int count;                /* number of names bound by this scope */
+    struct scope_t *owner;    /* scope whose frame holds the slots */
+    obj_t *frame_names;       /* owner only: names of every slot */
+    int nslots;               /* owner only: slots allocated so far */
+    int enter;                /* owner only: OP_ENTER to patch, or -1 */
+    loop_t *loop;
+    struct scope_t *parent;
+} scope_t;
+
+static void compile_expr(VM *vm, scope_t *sc, obj_t *expr, int tail);
+
+static int emit(scope_t *sc, int word) {
+    code_t *c = sc->code->bytecode;
+    if (c->count == c->capacity) {
+        c->capacity = c->capacity ? c->capacity * 2 : 16;
+        c->instrs = realloc(c->instrs, sizeof(int) * c->capacity);
+    }
+    c->instrs[c->count] = word;
+    return c->count++;
+}
+
+static int emit_op(scope_t *sc, opcode op, int arg) {
+    emit(sc, op);
+    return emit(sc, arg);
+}
+
+static void patch(scope_t *sc, int at) {
+    sc->code->bytecode->instrs[at] = sc->code->bytecode->count;
+}
+
+/* Forward jumps to the same place are chained through their operands,
+ * starting from -1, until the target is known. */
+static void patch_chain(scope_t *sc, int chain) {
+    int *instrs = sc->code->bytecode->instrs;
+    while (chain >= 0) {
+        int next = instrs[chain];
+        instrs[chain] = sc->code->bytecode->count;
+        chain = next;
+    }
+}
+
+static int new_const(scope_t *sc, obj_t *object) {
+    code_t *c = sc->code->bytecode;
+    if (c->nconsts == c->consts_capacity) {
+        c->consts_capacity = c->consts_capacity ? c->consts_capacity * 2 : 8;
+        c->consts = realloc(c->consts, sizeof(obj_t *) * c->consts_capacity);
+    }
+    c->consts[c->nconsts] = object;
+    write_barrier(vm, sc->code, object);
+    return c->nconsts++;
+}
+
+static int add_const(scope_t *sc, obj_t *object) {
+    code_t *c = sc->code->bytecode;
+
+    for (int i = 0; i < c->nconsts; i++) {
+        if (c->consts[i] == object) {
+            return i;
+        }
+    }
+    return new_const(sc, object);
+}
+
+static int add_ic(scope_t *sc) {
+    code_t *c = sc->code->bytecode;
+    c->ics = realloc(c->ics, sizeof(ic_t) * (c->nics + 1));
+    c->ics[c->nics].fn = NULL;
+    c->ics[c->nics].kind = IC_EMPTY;
+    c->ics[c->nics].epoch = 0;
+    return c->nics++;
+}
+
+static int is_tagged(obj_t *expr, obj_t *tag) {
+    return is_pair(expr) && car(expr) == tag;
+}
+
+static int is_top_level_only(obj_t *expr) {
+    return is_tagged(expr, define_sym) || is_tagged(expr, set_sym);
+}
+
+static int is_self_evaluating(obj_t *expr) {
+    return expr == NULL || is_char(expr) || is_boolean(expr) ||
+           is_string(expr) || is_num(expr) || is_error(expr);
+}
+
+static void compile_const(scope_t *sc, obj_t *object) {
+    emit_op(sc, OP_CONST, add_const(sc, object));
+}
+
+/* variables --------------------------------------------------------------- */
+
+static void open_scope(scope_t *sc, scope_t *parent, obj_t *code, int frame) {
+    sc->code = code;
+    sc->names = the_empty_list;
+    sc->base = 0;
+    sc->count = 0;
+    sc->owner = frame ? sc : parent ? parent->owner : NULL;
+    sc->frame_names = the_empty_list;
+    sc->nslots = 0;
+    sc->enter = -1;
+    sc->loop = NULL;
+    sc->parent = parent;
+}
+
+static int name_index(scope_t *sc, obj_t *symbol) {
+    obj_t *names = sc->names;
+    for (int i = 0; i < sc->count; i++, names = cdr(names)) {
+        if (car(names) == symbol) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/* Gives 'symbol' a slot in the owner's frame. All of a scope's names are
+ * bound before any nested scope is opened, so they stay contiguous. */
+static int bind_name(VM *vm, scope_t *sc, obj_t *symbol) {
+    FIG_ASSERT(vm, is_symbol(symbol), "invalid syntax");
+
+    int index = name_index(sc, symbol);
+    if (index >= 0) {
+        return sc->base + index;
+    }
+
+    scope_t *owner = sc->owner;
+    obj_t *cell = mk_cons(vm, symbol, the_empty_list);
+
+    if (is_the_empty_list(owner->frame_names)) {
+        owner->frame_names = cell;
+    } else {
+        obj_t *last = owner->frame_names;
+        while (!is_the_empty_list(cdr(last))) {
+            last = cdr(last);
+        }
+        set_cdr(last, cell);
+    }
+
+    if (sc->count++ == 0) {
+        sc->names = cell;
+        sc->base = owner->nslots;
+    }
+    return owner->nslots++;
+}
+
+/* Internal definitions get their slots up front so every frame is sized
+ * once, when it is created. */
+static void scan_definitions(VM *vm, scope_t *sc, obj_t *expr) {
+    if (is_tagged(expr, define_sym) && is_pair(cdr(expr))) {
+        obj_t *var = is_pair(cadr(expr)) ? caadr(expr) : cadr(expr);
+        bind_name(vm, sc, var);
+    } else if (is_tagged(expr, begin_sym) || is_tagged(expr, if_sym) ||
+               is_tagged(expr, when_sym) || is_tagged(expr, unless_sym)) {
+        for (obj_t *e = cdr(expr); is_pair(e); e = cdr(e)) {
+            scan_definitions(vm, sc, car(e));
+        }
+    }
+}
+
+static void scan_body(VM *vm, scope_t *sc, obj_t *body) {
+    for (; is_pair(body); body = cdr(body)) {
+        scan_definitions(vm, sc, car(body));
+    }
+}
+
+/* Finds the frame address of 'symbol', returning 0 if it is global. */
+static int resolve(scope_t *sc, obj_t *symbol, int *depth, int *slot) {
+    for (*depth = 0; sc->parent; sc = sc->parent) {
+        int index = name_index(sc, symbol);
+        if (index >= 0) {
+            *slot = sc->base + index;
+            return 1;
+        }
+        if (sc->owner == sc) {
+            (*depth)++;
+        }
+    }
+    return 0;
+}
+
+static void compile_reference(scope_t *sc, obj_t *symbol) {
+    int depth, slot;
+    if (resolve(sc, symbol, &depth, &slot)) {
+        emit_op(sc, OP_LOCAL, depth);
+        emit(sc, slot);
+    } else {
+        emit_op(sc, OP_GLOBAL, add_const(sc, unalias(symbol)));
+    }
+}
+
+static void compile_store(scope_t *sc, obj_t *symbol) {
+    int depth, slot;
+    if (resolve(sc, symbol, &depth, &slot)) {
+        emit_op(sc, OP_SET_LOCAL, depth);
+        emit(sc, slot);
+    } else {
+        emit_op(sc, OP_SET_GLOBAL, add_const(sc, unalias(symbol)));
+    }
+}
+
+/*
+ * A let-like scope needs a frame of its own only if a closure could capture
+ * its variables, or if there is no enclosing frame to borrow slots from.
+ */
+static int body_tail_calls(obj_t *label, obj_t *exprs, int tail);
+
+static int makes_closures(obj_t *expr) {
+    while (is_pair(expr)) {
+        obj_t *op = car(expr);
+        if (op == quote_sym) {
+            return 0;
+        }
+        if (op == lambda_sym || (op == define_sym && is_pair(cdr(expr)) &&
+                                 is_pair(cadr(expr)))) {
+            return 1;
+        }
+        if (op == let_sym && is_pair(cdr(expr)) && is_symbol(cadr(expr)) &&
+            is_pair(cddr(expr)) &&
+            !body_tail_calls(cadr(expr), cdddr(expr), 1)) {
+            return 1;
+        }
+        if (makes_closures(op)) {
+            return 1;
+        }
+        expr = cdr(expr);
+    }
+    return 0;
+}
+
+static void open_let_scope(scope_t *sc, scope_t *parent, obj_t *body) {
+    open_scope(sc, parent, parent->code, !parent->owner || makes_closures(body));
+    if (sc->owner == sc) {
+        sc->enter = emit_op(sc, OP_ENTER, 0);
+        emit(sc, 0);
+        emit(sc, 0);
+    }
+}
+
+/* Moves the 'n' values on top of the stack into the first slots of a scope
+ * opened by open_let_scope. */
+static void enter_scope(scope_t *sc, int n) {
+    if (sc->owner == sc) {
+        sc->code->bytecode->instrs[sc->enter + 1] = n;
+    } else {
+        for (int i = n - 1; i >= 0; i--) {
+            emit_op(sc, OP_STORE, 0);
+            emit(sc, sc->base + i);
+        }
+    }
+}
+
+/* Marks the slots of a scope from its first'th name on as not yet defined.
+ * Only a scope entered more than once in the same frame needs this: one
+ * that borrows its owner's slots, or the body of a loop. */
+static void unassign_slots(scope_t *sc, int first) {
+    for (int i = first; i < sc->count; i++) {
+        emit_op(sc, OP_UNASSIGN, sc->base + i);
+    }
+}
+
+static void leave_scope(scope_t *sc, int tail) {
+    if (sc->owner == sc && !(tail & TAIL)) {
+        emit(sc, OP_LEAVE);
+    }
+}
+
+/* Sizes the frame once every nested scope has claimed its slots. */
+static void finish_scope(scope_t *sc) {
+    if (sc->owner == sc) {
+        int names = new_const(sc, sc->frame_names);
+        sc->code->bytecode->instrs[sc->enter] = names;
+        sc->code->bytecode->instrs[sc->enter + 2] = sc->nslots;
+    }
+}
+
+/* special forms ----------------------------------------------------------- */
+
+static void compile_sequence(VM *vm, scope_t *sc, obj_t *exprs, int tail) {
+    FIG_ASSERT(vm, is_pair(exprs), "invalid syntax begin");
+
+    while (!is_the_empty_list(cdr(exprs))) {
+        compile_expr(vm, sc, car(exprs), 0);
+        emit(sc, OP_POP);
+        exprs = cdr(exprs);
+    }
+    compile_expr(vm, sc, car(exprs), tail);
+}
+
+static int has_unquote(obj_t *tmpl) {
+    while (is_pair(tmpl)) {
+        if (is_tagged(tmpl, unquote_sym) || has_unquote(car(tmpl))) {
+            return 1;
+        }
+        tmpl = cdr(tmpl);
+    }
+    return 0;
+}
+
+static void compile_quasi(VM *vm, scope_t *sc, obj_t *tmpl) {
+    if (is_tagged(tmpl, unquote_sym)) {
+        FIG_ASSERT(vm, is_pair(cdr(tmpl)) && is_the_empty_list(cddr(tmpl)),
+                   "invalid syntax in 'unquote'");
+        compile_expr(vm, sc, cadr(tmpl), 0);
+        return;
+    }
+
+    if (!has_unquote(tmpl)) {
+        compile_const(sc, tmpl);
+        return;
+    }
+
+    int n = 0;
+    while (is_pair(tmpl) && !is_tagged(tmpl, unquote_sym)) {
+        compile_quasi(vm, sc, car(tmpl));
+        tmpl = cdr(tmpl);
+        n++;
+    }
+    compile_quasi(vm, sc, tmpl);
+    emit_op(sc, OP_LIST, n);
+}
+
+static void compile_lambda(VM *vm, scope_t *sc, obj_t *name, obj_t *params,
+                           obj_t *body) {
+    obj_t *code = mk_code(vm);
+    code_t *c = code->bytecode;
+    c->name = name;
+    c->params = params;
+    c->body = body;
+
+    scope_t inner;
+    open_scope(&inner, sc, code, 1);
+
+    while (is_pair(params)) {
+        bind_name(vm, &inner, car(params));
+        c->nparams++;
+        params = cdr(params);
+    }
+    if (!is_the_empty_list(params)) {
+        bind_name(vm, &inner, params);
+        c->rest = 1;
+    }
+    FIG_ASSERT(vm, inner.count == c->nparams + c->rest,
+               "duplicate parameter in lambda");
+
+    scan_body(vm, &inner, body);
+    compile_sequence(vm, &inner, body, TAIL);
+    emit(&inner, OP_RETURN);
+
+    c->names = inner.frame_names;
+    c->nlocals = inner.nslots;
+    write_barrier(vm, code, c->names);
+
+    emit_op(sc, OP_CLOSURE, add_const(sc, code));
+}
+
+/* Compiles the value of a binding, naming it after the variable if it is a
+ * lambda. */
+static void compile_value(VM *vm, scope_t *sc, obj_t *var, obj_t *expr) {
+    if (is_tagged(expr, lambda_sym) && is_pair(cdr(expr))) {
+        compile_lambda(vm, sc, var, cadr(expr), cddr(expr));
+    } else {
+        compile_expr(vm, sc, expr, 0);
+    }
+}
+
+static void compile_definition(VM *vm, scope_t *sc, obj_t *expr) {
+    FIG_ASSERT(vm, is_list(expr) && length(cdr(expr)) >= 2,
+               "invalid syntax define");
+
+    obj_t *var;
+    if (is_pair(cadr(expr))) {
+        var = caadr(expr);
+        compile_lambda(vm, sc, var, cdadr(expr), cddr(expr));
+    } else {
+        var = cadr(expr);
+        compile_value(vm, sc, var, caddr(expr));
+    }
+
+    FIG_ASSERT(vm, is_symbol(var), "invalid syntax define");
+
+    if (sc->parent) {
+        /* unlike set!, a definition may find its slot unassigned */
+        int index = name_index(sc, var);
+        FIG_ASSERT(vm, index >= 0, "invalid syntax define");
+        emit_op(sc, OP_STORE, 0);
+        emit(sc, sc->base + index);
+        compile_const(sc, NULL);
+    } else {
+        emit_op(sc, OP_DEFINE, add_const(sc, var));
+    }
+}
+
+static void compile_assignment(VM *vm, scope_t *sc, obj_t *expr) {
+    FIG_ASSERT(vm, is_list(expr) && length(cdr(expr)) == 2,
+               "incorrect argument count for set!. expected 2, got %d",
+               is_list(expr) ? length(cdr(expr)) : 0);
+    FIG_ASSERT(vm, is_symbol(cadr(expr)), "invalid syntax set!");
+
+    compile_expr(vm, sc, caddr(expr), 0);
+    compile_store(sc, cadr(expr));
+}
+
+static void compile_if(VM *vm, scope_t *sc, obj_t *expr, int tail) {
+    FIG_ASSERT(vm, is_list(expr) &&
+                   (length(cdr(expr)) == 2 || length(cdr(expr)) == 3),
+               "invalid syntax if");
+    FIG_ASSERT(vm, !is_top_level_only(cadr(expr)), "invalid syntax if");
+
+    compile_expr(vm, sc, cadr(expr), 0);
+    int to_else = emit_op(sc, OP_JUMP_IF_FALSE, 0);
+
+    compile_expr(vm, sc, caddr(expr), tail);
+    int to_end = emit_op(sc, OP_JUMP, 0);
+
+    patch(sc, to_else);
+    if (!is_the_empty_list(cdddr(expr))) {
+        compile_expr(vm, sc, cadddr(expr), tail);
+    } else {
+        compile_const(sc, NULL);
+    }
+    patch(sc, to_end);
+}
+
+/* derived forms ----------------------------------------------------------- */
+
+static obj_t *list2(VM *vm, obj_t *a, obj_t *b) {
+    return mk_cons(vm, a, mk_cons(vm, b, the_empty_list));
+}
+
+static obj_t *list3(VM *vm, obj_t *a, obj_t *b, obj_t *c) {
+    return mk_cons(vm, a, list2(vm, b, c));
+}
+
+static void check_bindings(VM *vm, obj_t *bindings, char *form) {
+    FIG_ASSERT(vm, is_list(bindings), "invalid syntax %s", form);
+    for (; !is_the_empty_list(bindings); bindings = cdr(bindings)) {
+        obj_t *b = car(bindings);
+        FIG_ASSERT(vm, is_list(b) && length(b) == 2 && is_symbol(car(b)),
+                   "invalid syntax %s", form);
+    }
+}
+
+/* Binds the variable of each binding, or of each do spec, in order. */
+static void bind_vars(VM *vm, scope_t *sc, obj_t *bindings, char *form) {
+    int n = 0;
+    for (; !is_the_empty_list(bindings); bindings = cdr(bindings), n++) {
+        bind_name(vm, sc, caar(bindings));
+    }
+    FIG_ASSERT(vm, sc->count == n, "duplicate binding in %s", form);
+}
+
+/* Pushes the value of each binding, evaluated in 'sc'. */
+static int compile_inits(VM *vm, scope_t *sc, obj_t *bindings) {
+    int n = 0;
+    for (; !is_the_empty_list(bindings); bindings = cdr(bindings), n++) {
+        compile_value(vm, sc, caar(bindings), cadar(bindings));
+    }
+    return n;
+}
+
+static obj_t *binding_column(VM *vm, obj_t *bindings, int values) {
+    obj_t *head = the_empty_list;
+    obj_t *last = NULL;
+    for (; is_pair(bindings); bindings = cdr(bindings)) {
+        obj_t *item = values ? cadar(bindings) : caar(bindings);
+        obj_t *cell = mk_cons(vm, item, the_empty_list);
+        if (last) {
+            set_cdr(last, cell);
+        } else {
+            head = cell;
+        }
+        last = cell;
+    }
+    return head;
+}
+
+static int only_tail_calls(obj_t *label, obj_t *expr, int tail);
+
+static int body_tail_calls(obj_t *label, obj_t *exprs, int tail) {
+    for (; is_pair(exprs); exprs = cdr(exprs)) {
+        int last = !is_pair(cdr(exprs));
+        if (!only_tail_calls(label, car(exprs), last ? tail : 0)) {
+            return 0;
+        }
+    }
+    return exprs != label;
+}
+
+/*
+ * Checks that 'label' occurs in 'expr' only as the operator of calls in
+ * tail position, so a named let can jump back to its head instead of
+ * calling itself. With 'tail' clear this is just an occurrence check.
+ */
+static int only_tail_calls(obj_t *label, obj_t *expr, int tail) {
+    if (expr == label) {
+        return 0;
+    }
+    if (!is_pair(expr)) {
+        return 1;
+    }
+
+    obj_t *op = car(expr);
+    obj_t *rest = cdr(expr);
+
+    if (op == quote_sym) {
+        return 1;
+    }
+    if (!is_pair(rest)) {
+        return body_tail_calls(label, expr, 0);
+    }
+    if (op == if_sym) {
+        if (!only_tail_calls(label, car(rest), 0)) {
+            return 0;
+        }
+        for (rest = cdr(rest); is_pair(rest); rest = cdr(rest)) {
+            if (!only_tail_calls(label, car(rest), tail)) {
+                return 0;
+            }
+        }
+        return 1;
+    }
+    if (op == begin_sym || op == and_sym || op == or_sym) {
+        return body_tail_calls(label, rest, tail);
+    }
+    if (op == when_sym || op == unless_sym) {
+        return only_tail_calls(label, car(rest), 0) &&
+               body_tail_calls(label, cdr(rest), tail);
+    }
+    if ((op == let_sym && !is_symbol(car(rest))) || op == let_star_sym ||
+        op == letrec_sym) {
+        return body_tail_calls(label, car(rest), 0) &&
+               body_tail_calls(label, cdr(rest), tail);
+    }
+    if (op == cond_sym) {
+        for (; is_pair(rest); rest = cdr(rest)) {
+            obj_t *clause = car(rest);
+            if (!is_pair(clause)) {
+                return body_tail_calls(label, clause, 0);
+            }
+            if (is_pair(cdr(clause)) && cadr(clause) == arrow_sym) {
+                if (!body_tail_calls(label, clause, 0)) {
+                    return 0;
+                }
+            } else if ((car(clause) != else_sym &&
+                        !only_tail_calls(label, car(clause), 0)) ||
+                       !body_tail_calls(label, cdr(clause), tail)) {
+                return 0;
+            }
+        }
+        return 1;
+    }
+    if (op == case_sym) {
+        if (!only_tail_calls(label, car(rest), 0)) {
+            return 0;
+        }
+        for (rest = cdr(rest); is_pair(rest); rest = cdr(rest)) {
+            if (!is_pair(car(rest)) ||
+                !body_tail_calls(label, cdar(rest), tail)) {
+                return 0;
+            }
+        }
+        return 1;
+    }
+    if (op == label) {
+        return tail && body_tail_calls(label, rest, 0);
+    }
+    return body_tail_calls(label, expr, 0);
+}
+
+static void compile_application(VM *vm, scope_t *sc, obj_t *expr, int tail);
+
+/* A named let whose name is only called in tail position runs as a loop
+ * over its own variables. Otherwise it is a procedure, made once on entry:
+ * ((letrec ((name (lambda vars . body))) name) inits ...) */
+static void compile_named_let(VM *vm, scope_t *sc, obj_t *expr, int tail) {
+    FIG_ASSERT(vm, length(expr) >= 4, "invalid syntax let");
+
+    obj_t *label = cadr(expr);
+    obj_t *bindings = caddr(expr);
+    obj_t *body = cdddr(expr);
+    check_bindings(vm, bindings, "let");
+
+    if (!body_tail_calls(label, body, 1)) {
+        obj_t *vars = binding_column(vm, bindings, 0);
+        obj_t *lambda = mk_cons(vm, lambda_sym, mk_cons(vm, vars, body));
+        obj_t *letrec = list3(vm, letrec_sym,
+                              mk_cons(vm, list2(vm, label, lambda),
+                                      the_empty_list),
+                              label);
+        compile_application(vm, sc,
+                            mk_cons(vm, letrec,
+                                    binding_column(vm, bindings, 1)),
+                            tail);
+        return;
+    }
+
+    int n = compile_inits(vm, sc, bindings);
+
+    scope_t inner;
+    open_let_scope(&inner, sc, body);
+    bind_vars(vm, &inner, bindings, "let");
+    enter_scope(&inner, n);
+    scan_body(vm, &inner, body);
+
+    loop_t loop = {label, &inner, n, sc->code->bytecode->count,
+                   makes_closures(body)};
+    inner.loop = &loop;
+    unassign_slots(&inner, n);
+
+    compile_sequence(vm, &inner, body, (tail & TAIL) | LOOP_TAIL);
+    leave_scope(&inner, tail);
+    finish_scope(&inner);
+}
+
+static void compile_let(VM *vm, scope_t *sc, obj_t *expr, int tail) {
+    FIG_ASSERT(vm, is_list(expr) && length(expr) >= 3, "invalid syntax let");
+
+    if (is_symbol(cadr(expr))) {
+        compile_named_let(vm, sc, expr, tail);
+        return;
+    }
+
+    obj_t *bindings = cadr(expr);
+    obj_t *body = cddr(expr);
+    check_bindings(vm, bindings, "let");
+
+    int n = compile_inits(vm, sc, bindings);
+
+    scope_t inner;
+    open_let_scope(&inner, sc, body);
+    bind_vars(vm, &inner, bindings, "let");
+    enter_scope(&inner, n);
+    scan_body(vm, &inner, body);
+    if (inner.owner != &inner) {
+        unassign_slots(&inner, n);
+    }
+
+    compile_sequence(vm, &inner, body, tail);
+    leave_scope(&inner, tail);
+    finish_scope(&inner);
+}
+
+/* (let* (b1 b2 ...) body) is (let (b1) (let* (b2 ...) body)) */
+static void compile_let_star(VM *vm, scope_t *sc, obj_t *expr, int tail) {
+    FIG_ASSERT(vm, is_list(expr) && length(expr) >= 3, "invalid syntax let*");
+
+    obj_t *bindings = cadr(expr);
+    check_bindings(vm, bindings, "let*");
+
+    if (is_the_empty_list(bindings) || is_the_empty_list(cdr(bindings))) {
+        compile_let(vm, sc, mk_cons(vm, let_sym, cdr(expr)), tail);
+        return;
+    }
+
+    obj_t *rest = mk_cons(vm, let_star_sym,
+                          mk_cons(vm, cdr(bindings), cddr(expr)));
+    obj_t *first = mk_cons(vm, car(bindings), the_empty_list);
+    compile_let(vm, sc, list3(vm, let_sym, first, rest), tail);
+}
+
+static void compile_letrec(VM *vm, scope_t *sc, obj_t *expr, int tail) {
+    FIG_ASSERT(vm, is_list(expr) && length(expr) >= 3,
+               "invalid syntax letrec");
+
+    obj_t *bindings = cadr(expr);
+    obj_t *body = cddr(expr);
+    check_bindings(vm, bindings, "letrec");
+
+    scope_t inner;
+    open_let_scope(&inner, sc, cdr(expr));
+    bind_vars(vm, &inner, bindings, "letrec");
+    enter_scope(&inner, 0);
+    scan_body(vm, &inner, body);
+    if (inner.owner != &inner) {
+        unassign_slots(&inner, 0);
+    }
+
+    int slot = inner.base;
+    for (obj_t *b = bindings; !is_the_empty_list(b); b = cdr(b)) {
+        compile_value(vm, &inner, caar(b), cadar(b));
+        emit_op(&inner, OP_STORE, 0);
+        emit(&inner, slot++);
+    }
+
+    compile_sequence(vm, &inner, body, tail);
+    leave_scope(&inner, tail);
+    finish_scope(&inner);
+}
+
+static void compile_cond(VM *vm, scope_t *sc, obj_t *clauses, int tail) {
+    if (is_the_empty_list(clauses)) {
+        compile_const(sc, NULL);
+        return;
+    }
+
+    obj_t *clause = car(clauses);
+    obj_t *rest = cdr(clauses);
+    FIG_ASSERT(vm, is_list(clause) && !is_the_empty_list(clause),
+               "invalid syntax cond");
+
+    if (car(clause) == else_sym) {
+        FIG_ASSERT(vm, is_the_empty_list(rest) && !is_the_empty_list(cdr(clause)),
+                   "invalid syntax cond");
+        compile_sequence(vm, sc, cdr(clause), tail);
+        return;
+    }
+
+    /* (test => f) is (let ((t test)) (if t (f t) (cond rest ...))) */
+    if (is_pair(cdr(clause)) && cadr(clause) == arrow_sym) {
+        FIG_ASSERT(vm, length(clause) == 3, "invalid syntax cond");
+        obj_t *t = mk_gensym(vm, "t");
+        obj_t *call = list2(vm, caddr(clause), t);
+        obj_t *test = list3(vm, if_sym, t, call);
+        set_cdr(cddr(test), mk_cons(vm, mk_cons(vm, cond_sym, rest),
+                                    the_empty_list));
+        obj_t *binding = mk_cons(vm, list2(vm, t, car(clause)),
+                                 the_empty_list);
+        compile_let(vm, sc, list3(vm, let_sym, binding, test), tail);
+        return;
+    }
+
+    compile_expr(vm, sc, car(clause), 0);
+
+    if (is_the_empty_list(cdr(clause))) {
+        int to_end = emit_op(sc, OP_JUMP_IF_TRUE_OR_POP, -1);
+        compile_cond(vm, sc, rest, tail);
+        patch_chain(sc, to_end);
+        return;
+    }
+
+    int to_next = emit_op(sc, OP_JUMP_IF_FALSE, 0);
+    compile_sequence(vm, sc, cdr(clause), tail);
+    int to_end = emit_op(sc, OP_JUMP, 0);
+    patch(sc, to_next);
+    compile_cond(vm, sc, rest, tail);
+    patch(sc, to_end);
+}
+
+static void compile_case(VM *vm, scope_t *sc, obj_t *expr, int tail) {
+    FIG_ASSERT(vm, is_list(expr) && length(expr) >= 2, "invalid syntax case");
+
+    compile_expr(vm, sc, cadr(expr), 0);
+
+    int to_end = -1;
+    for (obj_t *clauses = cddr(expr); !is_the_empty_list(clauses);
+         clauses = cdr(clauses)) {
+        obj_t *clause = car(clauses);
+        FIG_ASSERT(vm, is_list(clause) && length(clause) >= 2,
+                   "invalid syntax case");
+
+        if (car(clause) == else_sym) {
+            FIG_ASSERT(vm, is_the_empty_list(cdr(clauses)),
+                       "invalid syntax case");
+            emit(sc, OP_POP);
+            compile_sequence(vm, sc, cdr(clause), tail);
+            patch_chain(sc, to_end);
+            return;
+        }
+
+        FIG_ASSERT(vm, is_list(car(clause)), "invalid syntax case");
+
+        int to_body = -1;
+        for (obj_t *d = car(clause); !is_the_empty_list(d); d = cdr(d)) {
+            emit_op(sc, OP_JUMP_IF_EQV, add_const(sc, car(d)));
+            to_body = emit(sc, to_body);
+        }
+        int to_next = emit_op(sc, OP_JUMP, 0);
+
+        patch_chain(sc, to_body);
+        emit(sc, OP_POP);
+        compile_sequence(vm, sc, cdr(clause), tail);
+        to_end = emit_op(sc, OP_JUMP, to_end);
+        patch(sc, to_next);
+    }
+
+    emit(sc, OP_POP);
+    compile_const(sc, NULL);
+    patch_chain(sc, to_end);
+}
+
+/* and, or: each value but the last is kept only if it decides the result */
+static void compile_junction(VM *vm, scope_t *sc, obj_t *expr, int tail,
+                             opcode op, obj_t *unit) {
+    FIG_ASSERT(vm, is_list(expr), "invalid syntax %s", car(expr)->sym);
+
+    obj_t *exprs = cdr(expr);
+    if (is_the_empty_list(exprs)) {
+        compile_const(sc, unit);
+        return;
+    }
+
+    int to_end = -1;
+    while (!is_the_empty_list(cdr(exprs))) {
+        compile_expr(vm, sc, car(exprs), 0);
+        to_end = emit_op(sc, op, to_end);
+        exprs = cdr(exprs);
+    }
+    compile_expr(vm, sc, car(exprs), tail);
+    patch_chain(sc, to_end);
+}
+
+static void compile_when(VM *vm, scope_t *sc, obj_t *expr, int tail) {
+    int when = car(expr) == when_sym;
+    FIG_ASSERT(vm, is_list(expr) && length(expr) >= 3, "invalid syntax %s",
+               when ? "when" : "unless");
+
+    compile_expr(vm, sc, cadr(expr), 0);
+    int to_other = emit_op(sc, OP_JUMP_IF_FALSE, 0);
+
+    if (when) {
+        compile_sequence(vm, sc, cddr(expr), tail);
+    } else {
+        compile_const(sc, NULL);
+    }
+    int to_end = emit_op(sc, OP_JUMP, 0);
+
+    patch(sc, to_other);
+    if (when) {
+        compile_const(sc, NULL);
+    } else {
+        compile_sequence(vm, sc, cddr(expr), tail);
+    }
+    patch(sc, to_end);
+}
+
+/* Stores the stepped do variables, last pushed first. */
+static void store_steps(scope_t *sc, obj_t *specs, int slot) {
+    if (is_the_empty_list(specs)) {
+        return;
+    }
+    store_steps(sc, cdr(specs), slot + 1);
+    if (!is_the_empty_list(cddar(specs))) {
+        emit_op(sc, OP_STORE, 0);
+        emit(sc, slot);
+    }
+}
+
+static void compile_do(VM *vm, scope_t *sc, obj_t *expr, int tail) {
+    FIG_ASSERT(vm, is_list(expr) && length(expr) >= 3 && is_list(cadr(expr)) &&
+                   is_list(caddr(expr)) && is_pair(caddr(expr)),
+               "invalid syntax do");
+
+    obj_t *specs = cadr(expr);
+    obj_t *exit = caddr(expr);
+    obj_t *commands = cdddr(expr);
+
+    for (obj_t *s = specs; !is_the_empty_list(s); s = cdr(s)) {
+        obj_t *spec = car(s);
+        FIG_ASSERT(vm, is_list(spec) && is_symbol(car(spec)) &&
+                       (length(spec) == 2 || length(spec) == 3),
+                   "invalid syntax do");
+    }
+
+    int n = compile_inits(vm, sc, specs);
+
+    scope_t inner;
+    /* the steps run in the scope too, and may close over it */
+    open_let_scope(&inner, sc, cdr(expr));
+    bind_vars(vm, &inner, specs, "do");
+    enter_scope(&inner, n);
+
+    loop_t loop = {NULL, &inner, n, sc->code->bytecode->count,
+                   makes_closures(cdr(expr))};
+    inner.loop = &loop;
+
+    compile_expr(vm, &inner, car(exit), 0);
+    int to_body = emit_op(&inner, OP_JUMP_IF_FALSE, 0);
+
+    if (is_the_empty_list(cdr(exit))) {
+        compile_const(&inner, NULL);
+    } else {
+        compile_sequence(vm, &inner, cdr(exit), tail & TAIL);
+    }
+    leave_scope(&inner, tail);
+    int to_end = emit_op(&inner, OP_JUMP, 0);
+
+    patch(&inner, to_body);
+    for (; !is_the_empty_list(commands); commands = cdr(commands)) {
+        compile_expr(vm, &inner, car(commands), 0);
+        emit(&inner, OP_POP);
+    }
+
+    if (loop.rebind) {
+        /* a closure may hold this iteration's frame, so step into a new one */
+        for (obj_t *s = specs; !is_the_empty_list(s); s = cdr(s)) {
+            if (!is_the_empty_list(cddar(s))) {
+                compile_expr(vm, &inner, caddar(s), 0);
+            } else {
+                compile_reference(&inner, caar(s));
+            }
+        }
+        emit_op(&inner, OP_REBIND, n);
+    } else {
+        for (obj_t *s = specs; !is_the_empty_list(s); s = cdr(s)) {
+            if (!is_the_empty_list(cddar(s))) {
+                compile_expr(vm, &inner, caddar(s), 0);
+            }
+        }
+        store_steps(&inner, specs, inner.base);
+    }
+    emit_op(&inner, OP_JUMP, loop.head);
+
+    patch(&inner, to_end);
+    finish_scope(&inner);
+}
+
+/* application ------------------------------------------------------------- */
+
+/* Returns the named let that a call to 'symbol' jumps back to, if any. */
+static loop_t *loop_target(scope_t *sc, obj_t *symbol) {
+    for (; sc; sc = sc->parent) {
+        if (name_index(sc, symbol) >= 0) {
+            return NULL;
+        }
+        if (sc->loop) {
+            return sc->loop->label == symbol ? sc->loop : NULL;
+        }
+    }
+    return NULL;
+}
+
+static void compile_loop_call(VM *vm, scope_t *sc, loop_t *loop,
+                              obj_t *expr) {
+    int argc = 0;
+    for (obj_t *args = cdr(expr); !is_the_empty_list(args); args = cdr(args)) {
+        FIG_ASSERT(vm, !is_top_level_only(car(args)), "invalid syntax");
+        compile_expr(vm, sc, car(args), 0);
+        argc++;
+    }
+    FIG_ASSERT(vm, argc == loop->nvars,
+               "incorrect number of arguments passed to '%s'",
+               loop->label->sym);
+
+    for (scope_t *s = sc; s != loop->scope; s = s->parent) {
+        if (s->owner == s) {
+            emit(sc, OP_LEAVE);
+        }
+    }
+
+    if (loop->rebind) {
+        emit_op(sc, OP_REBIND, argc);
+    } else {
+        for (int i = argc - 1; i >= 0; i--) {
+            emit_op(sc, OP_STORE, 0);
+            emit(sc, loop->scope->base + i);
+        }
+    }
+    emit_op(sc, OP_JUMP, loop->head);
+}
+
+/* constant folding -------------------------------------------------------- */
+
+#define MAX_FOLD_ARGS 8
+
+/* Builtins whose result depends only on their arguments. */
+static builtin pure_builtins[] = {
+    builtin_plus,         builtin_minus,           builtin_times,
+    builtin_divide,       builtin_remainder,       builtin_gt,
+    builtin_gte,          builtin_lt,              builtin_lte,
+    builtin_numeq,        builtin_is_null,         builtin_is_boolean,
+    builtin_is_symbol,    builtin_is_num,          builtin_is_integer,
+    builtin_is_char,      builtin_is_string,       builtin_is_pair,
+    builtin_is_list,      builtin_is_vector,       builtin_is_proc,
+    builtin_is_equal,     builtin_char_to_int,     builtin_int_to_char,
+    builtin_number_to_string, builtin_string_to_number,
+    builtin_symbol_to_string, builtin_string_to_symbol,
+    builtin_car,          builtin_cdr,             builtin_vector_length,
+    builtin_string_length, builtin_string_ref,     builtin_substring,
+    builtin_string_append, builtin_exact_to_inexact, builtin_inexact_to_exact,
+    builtin_exp,          builtin_log,             builtin_sin,
+    builtin_cos,          builtin_tan,             builtin_asin,
+    builtin_acos,         builtin_atan,            builtin_sqrt,
+    builtin_expt,         builtin_is_exact,        builtin_is_inexact,
+    builtin_is_f64vector, builtin_is_s64vector};
+
+static int is_pure(obj_t *fn) {
+    if (!fn || !is_builtin(fn)) {
+        return 0;
+    }
+    for (size_t i = 0; i < sizeof(pure_builtins) / sizeof(builtin); i++) {
+        if (fn->proc == pure_builtins[i]) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Computes the value of 'expr' if it is a literal or a call of a pure
+ * global builtin on such values, consing each (symbol . builtin) it relies
+ * on onto *deps. Everything allocated stays on the stack for the caller to
+ * pop. Errors raised by the builtins propagate.
+ */
+static int fold(VM *vm, scope_t *sc, obj_t *expr, obj_t **value,
+                obj_t **deps) {
+    if (is_self_evaluating(expr)) {
+        *value = expr;
+        return 1;
+    }
+    if (is_tagged(expr, quote_sym)) {
+        if (!is_pair(cdr(expr)) || !is_the_empty_list(cddr(expr))) {
+            return 0;
+        }
+        *value = cadr(expr);
+        return 1;
+    }
+    if (!is_pair(expr) || !is_symbol(car(expr)) || !is_list(expr)) {
+        return 0;
+    }
+
+    int depth, slot;
+    obj_t *op = car(expr);
+    if (resolve(sc, op, &depth, &slot)) {
+        return 0;
+    }
+    op = unalias(op);
+    if (!op->bound || !is_pure(op->value)) {
+        return 0;
+    }
+
+    obj_t *args[MAX_FOLD_ARGS];
+    int argc = 0;
+    for (obj_t *rest = cdr(expr); !is_the_empty_list(rest); rest = cdr(rest)) {
+        if (argc == MAX_FOLD_ARGS ||
+            !fold(vm, sc, car(rest), &args[argc], deps)) {
+            return 0;
+        }
+        argc++;
+    }
+
+    *deps = mk_cons(vm, mk_cons(vm, op, op->value), *deps);
+
+    int base = vm->sp;
+    push(vm, op->value);
+    for (int i = 0; i < argc; i++) {
+        push(vm, args[i]);
+    }
+    *value = op->value->proc(vm, argc, &vm->stack[base + 1]);
+    push(vm, *value);
+    return 1;
+}
+
+/*
+ * Emits OP_FOLDED if the call 'expr' folds to a constant, returning the
+ * operand to patch with the address past its unfolded code, else -1. A
+ * call that raises is left for run time to report.
+ */
+static int compile_fold(VM *vm, scope_t *sc, obj_t *expr) {
+    int sp = vm->sp;
+    obj_t *err = exc;
+
+    jmp_buf outer;
+    memcpy(outer, exc_env, sizeof(jmp_buf));
+
+    obj_t *value = NULL;
+    obj_t *deps = the_empty_list;
+    int folded = 0;
+    if (!setjmp(exc_env)) {
+        folded = fold(vm, sc, expr, &value, &deps);
+    }
+
+    memcpy(exc_env, outer, sizeof(jmp_buf));
+    exc = err;
+
+    if (!folded) {
+        vm->sp = sp;
+        return -1;
+    }
+
+    int idx = new_const(sc, mk_cons(vm, value, deps));
+    vm->sp = sp;
+
+    emit_op(sc, OP_FOLDED, idx);
+    emit(sc, add_ic(sc));
+    return emit(sc, -1);
+}
+
+static void compile_application(VM *vm, scope_t *sc, obj_t *expr, int tail) {
+    FIG_ASSERT(vm, is_list(expr), "invalid syntax");
+
+    if ((tail & LOOP_TAIL) && is_symbol(car(expr))) {
+        loop_t *loop = loop_target(sc, car(expr));
+        if (loop) {
+            compile_loop_call(vm, sc, loop, expr);
+            return;
+        }
+    }
+
+    int folded = compile_fold(vm, sc, expr);
+    int ic = add_ic(sc);
+    int depth, slot;
+    obj_t *op = car(expr);
+
+    if (is_symbol(op) && !resolve(sc, op, &depth, &slot)) {
+        emit_op(sc, OP_CALLEE, add_const(sc, unalias(op)));
+        emit(sc, ic);
+    } else {
+        compile_expr(vm, sc, op, 0);
+    }
+
+    int argc = 0;
+    for (obj_t *args = cdr(expr); !is_the_empty_list(args); args = cdr(args)) {
+        FIG_ASSERT(vm, !is_top_level_only(car(args)), "invalid syntax");
+        compile_expr(vm, sc, car(args), 0);
+        argc++;
+    }
+
+    emit_op(sc, (tail & TAIL) ? OP_TAIL_CALL : OP_CALL, argc);
+    emit(sc, ic);
+
+    if (folded >= 0) {
+        patch(sc, folded);
+        if (tail & TAIL) {
+            emit(sc, OP_RETURN);
+        }
+    }
+}
+
+static void compile_expr(VM *vm, scope_t *sc, obj_t *expr, int tail) {
+    if (is_self_evaluating(expr)) {
+        compile_const(sc, expr);
+    }
+    else if (is_symbol(expr)) {
+        compile_reference(sc, expr);
+    }
+    else if (is_the_empty_list(expr)) {
+        raise(vm, "cannot evaluate the empty list");
+    }
+    else if (!is_pair(expr)) {
+        raise(vm, "invalid syntax");
+    }
+    else if (car(expr) == quote_sym) {
+        FIG_ASSERT(vm, is_pair(cdr(expr)) && is_the_empty_list(cddr(expr)),
+                   "invalid syntax");
+        compile_const(sc, cadr(expr));
+    }
+    else if (car(expr) == quasiquote_sym) {
+        FIG_ASSERT(vm, is_pair(cdr(expr)) && is_the_empty_list(cddr(expr)),
+                   "invalid syntax in 'quasiquote'");
+        compile_quasi(vm, sc, cadr(expr));
+    }
+    else if (car(expr) == unquote_sym) {
+        raise(vm, "improper setting for 'unquote'");
+    }
+    else if (car(expr) == define_sym) {
+        compile_definition(vm, sc, expr);
+    }
+    else if (car(expr) == set_sym) {
+        compile_assignment(vm, sc, expr);
+    }
+    else if (car(expr) == lambda_sym) {
+        FIG_ASSERT(vm, is_pair(cdr(expr)), "invalid syntax lambda");
+        compile_lambda(vm, sc, NULL, cadr(expr), cddr(expr));
+    }
+    else if (car(expr) == begin_sym) {
+        compile_sequence(vm, sc, cdr(expr), tail);
+    }
+    else if (car(expr) == if_sym) {
+        compile_if(vm, sc, expr, tail);
+    }
+    else if (car(expr) == let_sym) {
+        compile_let(vm, sc, expr, tail);
+    }
+    else if (car(expr) == let_star_sym) {
+        compile_let_star(vm, sc, expr, tail);
+    }
+    else if (car(expr) == letrec_sym) {
+        compile_letrec(vm, sc, expr, tail);
+    }
+    else if (car(expr) == cond_sym) {
+        FIG_ASSERT(vm, is_list(expr), "invalid syntax cond");
+        compile_cond(vm, sc, cdr(expr), tail);
+    }
+    else if (car(expr) == case_sym) {
+        compile_case(vm, sc, expr, tail);
+    }
+    else if (car(expr) == and_sym) {
+        compile_junction(vm, sc, expr, tail, OP_JUMP_IF_FALSE_OR_POP, true);
+    }
+    else if (car(expr) == or_sym) {
+        compile_junction(vm, sc, expr, tail, OP_JUMP_IF_TRUE_OR_POP, false);
+    }
+    else if (car(expr) == when_sym || car(expr) == unless_sym) {
+        compile_when(vm, sc, expr, tail);
+    }
+    else if (car(expr) == do_sym) {
+        compile_do(vm, sc, expr, tail);
+    }
+    else {
+        compile_application(vm, sc, expr, tail);
+    }
+}
+
+obj_t *compile(VM *vm, obj_t *expr) {
+    scope_t top;
+    open_scope(&top, NULL, mk_code(vm), 0);
+    compile_expr(vm, &top, expr, TAIL);
+    emit(&top, OP_RETURN);
+    return top.code;
+}
+
+void code_delete(code_t *code) {
+    free(code->instrs);
+    free(code->consts);
+    free(code->ics);
+    free(code);
+}
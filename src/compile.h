@@ -0,0 +1,97 @@
+#ifndef COMPILE_H
+#define COMPILE_H
+
+#include "object.h"
+
+typedef struct obj_t obj_t;
+typedef struct VM VM;
+struct frame_t;
+
+/*
+ * Each instruction is an opcode word followed by its operands. Operands
+ * that name objects are indices into the constant pool of the enclosing
+ * code object.
+ */
+typedef enum {
+    OP_CONST,         /* idx       push consts[idx] */
+    OP_LOCAL,         /* d s       push slot s of the frame d levels out */
+    OP_SET_LOCAL,     /* d s       assign slot s of the frame d levels out */
+    OP_STORE,         /* d s       same, popping the value */
+    OP_UNASSIGN,      /* s         mark slot s of the frame as not yet defined */
+    OP_GLOBAL,        /* idx       push global value of symbol consts[idx] */
+    OP_CALLEE,        /* idx ic    same, for the operator of a call, through
+                                   inline cache ic */
+    OP_SET_GLOBAL,    /* idx       assign global symbol consts[idx] */
+    OP_DEFINE,        /* idx       bind global symbol consts[idx] */
+    OP_POP,           /*           discard top of stack */
+    OP_JUMP,          /* addr      continue at addr */
+    OP_JUMP_IF_FALSE, /* addr      pop, continue at addr if false */
+    OP_JUMP_IF_FALSE_OR_POP, /* addr  continue at addr if false, else pop */
+    OP_JUMP_IF_TRUE_OR_POP,  /* addr  continue at addr if true, else pop */
+    OP_JUMP_IF_EQV,   /* idx addr  continue at addr if top is eqv consts[idx] */
+    OP_FOLDED,        /* idx ic addr  push the value folded into consts[idx]
+                                   and continue at addr, unless a builtin it
+                                   was computed with has been redefined */
+    OP_ENTER,         /* idx n s   new frame of s slots named consts[idx],
+                                   the first n popped off the stack */
+    OP_REBIND,        /* n         replace the frame with a fresh copy holding
+                                   n popped values */
+    OP_LEAVE,         /*           return to the parent frame */
+    OP_CLOSURE,       /* idx       push closure over code consts[idx] */
+    OP_LIST,          /* n         cons n values onto the list on top */
+    OP_CALL,          /* argc ic   call procedure below argc arguments */
+    OP_TAIL_CALL,     /* argc ic   same, reusing the current frame */
+    OP_RETURN         /*           return top of stack to the caller */
+} opcode;
+
+/*
+ * Each call site has an inline cache. It remembers the procedure last
+ * called there once its type and argument count have been checked, so
+ * calling it again skips both. For a global operator it also stands in for
+ * the symbol's value until the VM's epoch moves on, which happens whenever
+ * a global bound to a procedure is redefined or assigned.
+ */
+typedef enum { IC_EMPTY, IC_BUILTIN, IC_CLOSURE } ic_kind;
+
+typedef struct ic_t {
+    obj_t *fn;
+    ic_kind kind;
+    long epoch;
+} ic_t;
+
+/*
+ * Code compiled ahead of time to C (see aot.c) runs the body for the frame
+ * on top of the VM. It returns 0 once it has pushed its value, or 1 after
+ * replacing the frame's code and environment for a tail call.
+ */
+typedef int (*native_code)(VM *vm, struct frame_t *frame);
+
+/*
+ * A frame holds one slot per name in 'names': the required parameters,
+ * then the rest parameter if there is one, then each internal definition,
+ * then the variables of any let-like forms that borrow the frame.
+ */
+typedef struct code_t {
+    obj_t *name;
+    obj_t *params;
+    obj_t *body;
+    obj_t *names;
+    int nparams;
+    int rest;
+    int nlocals;
+    int *instrs;
+    int count;
+    int capacity;
+    obj_t **consts;
+    int nconsts;
+    int consts_capacity;
+    ic_t *ics;
+    int nics;
+    native_code native;
+} code_t;
+
+obj_t *compile(VM *vm, obj_t *expr);
+
+void code_delete(code_t *code);
+
+#endif
@@ -61,7 +61,7 @@ obj_t *eval_quasiquote(obj_t *env, obj_t *expr) {
 int is_assignment(obj_t *expr) { return is_tagged_list(expr, set_sym); }
 
 obj_t *eval_assignment(VM *vm, obj_t *env, obj_t *expr) {
-    ARG_NUMCHECK(vm, cdr(expr), "set!", 2);
+    ARG_NUMCHECK(vm, length(cdr(expr)), "set!", 2);
     obj_t *var = cadr(expr);
     obj_t *val = eval(vm, env, caddr(expr));
     return env_set(vm, env, var, val);
@@ -97,7 +97,7 @@ int is_top_level_only(obj_t *expr) {
 }
 
 int is_callable(obj_t *expr) {
-    return expr->type == OBJ_FUN || expr->type == OBJ_BUILTIN;
+    return is_fun(expr) || is_builtin(expr);
 }
 
 int is_variadic(obj_t *fun) { return fun->variadic; }
@@ -113,10 +113,160 @@ obj_t *eval_arglist(VM *vm, obj_t *env, obj_t *arglist) {
         raise(vm, "invalid syntax '%s'", car(arglist));
     }
 
+    /* whatever evaluating the argument left on the stack is garbage now,
+     * but its value and the rest of the list must stay there while they
+     * are consed together */
+    int sp = vm->sp;
     expr = eval(vm, env, expr);
-    mk_cons(vm, expr, eval_arglist(vm, env, cdr(arglist)));
+    vm->sp = sp;
+    push(vm, expr);
 
-    return pop(vm);
+    obj_t *list = mk_cons(vm, expr, eval_arglist(vm, env, cdr(arglist)));
+    vm->sp = sp;
+    push(vm, list);
+    return list;
+}
+
+/* derived forms ----------------------------------------------------------- */
+
+/* The compiler handles these natively; here they are rewritten into the
+ * core forms above, or evaluated in place when that is simpler. */
+
+static obj_t *list2(VM *vm, obj_t *a, obj_t *b) {
+    return mk_cons(vm, a, mk_cons(vm, b, the_empty_list));
+}
+
+static obj_t *binding_column(VM *vm, obj_t *bindings, int values) {
+    if (!is_pair(bindings)) {
+        return the_empty_list;
+    }
+    obj_t *item = values ? cadar(bindings) : caar(bindings);
+    obj_t *rest = binding_column(vm, cdr(bindings), values);
+    return mk_cons(vm, item, rest);
+}
+
+static void check_bindings(VM *vm, obj_t *bindings, char *form) {
+    FIG_ASSERT(vm, is_list(bindings), "invalid syntax %s", form);
+    for (; !is_the_empty_list(bindings); bindings = cdr(bindings)) {
+        obj_t *b = car(bindings);
+        FIG_ASSERT(vm, is_list(b) && length(b) == 2 && is_symbol(car(b)),
+                   "invalid syntax %s", form);
+    }
+}
+
+/* (let name ((v e) ...) body) is
+ * ((lambda (v ...) (define (name v ...) body) (name v ...)) e ...) */
+obj_t *expand_let(VM *vm, obj_t *expr) {
+    FIG_ASSERT(vm, is_list(expr) && length(expr) >= 3, "invalid syntax let");
+
+    if (!is_symbol(cadr(expr))) {
+        check_bindings(vm, cadr(expr), "let");
+        obj_t *vars = binding_column(vm, cadr(expr), 0);
+        obj_t *lambda = mk_cons(vm, lambda_sym, mk_cons(vm, vars, cddr(expr)));
+        return mk_cons(vm, lambda, binding_column(vm, cadr(expr), 1));
+    }
+
+    FIG_ASSERT(vm, length(expr) >= 4, "invalid syntax let");
+    check_bindings(vm, caddr(expr), "let");
+
+    obj_t *label = cadr(expr);
+    obj_t *vars = binding_column(vm, caddr(expr), 0);
+    obj_t *define = mk_cons(vm, define_sym,
+                            mk_cons(vm, mk_cons(vm, label, vars), cdddr(expr)));
+    obj_t *body = list2(vm, define, mk_cons(vm, label, vars));
+    obj_t *lambda = mk_cons(vm, lambda_sym, mk_cons(vm, vars, body));
+    return mk_cons(vm, lambda, binding_column(vm, caddr(expr), 1));
+}
+
+/* (let* (b1 b2 ...) body) is (let (b1) (let* (b2 ...) body)) */
+obj_t *expand_let_star(VM *vm, obj_t *expr) {
+    FIG_ASSERT(vm, is_list(expr) && length(expr) >= 3, "invalid syntax let*");
+
+    obj_t *bindings = cadr(expr);
+    check_bindings(vm, bindings, "let*");
+
+    if (is_the_empty_list(bindings) || is_the_empty_list(cdr(bindings))) {
+        return mk_cons(vm, let_sym, cdr(expr));
+    }
+
+    obj_t *rest = mk_cons(vm, let_star_sym,
+                          mk_cons(vm, cdr(bindings), cddr(expr)));
+    obj_t *first = mk_cons(vm, car(bindings), the_empty_list);
+    return mk_cons(vm, let_sym, list2(vm, first, rest));
+}
+
+/* (letrec ((v e) ...) body) is ((lambda () (define v e) ... body)) */
+obj_t *expand_letrec(VM *vm, obj_t *expr) {
+    FIG_ASSERT(vm, is_list(expr) && length(expr) >= 3,
+               "invalid syntax letrec");
+    check_bindings(vm, cadr(expr), "letrec");
+
+    obj_t *body = cddr(expr);
+    obj_t *defines = binding_column(vm, cadr(expr), 0);
+    for (obj_t *d = defines, *b = cadr(expr); is_pair(d);
+         d = cdr(d), b = cdr(b)) {
+        set_car(d, mk_cons(vm, define_sym, car(b)));
+        if (is_the_empty_list(cdr(d))) {
+            set_cdr(d, body);
+            body = defines;
+            break;
+        }
+    }
+
+    obj_t *lambda = mk_cons(vm, lambda_sym, mk_cons(vm, the_empty_list, body));
+    return mk_cons(vm, lambda, the_empty_list);
+}
+
+static obj_t *do_column(VM *vm, obj_t *specs, int steps) {
+    if (!is_pair(specs)) {
+        return the_empty_list;
+    }
+
+    obj_t *spec = car(specs);
+    FIG_ASSERT(vm, is_list(spec) && is_symbol(car(spec)) &&
+                   (length(spec) == 2 || length(spec) == 3),
+               "invalid syntax do");
+
+    obj_t *item;
+    if (steps) {
+        item = is_the_empty_list(cddr(spec)) ? car(spec) : caddr(spec);
+    } else {
+        item = list2(vm, car(spec), cadr(spec));
+    }
+    obj_t *rest = do_column(vm, cdr(specs), steps);
+    return mk_cons(vm, item, rest);
+}
+
+static obj_t *append_exprs(VM *vm, obj_t *exprs, obj_t *tail) {
+    if (!is_pair(exprs)) {
+        return tail;
+    }
+    obj_t *rest = append_exprs(vm, cdr(exprs), tail);
+    return mk_cons(vm, car(exprs), rest);
+}
+
+/* (do ((v init step) ...) (test res ...) command ...) is
+ * (let loop ((v init) ...)
+ *   (if test (begin #<unspecified> res ...) (begin command ... (loop step ...))))
+ * where loop is a fresh symbol and a missing step is v itself. */
+obj_t *expand_do(VM *vm, obj_t *expr) {
+    FIG_ASSERT(vm, is_list(expr) && length(expr) >= 3 && is_list(cadr(expr)) &&
+                   is_pair(caddr(expr)) && is_list(caddr(expr)),
+               "invalid syntax do");
+
+    obj_t *label = mk_gensym(vm, "do");
+    obj_t *bindings = do_column(vm, cadr(expr), 0);
+    obj_t *steps = do_column(vm, cadr(expr), 1);
+    obj_t *exit = caddr(expr);
+
+    obj_t *result = mk_cons(vm, begin_sym, mk_cons(vm, NULL, cdr(exit)));
+    obj_t *loop = mk_cons(vm, mk_cons(vm, label, steps), the_empty_list);
+    obj_t *iterate = mk_cons(vm, begin_sym, append_exprs(vm, cdddr(expr), loop));
+    obj_t *body = mk_cons(vm, if_sym,
+                          mk_cons(vm, car(exit), list2(vm, result, iterate)));
+
+    return mk_cons(vm, let_sym,
+                   mk_cons(vm, label, list2(vm, bindings, body)));
 }
 
 int is_self_evaluating(obj_t *expr) {
@@ -125,6 +275,7 @@ int is_self_evaluating(obj_t *expr) {
 }
 
 obj_t *eval(VM *vm, obj_t *env, obj_t *expr) {
+    int sp = vm->sp;
 
 tailcall:
 
@@ -134,7 +285,7 @@ tailcall:
     else if (is_quote(expr)) {
         return text_of_quotation(expr);
     }
-    else if (expr->type == OBJ_SYM) {
+    else if (is_symbol(expr)) {
         return env_lookup(vm, env, expr);
     }
     else if (is_quasiquote(expr)) {
@@ -183,6 +334,118 @@ tailcall:
 
         goto tailcall;
     }
+    else if (is_tagged_list(expr, let_sym)) {
+        expr = expand_let(vm, expr);
+        goto tailcall;
+    }
+    else if (is_tagged_list(expr, let_star_sym)) {
+        expr = expand_let_star(vm, expr);
+        goto tailcall;
+    }
+    else if (is_tagged_list(expr, letrec_sym)) {
+        expr = expand_letrec(vm, expr);
+        goto tailcall;
+    }
+    else if (is_tagged_list(expr, do_sym)) {
+        expr = expand_do(vm, expr);
+        goto tailcall;
+    }
+    else if (is_tagged_list(expr, cond_sym)) {
+        FIG_ASSERT(vm, is_list(expr), "invalid syntax cond");
+
+        obj_t *clauses = cdr(expr);
+        for (; !is_the_empty_list(clauses); clauses = cdr(clauses)) {
+            obj_t *clause = car(clauses);
+            FIG_ASSERT(vm, is_list(clause) && !is_the_empty_list(clause),
+                       "invalid syntax cond");
+
+            if (car(clause) == else_sym) {
+                FIG_ASSERT(vm, !is_the_empty_list(cdr(clause)),
+                           "invalid syntax cond");
+                break;
+            }
+
+            obj_t *test = eval(vm, env, car(clause));
+            if (is_false(test)) {
+                continue;
+            }
+            if (is_the_empty_list(cdr(clause))) {
+                return test;
+            }
+            if (cadr(clause) == arrow_sym) {
+                FIG_ASSERT(vm, length(clause) == 3, "invalid syntax cond");
+                expr = list2(vm, caddr(clause), list2(vm, quote_sym, test));
+                goto tailcall;
+            }
+            break;
+        }
+
+        if (is_the_empty_list(clauses)) {
+            return NULL;
+        }
+        expr = mk_cons(vm, begin_sym, cdar(clauses));
+        goto tailcall;
+    }
+    else if (is_tagged_list(expr, case_sym)) {
+        FIG_ASSERT(vm, is_list(expr) && length(expr) >= 2,
+                   "invalid syntax case");
+
+        obj_t *key = eval(vm, env, cadr(expr));
+        obj_t *clauses = cddr(expr);
+
+        for (; !is_the_empty_list(clauses); clauses = cdr(clauses)) {
+            obj_t *clause = car(clauses);
+            FIG_ASSERT(vm, is_list(clause) && length(clause) >= 2,
+                       "invalid syntax case");
+
+            if (car(clause) == else_sym) {
+                break;
+            }
+
+            obj_t *data = car(clause);
+            FIG_ASSERT(vm, is_list(data), "invalid syntax case");
+            while (!is_the_empty_list(data) && !is_eqv(key, car(data))) {
+                data = cdr(data);
+            }
+            if (!is_the_empty_list(data)) {
+                break;
+            }
+        }
+
+        if (is_the_empty_list(clauses)) {
+            return NULL;
+        }
+        expr = mk_cons(vm, begin_sym, cdar(clauses));
+        goto tailcall;
+    }
+    else if (is_tagged_list(expr, and_sym) || is_tagged_list(expr, or_sym)) {
+        int and = car(expr) == and_sym;
+        obj_t *exprs = cdr(expr);
+
+        if (is_the_empty_list(exprs)) {
+            return and ? true : false;
+        }
+        for (; !is_the_empty_list(cdr(exprs)); exprs = cdr(exprs)) {
+            obj_t *value = eval(vm, env, car(exprs));
+            if (is_false(value) == and) {
+                return value;
+            }
+        }
+        expr = car(exprs);
+        goto tailcall;
+    }
+    else if (is_tagged_list(expr, when_sym) ||
+             is_tagged_list(expr, unless_sym)) {
+        FIG_ASSERT(vm, is_list(expr) && length(expr) >= 3,
+                   "invalid syntax %s", car(expr)->sym);
+
+        int when = car(expr) == when_sym;
+        if (is_false(eval(vm, env, cadr(expr))) == when) {
+            return NULL;
+        }
+        expr = mk_cons(vm, begin_sym, cddr(expr));
+        goto tailcall;
+    }
     else if (is_list(expr)) {
         if (is_the_empty_list(expr)) {
             raise(vm, "cannot evaluate the empty list");
@@ -191,12 +454,18 @@ tailcall:
         obj_t *procedure_sym = car(expr);
         obj_t *procedure = eval(vm, env, procedure_sym);
 
-        FIG_ASSERT(vm, is_callable(procedure), "cannot invoke object of type '%s'", type_name(procedure->type));
+        FIG_ASSERT(vm, is_callable(procedure), "cannot invoke object of type '%s'", type_name(obj_type(procedure)));
 
         obj_t *args = eval_arglist(vm, env, cdr(expr));
 
         if (is_builtin(procedure)) {
-            return procedure->proc(vm, args);
+            int argc = 0;
+            push(vm, procedure);
+            for (; !is_the_empty_list(args); args = cdr(args)) {
+                push(vm, car(args));
+                argc++;
+            }
+            return procedure->proc(vm, argc, &vm->stack[vm->sp - argc]);
         } else {
             if (!is_variadic(procedure)) {
                 FIG_ASSERT(vm, length(procedure->params) == length(args),
@@ -206,6 +475,11 @@ tailcall:
             env = env_extend(vm, procedure->env, procedure->params, args);
             expr = mk_cons(vm, begin_sym, procedure->body);
 
+            /* nothing pushed since entry is needed past a tail call, so a
+             * loop of them runs in constant stack */
+            vm->sp = sp;
+            push(vm, env);
+            push(vm, expr);
             goto tailcall;
         }
     }
@@ -0,0 +1,543 @@
+#include "common.h"
+#include "expand.h"
+#include "assert.h"
+
+#include <time.h>
+
+/*
+ * Macro expansion. Each top-level form is expanded once, before it is
+ * compiled or evaluated, and every macro use in it is overwritten in place
+ * by its expansion. A procedure body that runs many times was expanded
+ * exactly once, and expanding the same form again finds nothing to do.
+ *
+ * Macros are defined at top level with syntax-rules. Variables that a
+ * template binds with lambda, define, let, let*, letrec, named let or do
+ * are renamed to fresh symbols on every expansion, so they never capture
+ * names at the use site. Any other symbol in a template refers to the top
+ * level, where the macro was defined: if the use site binds the same name,
+ * the symbol is replaced by an alias for its global binding. Special-form
+ * keywords are never rebound, so they are left as they are.
+ */
+
+static int is_tagged(obj_t *expr, obj_t *tag) {
+    return expr && is_pair(expr) && car(expr) == tag;
+}
+
+static int memq(obj_t *symbol, obj_t *list) {
+    for (; is_pair(list); list = cdr(list)) {
+        if (car(list) == symbol) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static obj_t *assq(obj_t *symbol, obj_t *alist) {
+    for (; is_pair(alist); alist = cdr(alist)) {
+        if (caar(alist) == symbol) {
+            return car(alist);
+        }
+    }
+    return NULL;
+}
+
+static int count_pairs(obj_t *list) {
+    int n = 0;
+    for (; is_pair(list); list = cdr(list)) {
+        n++;
+    }
+    return n;
+}
+
+/* matching ---------------------------------------------------------------- */
+
+/*
+ * A match binds a pattern variable to (#f . form), or, for a variable
+ * under an ellipsis, to (#t . matches) with one match per repetition.
+ * 'binds' is an alist from pattern variables to matches.
+ */
+
+static obj_t *bind(VM *vm, obj_t *var, obj_t *match, obj_t *binds) {
+    return mk_cons(vm, mk_cons(vm, var, match), binds);
+}
+
+static void pattern_vars(VM *vm, obj_t *macro, obj_t *pattern, obj_t **vars) {
+    if (is_symbol(pattern)) {
+        if (pattern != underscore_sym && pattern != ellipsis_sym &&
+            !memq(pattern, macro->literals)) {
+            *vars = mk_cons(vm, pattern, *vars);
+        }
+    } else if (is_pair(pattern)) {
+        pattern_vars(vm, macro, car(pattern), vars);
+        pattern_vars(vm, macro, cdr(pattern), vars);
+    }
+}
+
+static int match(VM *vm, obj_t *macro, obj_t *pattern, obj_t *form,
+                 obj_t **binds) {
+    if (is_symbol(pattern)) {
+        if (pattern == underscore_sym) {
+            return 1;
+        }
+        if (memq(pattern, macro->literals)) {
+            return form == pattern;
+        }
+        *binds = bind(vm, pattern, mk_cons(vm, false, form), *binds);
+        return 1;
+    }
+
+    if (is_pair(pattern) && is_pair(cdr(pattern)) &&
+        cadr(pattern) == ellipsis_sym) {
+        obj_t *after = cddr(pattern);
+        int n = count_pairs(form) - count_pairs(after);
+        if (n < 0) {
+            return 0;
+        }
+
+        /* match each repetition on its own, last one first */
+        obj_t *reps = the_empty_list;
+        for (int i = 0; i < n; i++, form = cdr(form)) {
+            obj_t *rep = the_empty_list;
+            if (!match(vm, macro, car(pattern), car(form), &rep)) {
+                return 0;
+            }
+            reps = mk_cons(vm, rep, reps);
+        }
+
+        obj_t *vars = the_empty_list;
+        pattern_vars(vm, macro, car(pattern), &vars);
+        for (; is_pair(vars); vars = cdr(vars)) {
+            obj_t *matches = the_empty_list;
+            for (obj_t *r = reps; is_pair(r); r = cdr(r)) {
+                matches = mk_cons(vm, cdr(assq(car(vars), car(r))), matches);
+            }
+            *binds = bind(vm, car(vars), mk_cons(vm, true, matches), *binds);
+        }
+
+        return match(vm, macro, after, form, binds);
+    }
+
+    if (is_pair(pattern)) {
+        return is_pair(form) &&
+               match(vm, macro, car(pattern), car(form), binds) &&
+               match(vm, macro, cdr(pattern), cdr(form), binds);
+    }
+
+    if (is_the_empty_list(pattern)) {
+        return is_the_empty_list(form);
+    }
+
+    if (is_string(pattern)) {
+        return form && is_string(form) && !strcmp(pattern->str, form->str);
+    }
+    return is_eqv(pattern, form);
+}
+
+/* templates --------------------------------------------------------------- */
+
+static void add_rename(VM *vm, obj_t *var, obj_t *binds, obj_t **renames) {
+    if (is_symbol(var) && var != ellipsis_sym && !assq(var, binds) &&
+        !assq(var, *renames)) {
+        obj_t *fresh = mk_gensym(vm, var->sym);
+        *renames = mk_cons(vm, mk_cons(vm, var, fresh), *renames);
+    }
+}
+
+static void add_param_renames(VM *vm, obj_t *params, obj_t *binds,
+                              obj_t **renames) {
+    for (; is_pair(params); params = cdr(params)) {
+        add_rename(vm, car(params), binds, renames);
+    }
+    add_rename(vm, params, binds, renames);
+}
+
+/* Finds the variables a template binds. */
+static void template_binders(VM *vm, obj_t *tmpl, obj_t *binds,
+                             obj_t **renames) {
+    if (!is_pair(tmpl) || car(tmpl) == quote_sym) {
+        return;
+    }
+
+    obj_t *op = car(tmpl);
+    obj_t *rest = cdr(tmpl);
+
+    if (is_pair(rest)) {
+        if (op == lambda_sym) {
+            add_param_renames(vm, car(rest), binds, renames);
+        } else if (op == define_sym && is_pair(car(rest))) {
+            add_param_renames(vm, cdar(rest), binds, renames);
+        } else if (op == let_sym || op == let_star_sym || op == letrec_sym ||
+                   op == do_sym) {
+            obj_t *bindings = car(rest);
+            if (op == let_sym && is_symbol(bindings)) {
+                add_rename(vm, bindings, binds, renames);
+                bindings = is_pair(cdr(rest)) ? cadr(rest) : NULL;
+            }
+            for (; is_pair(bindings); bindings = cdr(bindings)) {
+                if (is_pair(car(bindings))) {
+                    add_rename(vm, caar(bindings), binds, renames);
+                }
+            }
+        }
+    }
+
+    for (; is_pair(tmpl); tmpl = cdr(tmpl)) {
+        template_binders(vm, car(tmpl), binds, renames);
+    }
+}
+
+static int is_keyword(obj_t *symbol) {
+    obj_t *keywords[] = {
+        quote_sym,  quasiquote_sym, unquote_sym, define_sym,  set_sym,
+        if_sym,     lambda_sym,     begin_sym,   let_sym,     let_star_sym,
+        letrec_sym, cond_sym,       case_sym,    and_sym,     or_sym,
+        when_sym,   unless_sym,     do_sym,      else_sym,    arrow_sym,
+        define_syntax_sym, syntax_rules_sym, ellipsis_sym, underscore_sym,
+    };
+    for (size_t i = 0; i < sizeof(keywords) / sizeof(keywords[0]); i++) {
+        if (symbol == keywords[i]) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* Finds the free symbols of a template that 'locals' would capture. */
+static void template_aliases(VM *vm, obj_t *tmpl, obj_t *binds,
+                             obj_t *locals, obj_t **renames) {
+    if (is_symbol(tmpl)) {
+        if (memq(tmpl, locals) && !is_keyword(tmpl) && !assq(tmpl, binds) &&
+            !assq(tmpl, *renames)) {
+            obj_t *alias = mk_alias(vm, tmpl);
+            *renames = mk_cons(vm, mk_cons(vm, tmpl, alias), *renames);
+        }
+    } else if (is_pair(tmpl) && car(tmpl) != quote_sym) {
+        template_aliases(vm, car(tmpl), binds, locals, renames);
+        template_aliases(vm, cdr(tmpl), binds, locals, renames);
+    }
+}
+
+static obj_t *instantiate(VM *vm, obj_t *tmpl, obj_t *binds, obj_t *renames);
+
+/* Collects the variables in 'tmpl' that are bound under an ellipsis. */
+static void repeated_vars(VM *vm, obj_t *tmpl, obj_t *binds, obj_t **vars) {
+    if (is_symbol(tmpl)) {
+        obj_t *b = assq(tmpl, binds);
+        if (b && is_true(cadr(b)) && !memq(tmpl, *vars)) {
+            *vars = mk_cons(vm, tmpl, *vars);
+        }
+    } else if (is_pair(tmpl)) {
+        repeated_vars(vm, car(tmpl), binds, vars);
+        repeated_vars(vm, cdr(tmpl), binds, vars);
+    }
+}
+
+/* Expands 'sub ...' followed by 'rest'. */
+static obj_t *instantiate_ellipsis(VM *vm, obj_t *sub, obj_t *rest,
+                                   obj_t *binds, obj_t *renames) {
+    /* the variables in 'sub' bound under an ellipsis drive the repetition */
+    obj_t *vars = the_empty_list;
+    repeated_vars(vm, sub, binds, &vars);
+
+    obj_t *cursors = the_empty_list;
+    int n = -1;
+    for (; is_pair(vars); vars = cdr(vars)) {
+        obj_t *b = assq(car(vars), binds);
+        int k = length(cddr(b));
+        FIG_ASSERT(vm, n < 0 || n == k,
+                   "syntax-rules: ellipsis variables differ in length");
+        n = k;
+        cursors = mk_cons(vm, mk_cons(vm, car(vars), cddr(b)), cursors);
+    }
+    FIG_ASSERT(vm, n >= 0, "syntax-rules: no pattern variable before '...'");
+
+    obj_t *head = the_empty_list;
+    obj_t *last = NULL;
+    for (int i = 0; i < n; i++) {
+        obj_t *inner = binds;
+        for (obj_t *c = cursors; is_pair(c); c = cdr(c)) {
+            inner = bind(vm, caar(c), cadar(c), inner);
+            set_cdr(car(c), cddar(c));
+        }
+
+        obj_t *cell = mk_cons(vm, instantiate(vm, sub, inner, renames),
+                              the_empty_list);
+        if (last) {
+            set_cdr(last, cell);
+        } else {
+            head = cell;
+        }
+        last = cell;
+    }
+
+    rest = instantiate(vm, rest, binds, renames);
+    if (last) {
+        set_cdr(last, rest);
+        return head;
+    }
+    return rest;
+}
+
+static obj_t *instantiate(VM *vm, obj_t *tmpl, obj_t *binds, obj_t *renames) {
+    if (is_symbol(tmpl)) {
+        obj_t *b = assq(tmpl, binds);
+        if (b) {
+            FIG_ASSERT(vm, is_false(cadr(b)),
+                       "syntax-rules: '%s' needs an ellipsis", tmpl->sym);
+            return cddr(b);
+        }
+        obj_t *r = assq(tmpl, renames);
+        return r ? cdr(r) : tmpl;
+    }
+
+    if (!is_pair(tmpl)) {
+        return tmpl;
+    }
+
+    if (car(tmpl) == quote_sym) {
+        renames = the_empty_list;
+    }
+
+    if (is_pair(cdr(tmpl)) && cadr(tmpl) == ellipsis_sym) {
+        return instantiate_ellipsis(vm, car(tmpl), cddr(tmpl), binds, renames);
+    }
+
+    obj_t *head = instantiate(vm, car(tmpl), binds, renames);
+    obj_t *tail = instantiate(vm, cdr(tmpl), binds, renames);
+    return mk_cons(vm, head, tail);
+}
+
+static obj_t *expand_macro(VM *vm, obj_t *macro, obj_t *form,
+                           obj_t *locals) {
+    for (obj_t *rules = macro->rules; is_pair(rules); rules = cdr(rules)) {
+        obj_t *pattern = caar(rules);
+        obj_t *tmpl = cadar(rules);
+        obj_t *binds = the_empty_list;
+
+        /* the pattern's keyword position is ignored */
+        if (match(vm, macro, cdr(pattern), cdr(form), &binds)) {
+            obj_t *renames = the_empty_list;
+            template_binders(vm, tmpl, binds, &renames);
+            template_aliases(vm, tmpl, binds, locals, &renames);
+
+            macro->uses++;
+            vm->expansions++;
+            return instantiate(vm, tmpl, binds, renames);
+        }
+    }
+
+    raise(vm, "no syntax-rules pattern matches use of '%s'",
+          macro->mname->sym);
+    return NULL; /* unreachable */
+}
+
+/* definitions ------------------------------------------------------------- */
+
+static void define_syntax(VM *vm, obj_t *form) {
+    FIG_ASSERT(vm, is_list(form) && length(form) == 3 && is_symbol(cadr(form)),
+               "invalid syntax define-syntax");
+
+    obj_t *spec = caddr(form);
+    FIG_ASSERT(vm, is_tagged(spec, syntax_rules_sym) && is_list(spec) &&
+                   length(spec) >= 2 && is_list(cadr(spec)),
+               "invalid syntax syntax-rules");
+
+    for (obj_t *rules = cddr(spec); !is_the_empty_list(rules);
+         rules = cdr(rules)) {
+        obj_t *rule = car(rules);
+        FIG_ASSERT(vm, is_list(rule) && length(rule) == 2 && is_pair(car(rule)),
+                   "invalid syntax syntax-rules");
+    }
+
+    obj_t *macro = mk_macro(vm, cadr(form), cadr(spec), cddr(spec));
+    env_define(vm, universe, cadr(form), macro);
+}
+
+/* walking ----------------------------------------------------------------- */
+
+/* Returns the macro 'form' uses, or NULL. */
+static obj_t *macro_use(obj_t *form, obj_t *locals) {
+    obj_t *op = car(form);
+    if (!is_symbol(op) || memq(op, locals)) {
+        return NULL;
+    }
+    op = unalias(op);
+    return op->bound && op->value && is_macro(op->value) ? op->value : NULL;
+}
+
+/* Overwrites a macro use with its expansion. */
+static void displace(VM *vm, obj_t *form, obj_t *expansion) {
+    if (is_pair(expansion)) {
+        set_car(form, car(expansion));
+        set_cdr(form, cdr(expansion));
+    } else {
+        set_car(form, begin_sym);
+        set_cdr(form, mk_cons(vm, expansion, the_empty_list));
+    }
+}
+
+static obj_t *param_locals(VM *vm, obj_t *params, obj_t *locals) {
+    for (; is_pair(params); params = cdr(params)) {
+        locals = mk_cons(vm, car(params), locals);
+    }
+    if (is_symbol(params)) {
+        locals = mk_cons(vm, params, locals);
+    }
+    return locals;
+}
+
+/* Internal definitions shadow macros throughout their body. */
+static obj_t *body_locals(VM *vm, obj_t *body, obj_t *locals) {
+    for (; is_pair(body); body = cdr(body)) {
+        obj_t *form = car(body);
+        if (is_tagged(form, define_sym) && is_pair(cdr(form))) {
+            obj_t *var = is_pair(cadr(form)) ? caadr(form) : cadr(form);
+            locals = mk_cons(vm, var, locals);
+        }
+    }
+    return locals;
+}
+
+static void expand_form(VM *vm, obj_t *form, obj_t *locals);
+
+static void expand_each(VM *vm, obj_t *forms, obj_t *locals) {
+    for (; is_pair(forms); forms = cdr(forms)) {
+        expand_form(vm, car(forms), locals);
+    }
+}
+
+static void expand_quasi(VM *vm, obj_t *tmpl, obj_t *locals) {
+    for (; is_pair(tmpl); tmpl = cdr(tmpl)) {
+        if (is_tagged(tmpl, unquote_sym)) {
+            expand_each(vm, cdr(tmpl), locals);
+            return;
+        }
+        if (is_tagged(car(tmpl), unquote_sym)) {
+            expand_each(vm, cdar(tmpl), locals);
+        } else {
+            expand_quasi(vm, car(tmpl), locals);
+        }
+    }
+}
+
+static void expand_form(VM *vm, obj_t *form, obj_t *locals) {
+    int sp = vm->sp;
+
+    if (!form) {
+        return;
+    }
+
+    obj_t *macro;
+    while (is_pair(form) && (macro = macro_use(form, locals))) {
+        displace(vm, form, expand_macro(vm, macro, form, locals));
+        vm->sp = sp;
+    }
+
+    if (!is_pair(form) || !is_pair(cdr(form))) {
+        expand_each(vm, form, locals);
+        return;
+    }
+
+    obj_t *op = car(form);
+    obj_t *rest = cdr(form);
+
+    if (op == quote_sym) {
+        return;
+    }
+    else if (op == quasiquote_sym) {
+        expand_quasi(vm, car(rest), locals);
+    }
+    else if (op == define_syntax_sym) {
+        raise(vm, "define-syntax is only allowed at top level");
+    }
+    else if (op == lambda_sym) {
+        locals = param_locals(vm, car(rest), locals);
+        locals = body_locals(vm, cdr(rest), locals);
+        expand_each(vm, cdr(rest), locals);
+    }
+    else if (op == define_sym && is_pair(car(rest))) {
+        locals = param_locals(vm, cdar(rest), locals);
+        locals = body_locals(vm, cdr(rest), locals);
+        expand_each(vm, cdr(rest), locals);
+    }
+    else if (op == let_sym || op == let_star_sym || op == letrec_sym ||
+             op == do_sym) {
+        if (op == let_sym && is_symbol(car(rest))) {
+            locals = mk_cons(vm, car(rest), locals);
+            rest = cdr(rest);
+        }
+        if (is_pair(rest)) {
+            obj_t *bindings = car(rest);
+            for (obj_t *b = bindings; is_pair(b); b = cdr(b)) {
+                if (is_pair(car(b))) {
+                    locals = mk_cons(vm, caar(b), locals);
+                }
+            }
+            for (obj_t *b = bindings; is_pair(b); b = cdr(b)) {
+                if (is_pair(car(b))) {
+                    expand_each(vm, cdar(b), locals);
+                }
+            }
+            if (op != do_sym) {
+                locals = body_locals(vm, cdr(rest), locals);
+            }
+            expand_each(vm, cdr(rest), locals);
+        }
+    }
+    else if (op == case_sym) {
+        expand_form(vm, car(rest), locals);
+        for (obj_t *c = cdr(rest); is_pair(c); c = cdr(c)) {
+            if (is_pair(car(c))) {
+                expand_each(vm, cdar(c), locals);
+            }
+        }
+    }
+    else {
+        expand_each(vm, form, locals);
+    }
+
+    vm->sp = sp;
+}
+
+/* Expands a form that is not inside any other, where definitions of
+ * macros are allowed. Returns the form to run in its place. */
+static obj_t *expand_top(VM *vm, obj_t *form) {
+    for (;;) {
+        if (is_tagged(form, define_syntax_sym)) {
+            define_syntax(vm, form);
+            return NULL;
+        }
+        obj_t *macro;
+        if (!form || !is_pair(form) ||
+            !(macro = macro_use(form, the_empty_list))) {
+            break;
+        }
+        displace(vm, form, expand_macro(vm, macro, form, the_empty_list));
+    }
+
+    if (is_tagged(form, begin_sym)) {
+        for (obj_t *forms = cdr(form); is_pair(forms); forms = cdr(forms)) {
+            set_car(forms, expand_top(vm, car(forms)));
+        }
+    } else {
+        expand_form(vm, form, the_empty_list);
+    }
+
+    return form;
+}
+
+obj_t *expand(VM *vm, obj_t *form) {
+    if (!form) {
+        return form;
+    }
+
+    clock_t start = clock();
+    int sp = vm->sp;
+
+    push(vm, form);
+    form = expand_top(vm, form);
+    vm->sp = sp;
+
+    vm->expand_usec += (long)(clock() - start) * 1000000 / CLOCKS_PER_SEC;
+    return form;
+}
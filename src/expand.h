@@ -0,0 +1,11 @@
+#ifndef EXPAND_H
+#define EXPAND_H
+
+#include "object.h"
+
+typedef struct obj_t obj_t;
+typedef struct VM VM;
+
+obj_t *expand(VM *vm, obj_t *form);
+
+#endif
@@ -1,5 +1,7 @@
 #include "common.h"
+#include "aot.h"
 #include "eval.h"
+#include "image.h"
 #include "builtins.h"
 #include "init.h"
 #include "read.h"
@@ -17,6 +19,9 @@ void repl(VM *vm) {
 
     Reader *rdr = reader_new(stdin);
 
+    int sp = vm->sp;
+    int fp = vm->fp;
+
     while (1) {
 
         int done = 0;
@@ -26,6 +31,9 @@ void repl(VM *vm) {
 
             println(exc);
 
+            vm->sp = sp;
+            vm->fp = fp;
+
         } else {
 
             printf("> ");
@@ -56,10 +64,49 @@ void repl(VM *vm) {
 
 int main(int argc, char **argv) {
 
-    init();
+    char *file = NULL;
+    char *out = NULL;
+    char *image = NULL;
+    char *dump = NULL;
+    int aot = 0;
+    long gc_budget = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--ast") == 0) {
+            ast_eval = 1;
+        } else if (strcmp(argv[i], "--compile") == 0) {
+            aot = 1;
+        } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            out = argv[++i];
+        } else if (strcmp(argv[i], "--gc-budget") == 0 && i + 1 < argc) {
+            gc_budget = strtol(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--image") == 0 && i + 1 < argc) {
+            image = argv[++i];
+        } else if (strcmp(argv[i], "--dump-image") == 0 && i + 1 < argc) {
+            dump = argv[++i];
+        } else {
+            file = argv[i];
+        }
+    }
+
+    if (aot && !file) {
+        fprintf(stderr, "usage: fig --compile file.fig [-o executable]\n");
+        return 1;
+    }
 
-    if (argc > 1) {
-        read_file(vm, argv[1]);
+    if (!image) {
+        init();
+    } else if (init_image(image)) {
+        return 1;
+    }
+    vm->gc_budget = gc_budget;
+
+    if (dump) {
+        return dump_image(vm, dump);
+    } else if (aot) {
+        return compile_program(vm, file, out);
+    } else if (file) {
+        read_file(vm, file);
     } else {
         repl(vm);
     }
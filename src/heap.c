@@ -0,0 +1,281 @@
+#include "heap.h"
+#include "object.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int class_of(size_t size) {
+    return (int)((size + GRANULE - 1) / GRANULE) - 1;
+}
+
+static page_t *page_new(heap_t *heap, int size) {
+    page_t *page = heap->empty;
+    if (page) {
+        heap->empty = page->next;
+    } else {
+        page = aligned_alloc(PAGE_SIZE, PAGE_SIZE);
+        if (!page) {
+            fprintf(stderr, "out of memory\n");
+            exit(1);
+        }
+        heap->npages++;
+    }
+
+    size_t header = (sizeof(page_t) + GRANULE - 1) / GRANULE * GRANULE;
+    page->next = NULL;
+    page->size = size;
+    page->start = (char *)page + header;
+    page->nslots = (int)((PAGE_SIZE - header) / size);
+    page->fresh = 0;
+    memset(page->live, 0, sizeof(page->live));
+    memset(page->marks, 0, sizeof(page->marks));
+    memset(page->remembered, 0, sizeof(page->remembered));
+
+    return page;
+}
+
+static void page_release(heap_t *heap, page_t *page) {
+    page->next = heap->empty;
+    heap->empty = page;
+}
+
+/* Deletes the objects of 'page' the last collection didn't mark. Returns
+ * the number of objects left. */
+static int sweep_page(page_t *page) {
+    int live = 0;
+
+    for (int w = 0; w < BITMAP_WORDS; w++) {
+        uint64_t dead = page->live[w] & ~page->marks[w];
+        while (dead) {
+            int bit = w * 64 + __builtin_ctzll(dead);
+            obj_delete((obj_t *)((char *)page + bit * GRANULE));
+            dead &= dead - 1;
+        }
+        page->live[w] &= page->marks[w];
+        live += __builtin_popcountll(page->live[w]);
+    }
+
+    return live;
+}
+
+/* Pushes the empty slots of 'page' onto the free list of 'cls', lowest
+ * address first. */
+static void add_free_slots(page_t *page, size_class_t *cls) {
+    char *slot = page->start + (page->nslots - 1) * page->size;
+    for (; slot >= page->start; slot -= page->size) {
+        int bit = bit_of(slot);
+        if (!((page->live[bit / 64] >> (bit % 64)) & 1)) {
+            *(void **)slot = cls->free;
+            cls->free = slot;
+        }
+    }
+}
+
+/* Sweeps the next unswept page of 'cls'. Returns the slots it examined. */
+static int sweep_next(heap_t *heap, size_class_t *cls) {
+    page_t *page = cls->unswept;
+    int nslots = page->nslots;
+
+    cls->unswept = page->next;
+    if (sweep_page(page)) {
+        page->next = cls->swept;
+        cls->swept = page;
+        add_free_slots(page, cls);
+    } else {
+        page_release(heap, page);
+    }
+
+    return nslots;
+}
+
+void heap_init(heap_t *heap) {
+    memset(heap, 0, sizeof(heap_t));
+}
+
+void heap_delete(heap_t *heap) {
+    for (int c = 0; c < NUM_CLASSES; c++) {
+        page_t *lists[] = {heap->classes[c].swept, heap->classes[c].unswept};
+        for (int i = 0; i < 2; i++) {
+            page_t *page = lists[i];
+            while (page) {
+                page_t *next = page->next;
+                memset(page->marks, 0, sizeof(page->marks));
+                sweep_page(page);
+                free(page);
+                page = next;
+            }
+        }
+    }
+    while (heap->empty) {
+        page_t *next = heap->empty->next;
+        free(heap->empty);
+        heap->empty = next;
+    }
+    free(heap->remembered);
+    memset(heap, 0, sizeof(heap_t));
+}
+
+void *heap_alloc(heap_t *heap, size_t size) {
+    int c = class_of(size);
+    if (c >= NUM_CLASSES) {
+        fprintf(stderr, "cannot allocate an object of %zu bytes\n", size);
+        exit(1);
+    }
+
+    size_class_t *cls = &heap->classes[c];
+    void *slot;
+
+    for (;;) {
+        if (cls->free) {
+            slot = cls->free;
+            cls->free = *(void **)slot;
+            break;
+        }
+
+        if (cls->bump < cls->limit) {
+            slot = cls->bump;
+            cls->bump += (c + 1) * GRANULE;
+            break;
+        }
+
+        if (cls->unswept) {
+            sweep_next(heap, cls);
+            continue;
+        }
+
+        page_t *page = page_new(heap, (c + 1) * GRANULE);
+        page->next = cls->swept;
+        cls->swept = page;
+        cls->bump = page->start;
+        cls->limit = page->start + page->nslots * page->size;
+    }
+
+    page_t *page = page_of(slot);
+    int bit = bit_of(slot);
+    page->live[bit / 64] |= (uint64_t)1 << (bit % 64);
+    page->fresh = 1;
+    return slot;
+}
+
+/* Sweeps every page still holding garbage from the last major collection,
+ * so only live objects are marked before the collector starts marking. */
+void heap_finish_sweep(heap_t *heap) {
+    for (int c = 0; c < NUM_CLASSES; c++) {
+        size_class_t *cls = &heap->classes[c];
+        while (cls->unswept) {
+            sweep_next(heap, cls);
+        }
+    }
+}
+
+/* Sweeps unswept pages until about 'budget' slots have been examined.
+ * Returns 1 once none are left. */
+int heap_sweep_step(heap_t *heap, long budget) {
+    for (int c = 0; c < NUM_CLASSES; c++) {
+        size_class_t *cls = &heap->classes[c];
+        while (cls->unswept) {
+            if (budget <= 0) {
+                return 0;
+            }
+            budget -= sweep_next(heap, cls);
+        }
+    }
+    return 1;
+}
+
+/* Makes every object young again ahead of a major collection, which
+ * leaves nothing to remember. */
+void heap_clear_marks(heap_t *heap) {
+    for (int c = 0; c < NUM_CLASSES; c++) {
+        for (page_t *page = heap->classes[c].swept; page; page = page->next) {
+            memset(page->marks, 0, sizeof(page->marks));
+            memset(page->remembered, 0, sizeof(page->remembered));
+        }
+    }
+    heap->nremembered = 0;
+}
+
+/* Hands every page to the lazy sweeper once a major collection is done
+ * marking. Returns the number of objects marked. */
+long heap_start_sweep(heap_t *heap) {
+    long marked = 0;
+
+    for (int c = 0; c < NUM_CLASSES; c++) {
+        size_class_t *cls = &heap->classes[c];
+        for (page_t *page = cls->swept; page; page = page->next) {
+            for (int w = 0; w < BITMAP_WORDS; w++) {
+                marked += __builtin_popcountll(page->marks[w]);
+            }
+            page->fresh = 0;
+        }
+        cls->unswept = cls->swept;
+        cls->swept = NULL;
+        cls->free = NULL;
+        cls->bump = cls->limit = NULL;
+    }
+
+    return marked;
+}
+
+/* Frees the young objects a minor collection didn't mark, which can only
+ * be on pages allocated into since the last collection. Their slots join
+ * the free lists, which still hold every other free slot. Returns the
+ * number of objects freed. */
+long heap_sweep_young(heap_t *heap) {
+    long freed = 0;
+
+    for (int c = 0; c < NUM_CLASSES; c++) {
+        size_class_t *cls = &heap->classes[c];
+        for (page_t *page = cls->swept; page; page = page->next) {
+            if (!page->fresh) {
+                continue;
+            }
+            for (int w = 0; w < BITMAP_WORDS; w++) {
+                uint64_t dead = page->live[w] & ~page->marks[w];
+                page->live[w] &= page->marks[w];
+                while (dead) {
+                    int bit = w * 64 + __builtin_ctzll(dead);
+                    void *slot = (char *)page + bit * GRANULE;
+                    obj_delete(slot);
+                    *(void **)slot = cls->free;
+                    cls->free = slot;
+                    dead &= dead - 1;
+                    freed++;
+                }
+            }
+            page->fresh = 0;
+        }
+    }
+
+    return freed;
+}
+
+void heap_remember(heap_t *heap, void *p) {
+    page_t *page = page_of(p);
+    int bit = bit_of(p);
+    uint64_t mask = (uint64_t)1 << (bit % 64);
+
+    if (page->remembered[bit / 64] & mask) {
+        return;
+    }
+    page->remembered[bit / 64] |= mask;
+
+    if (heap->nremembered == heap->remembered_capacity) {
+        heap->remembered_capacity =
+            heap->remembered_capacity ? heap->remembered_capacity * 2 : 64;
+        heap->remembered = realloc(heap->remembered,
+                                   sizeof(void *) * heap->remembered_capacity);
+    }
+    heap->remembered[heap->nremembered++] = p;
+}
+
+/* Empties the remembered set once a minor collection has traced it. */
+void heap_forget_remembered(heap_t *heap) {
+    for (long i = 0; i < heap->nremembered; i++) {
+        void *p = heap->remembered[i];
+        int bit = bit_of(p);
+        page_of(p)->remembered[bit / 64] &= ~((uint64_t)1 << (bit % 64));
+    }
+    heap->nremembered = 0;
+}
@@ -0,0 +1,104 @@
+#ifndef HEAP_H
+#define HEAP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Objects live in pages of PAGE_SIZE bytes, aligned to their size, each
+ * cut into slots of one size class. A page keeps a bitmap of the slots
+ * holding objects and a bitmap of the objects the collector has marked,
+ * with a bit per GRANULE bytes, so the bits of an object are found from
+ * its address alone and marking never writes to the object itself.
+ *
+ * Marks are sticky: an object that survives a collection stays marked and
+ * so counts as old, and only unmarked objects are young. A minor
+ * collection marks from the roots and from the remembered old objects that
+ * were given a pointer to a young one, stopping at anything already
+ * marked, then sweeps just the pages allocated into since the last
+ * collection. A major collection clears every mark first.
+ *
+ * After a major collection the pages of each class are swept lazily:
+ * allocation takes slots off the class's free list, then from the unused
+ * tail of its newest page, and only when both are empty sweeps the next
+ * page holding garbage, scanning its bitmaps a word at a time.
+ */
+#define PAGE_SIZE (64 * 1024)
+#define GRANULE 16
+#define NUM_CLASSES 16 /* slots of 16, 32, ... 256 bytes */
+#define BITMAP_WORDS (PAGE_SIZE / GRANULE / 64)
+
+typedef struct page_t {
+    struct page_t *next;
+    int size;
+    int nslots;
+    int fresh; /* allocated into since the last collection */
+    char *start;
+    uint64_t live[BITMAP_WORDS];
+    uint64_t marks[BITMAP_WORDS];
+    uint64_t remembered[BITMAP_WORDS];
+} page_t;
+
+typedef struct size_class_t {
+    page_t *swept;   /* pages allocation may take slots from */
+    page_t *unswept; /* pages still holding garbage from the last collection */
+    void *free;      /* free slots of swept pages, linked through a word */
+    char *bump;      /* unused tail of the newest page */
+    char *limit;
+} size_class_t;
+
+typedef struct heap_t {
+    size_class_t classes[NUM_CLASSES];
+    page_t *empty; /* pages swept clean, kept for any class to reuse */
+    long npages;
+    void **remembered; /* old objects that may point at young ones */
+    long nremembered;
+    long remembered_capacity;
+} heap_t;
+
+void heap_init(heap_t *heap);
+void heap_delete(heap_t *heap);
+
+void *heap_alloc(heap_t *heap, size_t size);
+
+void heap_finish_sweep(heap_t *heap);
+int heap_sweep_step(heap_t *heap, long budget);
+void heap_clear_marks(heap_t *heap);
+long heap_start_sweep(heap_t *heap);
+long heap_sweep_young(heap_t *heap);
+
+void heap_remember(heap_t *heap, void *p);
+void heap_forget_remembered(heap_t *heap);
+
+static inline page_t *page_of(void *p) {
+    return (page_t *)((uintptr_t)p & ~(uintptr_t)(PAGE_SIZE - 1));
+}
+
+/* index of the bit for 'p' in the bitmaps of its page */
+static inline int bit_of(void *p) {
+    return (int)(((uintptr_t)p & (PAGE_SIZE - 1)) / GRANULE);
+}
+
+static inline int heap_is_marked(void *p) {
+    int bit = bit_of(p);
+    return (page_of(p)->marks[bit / 64] >> (bit % 64)) & 1;
+}
+
+static inline void heap_mark(void *p) {
+    int bit = bit_of(p);
+    page_of(p)->marks[bit / 64] |= (uint64_t)1 << (bit % 64);
+}
+
+/* Must follow every store of 'value' into a field of 'holder' that the
+ * collector traces, unless nothing has been allocated since 'holder' was:
+ * an old object given a young one is remembered for the next minor
+ * collection. A 'value' not aligned to GRANULE isn't on the heap. */
+static inline void heap_write_barrier(heap_t *heap, void *holder,
+                                      void *value) {
+    if (value && !((uintptr_t)value & (GRANULE - 1)) &&
+        heap_is_marked(holder) && !heap_is_marked(value)) {
+        heap_remember(heap, holder);
+    }
+}
+
+#endif
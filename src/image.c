@@ -0,0 +1,594 @@
+#include "common.h"
+#include "compile.h"
+#include "image.h"
+#include "init.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*
+ * A heap image holds every object reachable from the global environment
+ * and the symbol table, written once the standard library is loaded, so
+ * that later runs can start from it instead of reading and evaluating the
+ * library again.
+ *
+ * An image is an array of words: a header, then a record for each object
+ * made of a word with its type and the number of words that follow, then
+ * its fields. A field referring to an object on the heap holds one more
+ * than the index of that object's record, shifted left three bits, while
+ * NULL and immediates are stored as they are, which can't be confused as
+ * an immediate always has one of its low three bits set. Characters are
+ * stored inline, NUL-terminated and padded to a word, bignums as their
+ * sign and number of limbs followed by the limbs, and the elements of
+ * f64vectors and s64vectors as their bits. A builtin is stored
+ * by name and bound to the procedure of that name when the image is
+ * loaded.
+ *
+ * Loading maps the file and makes two passes over it: one that allocates
+ * every object, filling in what it holds besides references, and one that
+ * relocates the references to the objects just made. Inline caches start
+ * out empty.
+ *
+ * Words are stored in the order of the machine that wrote them, so an
+ * image is only for the build of fig that made it.
+ */
+
+#define IMAGE_MAGIC "FIGIMAGE"
+#define IMAGE_FORMAT 4
+
+typedef struct image_header {
+    char magic[8];
+    char version[8];
+    uint64_t format;
+    uint64_t nobjects;
+    uint64_t universe;
+} image_header;
+
+/* writing ----------------------------------------------------------------- */
+
+typedef struct {
+    FILE *out;
+    obj_t **objects; /* in the order of their records */
+    long nobjects;
+    long capacity;
+    obj_t **keys; /* maps each object to its index, by open addressing */
+    long *indices;
+    long size;
+    uint64_t *record; /* words of the record being made */
+    long length;
+    long record_capacity;
+} writer_t;
+
+static size_t hash_pointer(obj_t *object, long size) {
+    return ((uintptr_t)object / GRANULE * 0x9e3779b97f4a7c15ULL) & (size - 1);
+}
+
+static void grow_index(writer_t *w) {
+    long size = w->size ? w->size * 2 : 1024;
+    obj_t **keys = calloc(size, sizeof(obj_t *));
+    long *indices = malloc(sizeof(long) * size);
+
+    for (long i = 0; i < w->size; i++) {
+        if (w->keys[i]) {
+            size_t j = hash_pointer(w->keys[i], size);
+            while (keys[j]) {
+                j = (j + 1) & (size - 1);
+            }
+            keys[j] = w->keys[i];
+            indices[j] = w->indices[i];
+        }
+    }
+
+    free(w->keys);
+    free(w->indices);
+    w->keys = keys;
+    w->indices = indices;
+    w->size = size;
+}
+
+/* Returns the index of the record of 'object', queueing it to be written
+ * if it hasn't been seen before. */
+static long index_of(writer_t *w, obj_t *object) {
+    if (w->nobjects * 2 >= w->size) {
+        grow_index(w);
+    }
+
+    size_t j = hash_pointer(object, w->size);
+    while (w->keys[j]) {
+        if (w->keys[j] == object) {
+            return w->indices[j];
+        }
+        j = (j + 1) & (w->size - 1);
+    }
+
+    if (w->nobjects == w->capacity) {
+        w->capacity = w->capacity ? w->capacity * 2 : 1024;
+        w->objects = realloc(w->objects, sizeof(obj_t *) * w->capacity);
+    }
+    w->keys[j] = object;
+    w->indices[j] = w->nobjects;
+    w->objects[w->nobjects] = object;
+    return w->nobjects++;
+}
+
+static uint64_t ref_word(writer_t *w, obj_t *object) {
+    if (!object || is_immediate(object)) {
+        return (uint64_t)(uintptr_t)object;
+    }
+    return (uint64_t)(index_of(w, object) + 1) << 3;
+}
+
+static void put(writer_t *w, uint64_t word) {
+    if (w->length == w->record_capacity) {
+        w->record_capacity = w->record_capacity ? w->record_capacity * 2 : 64;
+        w->record = realloc(w->record, sizeof(uint64_t) * w->record_capacity);
+    }
+    w->record[w->length++] = word;
+}
+
+static void put_ref(writer_t *w, obj_t *object) { put(w, ref_word(w, object)); }
+
+static void put_chars(writer_t *w, char *chars, long len) {
+    put(w, len);
+    for (long i = 0; i <= len; i += sizeof(uint64_t)) {
+        uint64_t word = 0;
+        long n = len - i < (long)sizeof(uint64_t) ? len - i : sizeof(uint64_t);
+        memcpy(&word, chars + i, n);
+        put(w, word);
+    }
+}
+
+static void put_big(writer_t *w, big_t *n) {
+    put(w, n->sign);
+    put(w, n->len);
+    for (int i = 0; i < n->len; i++) {
+        put(w, n->limbs[i]);
+    }
+}
+
+static void write_record(VM *vm, writer_t *w, obj_t *object) {
+    w->length = 0;
+
+    switch (object->type) {
+    case OBJ_NUM:
+        put(w, object->numer);
+        put(w, object->denom);
+        break;
+    case OBJ_BIG:
+        put_big(w, &object->big);
+        break;
+    case OBJ_RATIO:
+        put_big(w, &object->rnumer);
+        put_big(w, &object->rdenom);
+        break;
+    case OBJ_DOUBLE: {
+        uint64_t bits;
+        memcpy(&bits, &object->dbl, sizeof(bits));
+        put(w, bits);
+        break;
+    }
+    case OBJ_SYM:
+        put(w, table_get(symbol_table, object->sym, object->hash) == object);
+        put(w, object->bound);
+        put_ref(w, object->value);
+        put_chars(w, object->sym, strlen(object->sym));
+        break;
+    case OBJ_STR:
+    case OBJ_BUILDER:
+        put_chars(w, object->str, object->len);
+        break;
+    case OBJ_PAIR:
+        put_ref(w, object->car);
+        put_ref(w, object->cdr);
+        break;
+    case OBJ_F64VEC:
+    case OBJ_S64VEC:
+        /* the bits of each element */
+        put(w, object->count);
+        for (long i = 0; i < object->count; i++) {
+            put(w, object->s64[i]);
+        }
+        break;
+    case OBJ_VEC:
+        put(w, object->size);
+        for (int i = 0; i < object->size; i++) {
+            put_ref(w, object->objects[i]);
+        }
+        break;
+    case OBJ_BUILTIN:
+        if (!find_builtin(object->bname)) {
+            raise(vm, "cannot save builtin '%s' in an image", object->bname);
+        }
+        put_chars(w, object->bname, strlen(object->bname));
+        break;
+    case OBJ_FUN:
+        put(w, object->variadic);
+        put_ref(w, object->fname);
+        put_ref(w, object->env);
+        put_ref(w, object->params);
+        put_ref(w, object->body);
+        put_ref(w, object->code);
+        break;
+    case OBJ_CODE: {
+        code_t *c = object->bytecode;
+        if (c->native) {
+            raise(vm, "cannot save native code in an image");
+        }
+        put_ref(w, c->name);
+        put_ref(w, c->params);
+        put_ref(w, c->body);
+        put_ref(w, c->names);
+        put(w, c->nparams);
+        put(w, c->rest);
+        put(w, c->nlocals);
+        put(w, c->nics);
+        put(w, c->count);
+        for (int i = 0; i < c->count; i++) {
+            put(w, c->instrs[i]);
+        }
+        put(w, c->nconsts);
+        for (int i = 0; i < c->nconsts; i++) {
+            put_ref(w, c->consts[i]);
+        }
+        break;
+    }
+    case OBJ_FRAME:
+        put_ref(w, object->parent);
+        put_ref(w, object->names);
+        put(w, object->nslots);
+        for (int i = 0; i < object->nslots; i++) {
+            put_ref(w, object->slots[i]);
+        }
+        break;
+    case OBJ_MACRO:
+        put_ref(w, object->mname);
+        put_ref(w, object->literals);
+        put_ref(w, object->rules);
+        put(w, object->uses);
+        break;
+    case OBJ_ERR:
+        put_chars(w, object->err, strlen(object->err));
+        break;
+    default:
+        raise(vm, "cannot save an object of type '%s' in an image",
+              type_name(obj_type(object)));
+    }
+
+    uint64_t head = object->type | (uint64_t)w->length << 8;
+    fwrite(&head, sizeof(uint64_t), 1, w->out);
+    fwrite(w->record, sizeof(uint64_t), w->length, w->out);
+}
+
+static void writer_free(writer_t *w) {
+    fclose(w->out);
+    free(w->objects);
+    free(w->keys);
+    free(w->indices);
+    free(w->record);
+}
+
+/*
+ * Writes the objects reachable from the global environment and the
+ * symbol table to the image 'path'. Records are written in the order the
+ * objects are first referred to, so each record's references are numbered
+ * as it is written. Returns an exit status.
+ */
+int dump_image(VM *vm, char *path) {
+    writer_t w = {0};
+    w.out = fopen(path, "wb");
+    if (!w.out) {
+        fprintf(stderr, "could not write '%s'\n", path);
+        return 1;
+    }
+
+    jmp_buf outer;
+    memcpy(outer, exc_env, sizeof(jmp_buf));
+
+    if (setjmp(exc_env)) {
+        println(exc);
+        memcpy(exc_env, outer, sizeof(jmp_buf));
+        writer_free(&w);
+        remove(path);
+        return 1;
+    }
+
+    image_header header = {IMAGE_MAGIC, VERSION, IMAGE_FORMAT};
+    fwrite(&header, sizeof(header), 1, w.out);
+
+    header.universe = ref_word(&w, universe);
+    for (size_t i = 0; i < symbol_table->size; i++) {
+        if (symbol_table->slots[i]) {
+            index_of(&w, symbol_table->slots[i]);
+        }
+    }
+    for (long i = 0; i < w.nobjects; i++) {
+        write_record(vm, &w, w.objects[i]);
+    }
+
+    header.nobjects = w.nobjects;
+    fseek(w.out, 0, SEEK_SET);
+    fwrite(&header, sizeof(header), 1, w.out);
+
+    memcpy(exc_env, outer, sizeof(jmp_buf));
+    writer_free(&w);
+    return 0;
+}
+
+/* loading ----------------------------------------------------------------- */
+
+typedef struct {
+    VM *vm;
+    obj_t *table; /* vector of the objects made, which keeps them alive */
+    long nobjects;
+} loader_t;
+
+static obj_t *deref(loader_t *l, uint64_t word) {
+    if (!word || (word & TAG_MASK)) {
+        return (obj_t *)(uintptr_t)word;
+    }
+    if ((word >> 3) > (uint64_t)l->nobjects) {
+        raise(l->vm, "invalid reference in image");
+    }
+    return l->table->objects[(word >> 3) - 1];
+}
+
+/* Stores the object 'word' refers to in 'field' of 'holder'. */
+static void relocate(loader_t *l, obj_t *holder, obj_t **field,
+                     uint64_t word) {
+    *field = deref(l, word);
+    write_barrier(l->vm, holder, *field);
+}
+
+/* Copies the integer stored at 'r'. */
+static big_t get_big(uint64_t *r) {
+    big_t n = {(limb_t *)&r[2], (int)r[1], (int)(int64_t)r[0]};
+    return big_copy(&n);
+}
+
+/* Makes the object of the record at 'r' with its references left NULL. */
+static obj_t *make_object(VM *vm, object_type type, uint64_t *r) {
+    obj_t *object;
+    builtin_def *def;
+
+    switch (type) {
+    case OBJ_NUM:
+        object = obj_new(vm, OBJ_NUM);
+        object->numer = r[0];
+        object->denom = r[1];
+        return object;
+    case OBJ_BIG:
+        object = obj_new(vm, OBJ_BIG);
+        object->big = get_big(r);
+        return object;
+    case OBJ_RATIO:
+        object = obj_new(vm, OBJ_RATIO);
+        object->rnumer = get_big(r);
+        object->rdenom = get_big(r + 2 + r[1]);
+        return object;
+    case OBJ_DOUBLE:
+        object = obj_new(vm, OBJ_DOUBLE);
+        memcpy(&object->dbl, &r[0], sizeof(object->dbl));
+        return object;
+    case OBJ_SYM:
+        if (r[0]) {
+            object = mk_sym(vm, (char *)&r[4]);
+            pop(vm);
+        } else {
+            object = obj_new(vm, OBJ_SYM);
+            object->sym = strdup((char *)&r[4]);
+            object->hash = table_hash(object->sym);
+        }
+        object->value = NULL;
+        object->bound = 0;
+        return object;
+    case OBJ_STR:
+        object = mk_string_len(vm, (char *)&r[1], r[0]);
+        pop(vm);
+        return object;
+    case OBJ_BUILDER:
+        object = mk_builder(vm);
+        builder_append(object, (char *)&r[1], r[0]);
+        pop(vm);
+        return object;
+    case OBJ_PAIR:
+        object = obj_new(vm, OBJ_PAIR);
+        object->car = object->cdr = NULL;
+        return object;
+    case OBJ_F64VEC:
+    case OBJ_S64VEC:
+        object = mk_numvec(vm, type, r[0]);
+        memcpy(object->s64, &r[1], sizeof(int64_t) * r[0]);
+        pop(vm);
+        return object;
+    case OBJ_VEC:
+        object = obj_new(vm, OBJ_VEC);
+        object->objects = calloc(r[0], sizeof(obj_t *));
+        object->size = r[0];
+        return object;
+    case OBJ_BUILTIN:
+        if (!(def = find_builtin((char *)&r[1]))) {
+            raise(vm, "no builtin named '%s'", (char *)&r[1]);
+        }
+        object = def->list_proc ? mk_list_builtin(vm, def->name, def->list_proc)
+                                : mk_builtin(vm, def->name, def->proc);
+        pop(vm);
+        return object;
+    case OBJ_FUN:
+        object = obj_new(vm, OBJ_FUN);
+        object->variadic = r[0];
+        object->fname = object->env = object->params = NULL;
+        object->body = object->code = NULL;
+        return object;
+    case OBJ_CODE: {
+        code_t *c = calloc(1, sizeof(code_t));
+        c->nparams = r[4];
+        c->rest = r[5];
+        c->nlocals = r[6];
+        c->nics = r[7];
+        c->ics = calloc(c->nics, sizeof(ic_t));
+        c->count = c->capacity = r[8];
+        c->instrs = malloc(sizeof(int) * c->count);
+        for (int i = 0; i < c->count; i++) {
+            c->instrs[i] = r[9 + i];
+        }
+        c->nconsts = c->consts_capacity = r[9 + c->count];
+        c->consts = calloc(c->nconsts, sizeof(obj_t *));
+
+        object = obj_new(vm, OBJ_CODE);
+        object->bytecode = c;
+        return object;
+    }
+    case OBJ_FRAME:
+        object = obj_new(vm, OBJ_FRAME);
+        object->parent = object->names = NULL;
+        object->slots = calloc(r[2], sizeof(obj_t *));
+        object->nslots = r[2];
+        return object;
+    case OBJ_MACRO:
+        object = obj_new(vm, OBJ_MACRO);
+        object->mname = object->literals = object->rules = NULL;
+        object->uses = r[3];
+        return object;
+    case OBJ_ERR:
+        object = mk_err(vm, (char *)&r[1]);
+        pop(vm);
+        return object;
+    default:
+        raise(vm, "invalid object of type %d in image", type);
+    }
+
+    return NULL; /* unreachable */
+}
+
+/* Fills in the references of 'object' from the record at 'r'. */
+static void relocate_object(loader_t *l, obj_t *object, uint64_t *r) {
+    switch (object->type) {
+    case OBJ_SYM:
+        object->bound = r[1];
+        relocate(l, object, &object->value, r[2]);
+        break;
+    case OBJ_PAIR:
+        relocate(l, object, &object->car, r[0]);
+        relocate(l, object, &object->cdr, r[1]);
+        break;
+    case OBJ_VEC:
+        for (int i = 0; i < object->size; i++) {
+            relocate(l, object, &object->objects[i], r[1 + i]);
+        }
+        break;
+    case OBJ_FUN:
+        relocate(l, object, &object->fname, r[1]);
+        relocate(l, object, &object->env, r[2]);
+        relocate(l, object, &object->params, r[3]);
+        relocate(l, object, &object->body, r[4]);
+        relocate(l, object, &object->code, r[5]);
+        break;
+    case OBJ_CODE: {
+        code_t *c = object->bytecode;
+        relocate(l, object, &c->name, r[0]);
+        relocate(l, object, &c->params, r[1]);
+        relocate(l, object, &c->body, r[2]);
+        relocate(l, object, &c->names, r[3]);
+        for (int i = 0; i < c->nconsts; i++) {
+            relocate(l, object, &c->consts[i], r[10 + c->count + i]);
+        }
+        break;
+    }
+    case OBJ_FRAME:
+        relocate(l, object, &object->parent, r[0]);
+        relocate(l, object, &object->names, r[1]);
+        for (int i = 0; i < object->nslots; i++) {
+            relocate(l, object, &object->slots[i], r[3 + i]);
+        }
+        break;
+    case OBJ_MACRO:
+        relocate(l, object, &object->mname, r[0]);
+        relocate(l, object, &object->literals, r[1]);
+        relocate(l, object, &object->rules, r[2]);
+        break;
+    default:
+        break;
+    }
+}
+
+/*
+ * Makes the objects of the image 'path' and returns its global
+ * environment, or NULL after reporting why it couldn't. Every symbol of
+ * the image that was interned is interned again.
+ */
+obj_t *load_image(VM *vm, char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "could not read '%s'\n", path);
+        return NULL;
+    }
+
+    struct stat st;
+    void *map = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size >= (off_t)sizeof(image_header)) {
+        map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+
+    image_header *header = map;
+    if (map == MAP_FAILED || memcmp(header->magic, IMAGE_MAGIC, 8) ||
+        strncmp(header->version, VERSION, 8) ||
+        header->format != IMAGE_FORMAT) {
+        fprintf(stderr, "'%s' is not an image made by this fig\n", path);
+        if (map != MAP_FAILED) {
+            munmap(map, st.st_size);
+        }
+        return NULL;
+    }
+
+    uint64_t *start = (uint64_t *)(header + 1);
+    uint64_t *end = (uint64_t *)((char *)map + st.st_size);
+    long n = header->nobjects;
+    uint64_t **records = malloc(sizeof(uint64_t *) * (n ? n : 1));
+
+    int sp = vm->sp;
+    jmp_buf outer;
+    memcpy(outer, exc_env, sizeof(jmp_buf));
+
+    if (setjmp(exc_env)) {
+        println(exc);
+        vm->sp = sp;
+        memcpy(exc_env, outer, sizeof(jmp_buf));
+        free(records);
+        munmap(map, st.st_size);
+        return NULL;
+    }
+
+    loader_t l = {vm, mk_vec(vm, calloc(n ? n : 1, sizeof(obj_t *)), n), n};
+    push(vm, l.table);
+
+    /* as after a collection that found this many objects live */
+    if (vm->gc_threshold < n * vm->heap_growth) {
+        vm->gc_threshold = n * vm->heap_growth;
+    }
+
+    uint64_t *r = start;
+    for (long i = 0; i < n; i++) {
+        if (r >= end || r + 1 + (r[0] >> 8) > end) {
+            raise(vm, "image '%s' is truncated", path);
+        }
+        records[i] = r + 1;
+        obj_t *object = make_object(vm, r[0] & 0xff, r + 1);
+        l.table->objects[i] = object;
+        write_barrier(vm, l.table, object);
+        r += 1 + (r[0] >> 8);
+    }
+
+    for (long i = 0; i < n; i++) {
+        relocate_object(&l, l.table->objects[i], records[i]);
+    }
+    obj_t *env = deref(&l, header->universe);
+
+    memcpy(exc_env, outer, sizeof(jmp_buf));
+    vm->sp = sp;
+    free(records);
+    munmap(map, st.st_size);
+    return env;
+}
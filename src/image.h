@@ -0,0 +1,11 @@
+#ifndef IMAGE_H
+#define IMAGE_H
+
+#include "object.h"
+
+typedef struct VM VM;
+
+int dump_image(VM *vm, char *path);
+obj_t *load_image(VM *vm, char *path);
+
+#endif
@@ -1,9 +1,7 @@
 #include "common.h"
+#include "image.h"
 #include "init.h"
 
-/* TODO: possible to specity a relative path instead? */
-#define STDLIB "/usr/local/Cellar/fig/"VERSION"/lib/lib.fig"
-
 void register_builtin(VM *vm, obj_t *env, builtin fun, char *bname) {
     obj_t *var = mk_sym(vm, bname);
     obj_t *fn = mk_builtin(vm, bname, fun);
@@ -14,73 +12,159 @@ void register_builtin(VM *vm, obj_t *env, builtin fun, char *bname) {
     pop(vm);
 }
 
-obj_t *global_env(VM *vm) {
-    obj_t *env = mk_env(vm);
+void register_list_builtin(VM *vm, obj_t *env, list_builtin fun, char *bname) {
+    obj_t *var = mk_sym(vm, bname);
+    obj_t *fn = mk_list_builtin(vm, bname, fun);
+    env_define(vm, env, var, fn);
 
-    register_builtin(vm, env, builtin_plus, "+");
-    register_builtin(vm, env, builtin_minus, "-");
-    register_builtin(vm, env, builtin_times, "*");
-    register_builtin(vm, env, builtin_divide, "/");
-    register_builtin(vm, env, builtin_remainder, "mod");
-
-    register_builtin(vm, env, builtin_gt, ">");
-    register_builtin(vm, env, builtin_gte, ">=");
-    register_builtin(vm, env, builtin_lt, "<");
-    register_builtin(vm, env, builtin_lte, "<=");
-    register_builtin(vm, env, builtin_numeq, "=");
-
-    register_builtin(vm, env, builtin_is_null, "null?");
-    register_builtin(vm, env, builtin_is_boolean, "boolean?");
-    register_builtin(vm, env, builtin_is_symbol, "symbol?");
-    register_builtin(vm, env, builtin_is_num, "number?");
-    register_builtin(vm, env, builtin_is_integer, "integer?");
-    register_builtin(vm, env, builtin_is_char, "char?");
-    register_builtin(vm, env, builtin_is_string, "string?");
-    register_builtin(vm, env, builtin_is_pair, "pair?");
-    register_builtin(vm, env, builtin_is_list, "list?");
-    register_builtin(vm, env, builtin_is_vector, "vector?");
-    register_builtin(vm, env, builtin_is_proc, "procedure?");
-    register_builtin(vm, env, builtin_is_equal, "eq?");
-
-    register_builtin(vm, env, builtin_char_to_int, "char->int");
-    register_builtin(vm, env, builtin_int_to_char, "int->char");
-    register_builtin(vm, env, builtin_number_to_string, "number->string");
-    register_builtin(vm, env, builtin_string_to_number, "string->number");
-    register_builtin(vm, env, builtin_symbol_to_string, "symbol->string");
-    register_builtin(vm, env, builtin_string_to_symbol, "string->symbol");
-
-    register_builtin(vm, env, builtin_cons, "cons");
-    register_builtin(vm, env, builtin_car, "car");
-    register_builtin(vm, env, builtin_cdr, "cdr");
-    register_builtin(vm, env, builtin_setcar, "set-car!");
-    register_builtin(vm, env, builtin_setcdr, "set-cdr!");
-
-    register_builtin(vm, env, builtin_make_vector, "make-vector");
-    register_builtin(vm, env, builtin_vector_length, "vector-length");
-    register_builtin(vm, env, builtin_vector_ref, "vector-ref");
-    register_builtin(vm, env, builtin_vector_set, "vector-set!");
-
-    register_builtin(vm, env, builtin_string_append, "string-append");
-
-    register_builtin(vm, env, builtin_display, "display");
-    register_builtin(vm, env, builtin_env, "env");
-    register_builtin(vm, env, builtin_load, "load");
-    register_builtin(vm, env, builtin_exit, "exit");
-
-    register_builtin(vm, env, builtin_raise, "raise");
+    pop(vm);
+    pop(vm);
+}
 
-    return env;
+/* Every builtin, under the name it is bound to globally. Heap images
+ * refer to builtins by these names. */
+static builtin_def builtin_defs[] = {
+    {"+", builtin_plus},
+    {"-", builtin_minus},
+    {"*", builtin_times},
+    {"/", builtin_divide},
+    {"mod", builtin_remainder},
+    {"exact->inexact", builtin_exact_to_inexact},
+    {"inexact->exact", builtin_inexact_to_exact},
+    {"exp", builtin_exp},
+    {"log", builtin_log},
+    {"sin", builtin_sin},
+    {"cos", builtin_cos},
+    {"tan", builtin_tan},
+    {"asin", builtin_asin},
+    {"acos", builtin_acos},
+    {"atan", builtin_atan},
+    {"sqrt", builtin_sqrt},
+    {"expt", builtin_expt},
+
+    {">", builtin_gt},
+    {">=", builtin_gte},
+    {"<", builtin_lt},
+    {"<=", builtin_lte},
+    {"=", builtin_numeq},
+
+    {"null?", builtin_is_null},
+    {"boolean?", builtin_is_boolean},
+    {"symbol?", builtin_is_symbol},
+    {"number?", builtin_is_num},
+    {"integer?", builtin_is_integer},
+    {"exact?", builtin_is_exact},
+    {"inexact?", builtin_is_inexact},
+    {"char?", builtin_is_char},
+    {"string?", builtin_is_string},
+    {"pair?", builtin_is_pair},
+    {"list?", builtin_is_list},
+    {"vector?", builtin_is_vector},
+    {"procedure?", builtin_is_proc},
+    {"eq?", builtin_is_equal},
+
+    {"char->int", builtin_char_to_int},
+    {"int->char", builtin_int_to_char},
+    {"number->string", builtin_number_to_string},
+    {"string->number", builtin_string_to_number},
+    {"symbol->string", builtin_symbol_to_string},
+    {"string->symbol", builtin_string_to_symbol},
+
+    {"cons", builtin_cons},
+    {"list", NULL, builtin_list},
+    {"car", builtin_car},
+    {"cdr", builtin_cdr},
+    {"set-car!", builtin_setcar},
+    {"set-cdr!", builtin_setcdr},
+
+    {"make-vector", builtin_make_vector},
+    {"vector-length", builtin_vector_length},
+    {"vector-ref", builtin_vector_ref},
+    {"vector-set!", builtin_vector_set},
+
+    {"f64vector?", builtin_is_f64vector},
+    {"make-f64vector", builtin_make_f64vector},
+    {"f64vector", builtin_f64vector},
+    {"f64vector-length", builtin_f64vector_length},
+    {"f64vector-ref", builtin_f64vector_ref},
+    {"f64vector-set!", builtin_f64vector_set},
+    {"f64vector->list", builtin_f64vector_to_list},
+    {"f64vector-fill!", builtin_f64vector_fill},
+    {"f64vector-copy", builtin_f64vector_copy},
+    {"f64vector-copy!", builtin_f64vector_copy_into},
+    {"f64vector-add!", builtin_f64vector_add},
+    {"f64vector-mul!", builtin_f64vector_mul},
+    {"f64vector-scale!", builtin_f64vector_scale},
+    {"f64vector-dot", builtin_f64vector_dot},
+    {"f64vector-sum", builtin_f64vector_sum},
+    {"f64vector-min", builtin_f64vector_min},
+    {"f64vector-max", builtin_f64vector_max},
+
+    {"s64vector?", builtin_is_s64vector},
+    {"make-s64vector", builtin_make_s64vector},
+    {"s64vector", builtin_s64vector},
+    {"s64vector-length", builtin_s64vector_length},
+    {"s64vector-ref", builtin_s64vector_ref},
+    {"s64vector-set!", builtin_s64vector_set},
+    {"s64vector->list", builtin_s64vector_to_list},
+    {"s64vector-fill!", builtin_s64vector_fill},
+    {"s64vector-copy", builtin_s64vector_copy},
+    {"s64vector-copy!", builtin_s64vector_copy_into},
+    {"s64vector-add!", builtin_s64vector_add},
+    {"s64vector-mul!", builtin_s64vector_mul},
+    {"s64vector-scale!", builtin_s64vector_scale},
+    {"s64vector-dot", builtin_s64vector_dot},
+    {"s64vector-sum", builtin_s64vector_sum},
+    {"s64vector-min", builtin_s64vector_min},
+    {"s64vector-max", builtin_s64vector_max},
+
+    {"string-length", builtin_string_length},
+    {"string-ref", builtin_string_ref},
+    {"substring", builtin_substring},
+    {"string-append", builtin_string_append},
+    {"string-builder", builtin_string_builder},
+    {"string-builder-append!", builtin_string_builder_append},
+    {"string-builder->string", builtin_string_builder_to_string},
+
+    {"display", builtin_display},
+    {"env", builtin_env},
+    {"macro-stats", builtin_macro_stats},
+    {"gc-stats", builtin_gc_stats},
+    {"load", builtin_load},
+    {"exit", builtin_exit},
+
+    {"raise", builtin_raise},
+};
+
+#define NUM_BUILTINS (sizeof(builtin_defs) / sizeof(builtin_def))
+
+builtin_def *find_builtin(char *name) {
+    for (size_t i = 0; i < NUM_BUILTINS; i++) {
+        if (strcmp(builtin_defs[i].name, name) == 0) {
+            return &builtin_defs[i];
+        }
+    }
+    return NULL;
 }
 
-void init() {
-    vm = vm_new();
-    symbol_table = table_new();
+obj_t *global_env(VM *vm) {
+    obj_t *env = mk_env(vm);
 
-    true = mk_bool(vm, 1);
-    false = mk_bool(vm, 0);
+    for (size_t i = 0; i < NUM_BUILTINS; i++) {
+        builtin_def *def = &builtin_defs[i];
+        if (def->list_proc) {
+            register_list_builtin(vm, env, def->list_proc, def->name);
+        } else {
+            register_builtin(vm, env, def->proc, def->name);
+        }
+    }
 
-    the_empty_list = mk_nil(vm);
+    return env;
+}
 
+/* Interns the symbols that name special forms. They are left on the
+ * stack, which keeps them alive though they are never bound. */
+static void init_keywords() {
     quote_sym = mk_sym(vm, "quote");
     quasiquote_sym = mk_sym(vm, "quasiquote");
     unquote_sym = mk_sym(vm, "unquote");
@@ -91,6 +175,59 @@ void init() {
     lambda_sym = mk_sym(vm, "lambda");
     begin_sym = mk_sym(vm, "begin");
 
+    let_sym = mk_sym(vm, "let");
+    let_star_sym = mk_sym(vm, "let*");
+    letrec_sym = mk_sym(vm, "letrec");
+    cond_sym = mk_sym(vm, "cond");
+    case_sym = mk_sym(vm, "case");
+    and_sym = mk_sym(vm, "and");
+    or_sym = mk_sym(vm, "or");
+    when_sym = mk_sym(vm, "when");
+    unless_sym = mk_sym(vm, "unless");
+    do_sym = mk_sym(vm, "do");
+    else_sym = mk_sym(vm, "else");
+    arrow_sym = mk_sym(vm, "=>");
+
+    define_syntax_sym = mk_sym(vm, "define-syntax");
+    syntax_rules_sym = mk_sym(vm, "syntax-rules");
+    ellipsis_sym = mk_sym(vm, "...");
+    underscore_sym = mk_sym(vm, "_");
+}
+
+/* Sets up the VM and the global environment without loading the
+ * standard library, which programs compiled ahead of time carry along. */
+void init_runtime() {
+    vm = vm_new();
+    symbol_table = table_new();
+
+    true = mk_bool(vm, 1);
+    false = mk_bool(vm, 0);
+
+    the_empty_list = mk_nil(vm);
+
+    init_keywords();
     universe = global_env(vm);
+}
+
+void init() {
+    init_runtime();
     read_file(vm, STDLIB);
 }
+
+/* Sets up the VM from a heap image in place of init(). Returns 0, or 1
+ * if the image can't be loaded. */
+int init_image(char *path) {
+    vm = vm_new();
+    symbol_table = table_new();
+
+    true = mk_bool(vm, 1);
+    false = mk_bool(vm, 0);
+
+    the_empty_list = mk_nil(vm);
+
+    if (!(universe = load_image(vm, path))) {
+        return 1;
+    }
+    init_keywords();
+    return 0;
+}
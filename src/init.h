@@ -4,6 +4,19 @@
 #include "object.h"
 #include "builtins.h"
 
+/* TODO: possible to specity a relative path instead? */
+#define STDLIB "/usr/local/Cellar/fig/"VERSION"/lib/lib.fig"
+
+typedef struct builtin_def {
+    char *name;
+    builtin proc;
+    list_builtin list_proc; /* instead of 'proc', see mk_list_builtin */
+} builtin_def;
+
+builtin_def *find_builtin(char *name);
+
+void init_runtime(void);
 void init(void);
+int init_image(char *path);
 
 #endif
\ No newline at end of file
@@ -1,87 +1,549 @@
 #include "common.h"
 #include "numbers.h"
 
-static long gcd(long a, long b) {
-    if (a == 0)
-        return b;
-    return gcd(b % a, a);
+#include <math.h>
+
+static unsigned long magnitude(long n) {
+    return n < 0 ? -(unsigned long)n : (unsigned long)n;
+}
+
+/* Brings numer/denom to lowest terms with a positive denominator. Neither
+ * may be LONG_MIN. */
+void reduce(long *numer, long *denom) {
+    if (*denom == 1) {
+        return;
+    }
+
+    long divisor = gcd_limb(magnitude(*numer), magnitude(*denom));
+    if (divisor != 1 && divisor != 0) {
+        *numer /= divisor;
+        *denom /= divisor;
+    }
+
+    if (*denom < 0) {
+        *numer *= -1;
+        *denom *= -1;
+    }
+}
+
+static void divide_out(big_t *n, big_t *divisor) {
+    big_t q;
+    big_divmod(n, divisor, &q, NULL);
+    big_free(n);
+    *n = q;
 }
 
-obj_t *reduce(VM *vm, obj_t *rational) {
-    int divisor = gcd(rational->numer, rational->denom);
-    if (divisor == 1) {
-        return rational;
+void reduce_big(big_t *numer, big_t *denom) {
+    if (!big_is_one(denom)) {
+        big_t divisor = big_gcd(numer, denom);
+        if (!big_is_one(&divisor)) {
+            divide_out(numer, &divisor);
+            divide_out(denom, &divisor);
+        }
+        big_free(&divisor);
     }
-    rational->numer /= divisor;
-    rational->denom /= divisor;
 
-    if (rational->denom < 0) {
-        rational->numer *= -1;
-        rational->denom *= -1;
+    if (denom->sign < 0) {
+        denom->sign = 1;
+        if (numer->len) {
+            numer->sign = -numer->sign;
+        }
+    }
+}
+
+/*
+ * Each operation first tries both operands as fixnums, which need no
+ * reduction. If either is inexact the other is made a double too, and the
+ * hardware does the rest. Otherwise they are tried as fractions of longs,
+ * checking every step for overflow, and only when that fails are they
+ * taken as fractions of bignums.
+ */
+
+static int either_double(obj_t *a, obj_t *b) {
+    return is_double(a) || is_double(b);
+}
+
+static int is_small(obj_t *x) {
+    return is_fixnum(x) || obj_type(x) == OBJ_NUM;
+}
+
+/* A number as a fraction of bignums, borrowing the limbs of a large one
+ * and holding those of a small one in 'space'. It is never freed. */
+typedef struct {
+    big_t numer, denom;
+    limb_t space[2];
+} ratio_t;
+
+static void as_ratio(obj_t *x, ratio_t *r) {
+    switch (obj_type(x)) {
+    case OBJ_BIG:
+        r->numer = x->big;
+        big_borrow_long(&r->denom, 1, &r->space[1]);
+        break;
+    case OBJ_RATIO:
+        r->numer = x->rnumer;
+        r->denom = x->rdenom;
+        break;
+    default:
+        big_borrow_long(&r->numer, num_numer(x), &r->space[0]);
+        big_borrow_long(&r->denom, num_denom(x), &r->space[1]);
     }
+}
+
+static int is_whole(ratio_t *r) { return big_is_one(&r->denom); }
 
-    return rational;
+/* The double nearest numer/denom, from an integer quotient of 63 or 64
+ * bits with the lowest set if there was a remainder, so that it rounds
+ * just once. */
+static double ratio_to_double(const big_t *numer, const big_t *denom) {
+    int shift = 63 - (big_bit_length(numer) - big_bit_length(denom));
+    big_t power = big_pow2(shift > 0 ? shift : -shift);
+    big_t n = shift > 0 ? big_mul(numer, &power) : big_copy(numer);
+    big_t d = shift > 0 ? big_copy(denom) : big_mul(denom, &power);
+
+    big_t q, r;
+    big_divmod(&n, &d, &q, &r);
+    double result = ldexp((double)(q.limbs[0] | !big_is_zero(&r)), -shift);
+    result *= q.sign;
+
+    big_free(&power);
+    big_free(&n);
+    big_free(&d);
+    big_free(&q);
+    big_free(&r);
+    return result;
+}
+
+double num_to_double(obj_t *x) {
+    if (is_fixnum(x)) {
+        return fixnum_value(x);
+    }
+    switch (x->type) {
+    case OBJ_DOUBLE:
+        return x->dbl;
+    case OBJ_BIG:
+        return big_to_double(&x->big);
+    case OBJ_RATIO:
+        return ratio_to_double(&x->rnumer, &x->rdenom);
+    default:
+        return (double)x->numer / x->denom;
+    }
+}
+
+/*
+ * x + sign * y, by Henrici's method: with g the gcd of the denominators,
+ * only a factor of g can be common to the numerator and denominator of
+ *
+ *   (xn * (yd / g) + yn * (xd / g)) / (xd * yd / g),
+ *
+ * so the result is reduced by a gcd with g rather than with the product.
+ */
+static obj_t *add_ratios(VM *vm, ratio_t *x, ratio_t *y, int sign) {
+    big_t numer, denom;
+
+    if (is_whole(x) && is_whole(y)) {
+        numer = sign > 0 ? big_add(&x->numer, &y->numer)
+                         : big_sub(&x->numer, &y->numer);
+        return mk_bignum(vm, numer);
+    }
+
+    big_t g = big_gcd(&x->denom, &y->denom), xd, yd;
+    big_divmod(&x->denom, &g, &xd, NULL);
+    big_divmod(&y->denom, &g, &yd, NULL);
+
+    big_t p = big_mul(&x->numer, &yd), q = big_mul(&y->numer, &xd);
+    numer = sign > 0 ? big_add(&p, &q) : big_sub(&p, &q);
+    big_free(&p);
+    big_free(&q);
+
+    big_t common = big_gcd(&numer, &g);
+    big_t rest = big_copy(&y->denom);
+    if (!big_is_one(&common)) {
+        divide_out(&numer, &common);
+        divide_out(&rest, &common);
+    }
+    denom = big_mul(&xd, &rest);
+
+    big_free(&g);
+    big_free(&xd);
+    big_free(&yd);
+    big_free(&common);
+    big_free(&rest);
+
+    return mk_ratio(vm, numer, denom);
+}
+
+/* x * y, cancelling each numerator against the other's denominator first,
+ * which leaves the product in lowest terms. */
+static obj_t *mul_ratios(VM *vm, ratio_t *x, ratio_t *y) {
+    if (is_whole(x) && is_whole(y)) {
+        return mk_bignum(vm, big_mul(&x->numer, &y->numer));
+    }
+
+    big_t g1 = big_gcd(&x->numer, &y->denom);
+    big_t g2 = big_gcd(&y->numer, &x->denom);
+    big_t xn, xd, yn, yd;
+    big_divmod(&x->numer, &g1, &xn, NULL);
+    big_divmod(&y->denom, &g1, &yd, NULL);
+    big_divmod(&y->numer, &g2, &yn, NULL);
+    big_divmod(&x->denom, &g2, &xd, NULL);
+
+    big_t numer = big_mul(&xn, &yn), denom = big_mul(&xd, &yd);
+
+    big_free(&g1);
+    big_free(&g2);
+    big_free(&xn);
+    big_free(&xd);
+    big_free(&yn);
+    big_free(&yd);
+
+    return mk_ratio(vm, numer, denom);
+}
+
+/* numer/denom = an/ad + sign * bn/bd, or 0 on overflow. */
+static int small_add(long an, long ad, long bn, long bd, int sign, long *numer,
+                     long *denom) {
+    long p = an, q = bn;
+
+    *denom = ad;
+    if (ad != bd && (__builtin_mul_overflow(an, bd, &p) ||
+                     __builtin_mul_overflow(bn, ad, &q) ||
+                     __builtin_mul_overflow(ad, bd, denom))) {
+        return 0;
+    }
+    return sign > 0 ? !__builtin_add_overflow(p, q, numer)
+                    : !__builtin_sub_overflow(p, q, numer);
+}
+
+static obj_t *add(VM *vm, obj_t *a, obj_t *b, int sign) {
+    long numer, denom;
+    if (is_small(a) && is_small(b) &&
+        small_add(num_numer(a), num_denom(a), num_numer(b), num_denom(b), sign,
+                  &numer, &denom)) {
+        return mk_num_from_long(vm, numer, denom);
+    }
+
+    ratio_t x, y;
+    as_ratio(a, &x);
+    as_ratio(b, &y);
+    return add_ratios(vm, &x, &y, sign);
 }
 
 obj_t *num_add(VM *vm, obj_t *a, obj_t *b) {
-    if (a->denom == b->denom) {
-        // TODO: check for overflow
-        return mk_num_from_long(vm, a->numer + b->numer, a->denom);
+    if (is_fixnum(a) && is_fixnum(b)) {
+        return mk_integer(vm, fixnum_value(a) + fixnum_value(b));
     }
-    long denom = a->denom * b->denom;
-    long numer = a->numer * b->denom + b->numer * a->denom;
-    return mk_num_from_long(vm, numer, denom);
+    if (either_double(a, b)) {
+        return mk_double(vm, num_to_double(a) + num_to_double(b));
+    }
+    return add(vm, a, b, 1);
 }
 
 obj_t *num_sub(VM *vm, obj_t *a, obj_t *b) {
-    if (a->denom == b->denom) {
-        return mk_num_from_long(vm, a->numer - b->numer, a->denom);
+    if (is_fixnum(a) && is_fixnum(b)) {
+        return mk_integer(vm, fixnum_value(a) - fixnum_value(b));
+    }
+    if (either_double(a, b)) {
+        return mk_double(vm, num_to_double(a) - num_to_double(b));
     }
-    long denom = a->denom * b->denom;
-    long numer = a->numer * b->denom - b->numer * a->denom;
-    return mk_num_from_long(vm, numer, denom);
+    return add(vm, a, b, -1);
 }
 
 obj_t *num_mul(VM *vm, obj_t *a, obj_t *b) {
-    long denom = a->denom * b->denom;
-    long numer = a->numer * b->numer;
-    return mk_num_from_long(vm, numer, denom);
+    long numer, denom;
+    if (is_fixnum(a) && is_fixnum(b) &&
+        !__builtin_mul_overflow(fixnum_value(a), fixnum_value(b), &numer)) {
+        return mk_integer(vm, numer);
+    }
+    if (either_double(a, b)) {
+        return mk_double(vm, num_to_double(a) * num_to_double(b));
+    }
+    if (is_small(a) && is_small(b) &&
+        !__builtin_mul_overflow(num_numer(a), num_numer(b), &numer) &&
+        !__builtin_mul_overflow(num_denom(a), num_denom(b), &denom)) {
+        return mk_num_from_long(vm, numer, denom);
+    }
+
+    ratio_t x, y;
+    as_ratio(a, &x);
+    as_ratio(b, &y);
+    return mul_ratios(vm, &x, &y);
 }
 
+/* b must not be an exact zero. */
 obj_t *num_div(VM *vm, obj_t *a, obj_t *b) {
-    long denom = a->denom * b->numer;
-    long numer = a->numer * b->denom;
-    return mk_num_from_long(vm, numer, denom);
+    long numer, denom;
+    if (is_fixnum(a) && is_fixnum(b) && fixnum_value(b) &&
+        fixnum_value(a) % fixnum_value(b) == 0) {
+        return mk_integer(vm, fixnum_value(a) / fixnum_value(b));
+    }
+    if (either_double(a, b)) {
+        return mk_double(vm, num_to_double(a) / num_to_double(b));
+    }
+    if (is_small(a) && is_small(b) &&
+        !__builtin_mul_overflow(num_numer(a), num_denom(b), &numer) &&
+        !__builtin_mul_overflow(num_denom(a), num_numer(b), &denom)) {
+        return mk_num_from_long(vm, numer, denom);
+    }
+
+    /* multiplies by the reciprocal of b, with its sign on the numerator */
+    ratio_t x, y, inverse;
+    as_ratio(a, &x);
+    as_ratio(b, &y);
+    inverse.numer = y.denom;
+    inverse.numer.sign = y.numer.sign;
+    inverse.denom = y.numer;
+    inverse.denom.sign = 1;
+    return mul_ratios(vm, &x, &inverse);
 }
 
+/* Both must be integers, b not an exact zero. The remainder takes the
+ * sign of a. */
 obj_t *num_mod(VM *vm, obj_t *a, obj_t *b) {
-    long divisor = a->numer;
-    long modulus = b->numer;
-    return mk_num_from_long(vm, divisor % modulus, 1l);
+    if (is_fixnum(a) && is_fixnum(b)) {
+        return mk_integer(vm, fixnum_value(a) % fixnum_value(b));
+    }
+    if (either_double(a, b)) {
+        return mk_double(vm, fmod(num_to_double(a), num_to_double(b)));
+    }
+
+    ratio_t x, y;
+    as_ratio(a, &x);
+    as_ratio(b, &y);
+
+    big_t rem;
+    big_divmod(&x.numer, &y.numer, NULL, &rem);
+    return mk_bignum(vm, rem);
 }
 
+/*
+ * A fold of several numbers, left to right as by the operations above,
+ * keeps its running result in registers: as a double once any operand is
+ * inexact, and as a fraction of longs while it fits. Only the result is
+ * made an object, unless it outgrows longs, when the fold goes on a step
+ * at a time through the operations above and returns to registers should
+ * a step bring it back within longs.
+ */
+typedef struct {
+    int inexact;
+    double dbl;
+    long numer, denom; /* in lowest terms, with a positive denominator */
+    obj_t *object;     /* the result so far if neither of the above */
+} acc_t;
 
-obj_t *num_gt(VM *vm, obj_t *a, obj_t *b) {
-    long denom = a->denom * b->denom;
-    return (a->numer * denom > b->numer * denom) ? true : false;
+static void acc_load(acc_t *acc, obj_t *x) {
+    acc->inexact = is_double(x);
+    acc->object = NULL;
+    if (acc->inexact) {
+        acc->dbl = x->dbl;
+    } else if (is_small(x)) {
+        acc->numer = num_numer(x);
+        acc->denom = num_denom(x);
+    } else {
+        acc->object = x;
+    }
 }
 
-obj_t *num_gte(VM *vm, obj_t *a, obj_t *b) {
-    long denom = a->denom * b->denom;
-    return (a->numer * denom >= b->numer * denom) ? true : false;
+static double apply_inexact(fold_op op, double a, double b) {
+    switch (op) {
+    case FOLD_ADD:
+        return a + b;
+    case FOLD_SUB:
+        return a - b;
+    case FOLD_MUL:
+        return a * b;
+    default:
+        return a / b;
+    }
+}
+
+/* Applies 'op' to the fraction in 'acc' and bn/bd, or returns 0 if that
+ * would overflow. A LONG_MIN counts as an overflow, since reduce() can't
+ * take one. */
+static int apply_small(fold_op op, acc_t *acc, long bn, long bd) {
+    long an = acc->numer, ad = acc->denom, numer, denom;
+
+    switch (op) {
+    case FOLD_ADD:
+    case FOLD_SUB:
+        if (!small_add(an, ad, bn, bd, op == FOLD_ADD ? 1 : -1, &numer,
+                       &denom)) {
+            return 0;
+        }
+        break;
+    case FOLD_MUL:
+        if (__builtin_mul_overflow(an, bn, &numer) ||
+            __builtin_mul_overflow(ad, bd, &denom)) {
+            return 0;
+        }
+        break;
+    default:
+        if (__builtin_mul_overflow(an, bd, &numer) ||
+            __builtin_mul_overflow(ad, bn, &denom)) {
+            return 0;
+        }
+    }
+
+    if (numer == LONG_MIN || denom == LONG_MIN) {
+        return 0;
+    }
+    reduce(&numer, &denom);
+    acc->numer = numer;
+    acc->denom = denom;
+    return 1;
+}
+
+static obj_t *apply_exact(VM *vm, fold_op op, obj_t *a, obj_t *b) {
+    switch (op) {
+    case FOLD_ADD:
+        return num_add(vm, a, b);
+    case FOLD_SUB:
+        return num_sub(vm, a, b);
+    case FOLD_MUL:
+        return num_mul(vm, a, b);
+    default:
+        return num_div(vm, a, b);
+    }
+}
+
+/* argv[0] op argv[1] op ... for argc of at least one. Divisors must not be
+ * exact zeros. */
+obj_t *num_fold(VM *vm, fold_op op, int argc, obj_t **argv) {
+    int sp = vm->sp;
+    acc_t acc;
+    acc_load(&acc, argv[0]);
+
+    for (int i = 1; i < argc; i++) {
+        obj_t *x = argv[i];
+        if (!acc.inexact && is_double(x)) {
+            acc.dbl = acc.object ? num_to_double(acc.object)
+                                 : (double)acc.numer / acc.denom;
+            acc.inexact = 1;
+        }
+        if (acc.inexact) {
+            acc.dbl = apply_inexact(op, acc.dbl, num_to_double(x));
+            continue;
+        }
+        if (!acc.object && is_small(x) &&
+            apply_small(op, &acc, num_numer(x), num_denom(x))) {
+            continue;
+        }
+
+        /* keeping only the latest result on the stack */
+        obj_t *a = acc.object ? acc.object
+                              : mk_num_from_long(vm, acc.numer, acc.denom);
+        obj_t *result = apply_exact(vm, op, a, x);
+        popn(vm, vm->sp - sp);
+        push(vm, result);
+        acc_load(&acc, result);
+    }
+
+    if (acc.inexact) {
+        return mk_double(vm, acc.dbl);
+    }
+    if (acc.object) {
+        return acc.object;
+    }
+    return acc.denom == 1 ? mk_integer(vm, acc.numer)
+                          : mk_num_from_long(vm, acc.numer, acc.denom);
 }
 
-obj_t *num_lt(VM *vm, obj_t *a, obj_t *b) {
-    long denom = a->denom * b->denom;
-    return (a->numer * denom < b->numer * denom) ? true : false;
+/* what compare() returns when either number is a NaN */
+#define UNORDERED 2
+
+/* Returns -1, 0 or 1 as a is less than, equal to or greater than b.
+ * Denominators are positive, so fractions compare by cross products,
+ * which for longs can't overflow 128 bits. */
+static int compare(obj_t *a, obj_t *b) {
+    if (is_fixnum(a) && is_fixnum(b)) {
+        long x = fixnum_value(a), y = fixnum_value(b);
+        return (x > y) - (x < y);
+    }
+    if (either_double(a, b)) {
+        double x = num_to_double(a), y = num_to_double(b);
+        return isunordered(x, y) ? UNORDERED : (x > y) - (x < y);
+    }
+    if (is_small(a) && is_small(b)) {
+        __int128 x = (__int128)num_numer(a) * num_denom(b);
+        __int128 y = (__int128)num_numer(b) * num_denom(a);
+        return (x > y) - (x < y);
+    }
+
+    ratio_t x, y;
+    as_ratio(a, &x);
+    as_ratio(b, &y);
+    if (x.numer.sign != y.numer.sign || (is_whole(&x) && is_whole(&y))) {
+        return big_cmp(&x.numer, &y.numer);
+    }
+
+    big_t p = big_mul(&x.numer, &y.denom), q = big_mul(&y.numer, &x.denom);
+    int c = big_cmp(&p, &q);
+    big_free(&p);
+    big_free(&q);
+    return c;
 }
 
-obj_t *num_lte(VM *vm, obj_t *a, obj_t *b) {
-    long denom = a->denom * b->denom;
-    return (a->numer * denom <= b->numer * denom) ? true : false;
+/* Exact numbers are kept in their smallest form and lowest terms, so equal
+ * ones are of the same kind with equal parts. */
+static int equal(obj_t *a, obj_t *b) {
+    if (either_double(a, b)) {
+        return compare(a, b) == 0;
+    }
+    if (is_fixnum(a) || is_fixnum(b)) {
+        return a == b;
+    }
+    return is_eqv(a, b);
 }
 
 obj_t *num_eq(VM *vm, obj_t *a, obj_t *b) {
-    long denom = a->denom * b->denom;
-    return a->numer * denom == b->numer * denom ? true : false;
-}
\ No newline at end of file
+    return equal(a, b) ? true : false;
+}
+
+/* Whether each number in argv stands to the next in a relation 'accept'
+ * holds of, stopping at the first that doesn't. A result c of compare()
+ * is the bit 1 << (c + 1), which UNORDERED leaves out of every relation. */
+int num_ordered(int argc, obj_t **argv, int accept) {
+    for (int i = 0; i + 1 < argc; i++) {
+        int holds = accept == NUM_EQUAL
+                        ? equal(argv[i], argv[i + 1])
+                        : accept & 1 << (compare(argv[i], argv[i + 1]) + 1);
+        if (!holds) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+obj_t *num_inexact(VM *vm, obj_t *x) {
+    return is_double(x) ? x : mk_double(vm, num_to_double(x));
+}
+
+/* The exact value of a finite double, which is its 53-bit significand
+ * times a power of two. */
+obj_t *num_exact(VM *vm, obj_t *x) {
+    if (!is_double(x)) {
+        return x;
+    }
+    if (!isfinite(x->dbl)) {
+        raise(vm, "no exact number equals %g", x->dbl);
+    }
+
+    int exponent;
+    long significand = (long)ldexp(frexp(x->dbl, &exponent), 53);
+    exponent -= 53;
+
+    if (exponent < 0 && exponent > -63) {
+        return mk_num_from_long(vm, significand, 1L << -exponent);
+    }
+
+    big_t numer = big_from_long(significand);
+    big_t power = big_pow2(exponent < 0 ? -exponent : exponent);
+    if (exponent >= 0) {
+        big_t product = big_mul(&numer, &power);
+        big_free(&numer);
+        big_free(&power);
+        return mk_bignum(vm, product);
+    }
+    reduce_big(&numer, &power);
+    return mk_ratio(vm, numer, power);
+}
@@ -3,7 +3,8 @@
 
 #include "object.h"
 
-obj_t *reduce(VM *vm, obj_t *num_);
+void reduce(long *numer, long *denom);
+void reduce_big(big_t *numer, big_t *denom);
 
 obj_t *num_add(VM *vm, obj_t *a, obj_t *b);
 obj_t *num_sub(VM *vm, obj_t *a, obj_t *b);
@@ -11,11 +12,21 @@ obj_t *num_mul(VM *vm, obj_t *a, obj_t *b);
 obj_t *num_div(VM *vm, obj_t *a, obj_t *b);
 obj_t *num_mod(VM *vm, obj_t *a, obj_t *b);
 
-obj_t *num_gt(VM *vm, obj_t *a, obj_t *b);
-obj_t *num_gte(VM *vm, obj_t *a, obj_t *b);
-obj_t *num_lt(VM *vm, obj_t *a, obj_t *b);
-obj_t *num_lte(VM *vm, obj_t *a, obj_t *b);
+typedef enum { FOLD_ADD, FOLD_SUB, FOLD_MUL, FOLD_DIV } fold_op;
+
+obj_t *num_fold(VM *vm, fold_op op, int argc, obj_t **argv);
+
+/* the relations num_ordered() can test, which may be combined */
+#define NUM_LESS 1
+#define NUM_EQUAL 2
+#define NUM_GREATER 4
+
+int num_ordered(int argc, obj_t **argv, int accept);
 
 obj_t *num_eq(VM *vm, obj_t *a, obj_t *b);
 
+double num_to_double(obj_t *x);
+obj_t *num_exact(VM *vm, obj_t *x);
+obj_t *num_inexact(VM *vm, obj_t *x);
+
 #endif
\ No newline at end of file
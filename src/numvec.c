@@ -0,0 +1,482 @@
+#include "numvec.h"
+
+#include <math.h>
+
+#if (defined(__GNUC__) || defined(__clang__)) && defined(__x86_64__) &&        \
+    !defined(FIG_NO_SIMD)
+#define X86_KERNELS
+#include <immintrin.h>
+#endif
+
+#ifdef X86_KERNELS
+
+/* 2 with AVX2, 1 with only AVX and 0 with neither; SSE2 is always there */
+static int avx_level = -1;
+
+static int cpu_avx_level(void) {
+    if (avx_level < 0) {
+        __builtin_cpu_init();
+        avx_level = __builtin_cpu_supports("avx2")  ? 2
+                    : __builtin_cpu_supports("avx") ? 1
+                                                    : 0;
+    }
+    return avx_level;
+}
+
+/* The AVX kernels. Each finishes the elements left over from its lanes one
+ * at a time. */
+
+__attribute__((target("avx"))) static void
+f64_add_avx(double *dst, const double *a, const double *b, long n) {
+    long i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256d x = _mm256_loadu_pd(a + i), y = _mm256_loadu_pd(b + i);
+        _mm256_storeu_pd(dst + i, _mm256_add_pd(x, y));
+    }
+    for (; i < n; i++) {
+        dst[i] = a[i] + b[i];
+    }
+}
+
+__attribute__((target("avx"))) static void
+f64_mul_avx(double *dst, const double *a, const double *b, long n) {
+    long i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256d x = _mm256_loadu_pd(a + i), y = _mm256_loadu_pd(b + i);
+        _mm256_storeu_pd(dst + i, _mm256_mul_pd(x, y));
+    }
+    for (; i < n; i++) {
+        dst[i] = a[i] * b[i];
+    }
+}
+
+__attribute__((target("avx"))) static void
+f64_scale_avx(double *dst, const double *a, double k, long n) {
+    __m256d factor = _mm256_set1_pd(k);
+    long i = 0;
+    for (; i + 4 <= n; i += 4) {
+        _mm256_storeu_pd(dst + i, _mm256_mul_pd(_mm256_loadu_pd(a + i), factor));
+    }
+    for (; i < n; i++) {
+        dst[i] = a[i] * k;
+    }
+}
+
+__attribute__((target("avx"))) static void f64_fill_avx(double *dst, double x,
+                                                         long n) {
+    __m256d fill = _mm256_set1_pd(x);
+    long i = 0;
+    for (; i + 4 <= n; i += 4) {
+        _mm256_storeu_pd(dst + i, fill);
+    }
+    for (; i < n; i++) {
+        dst[i] = x;
+    }
+}
+
+__attribute__((target("avx"))) static double sum_lanes_avx(__m256d v) {
+    __m128d pair = _mm_add_pd(_mm256_castpd256_pd128(v),
+                              _mm256_extractf128_pd(v, 1));
+    return _mm_cvtsd_f64(_mm_add_sd(pair, _mm_unpackhi_pd(pair, pair)));
+}
+
+/* two sets of lanes, so that one addition needn't wait on the last */
+__attribute__((target("avx"))) static double
+f64_dot_avx(const double *a, const double *b, long n) {
+    __m256d s0 = _mm256_setzero_pd(), s1 = _mm256_setzero_pd();
+    long i = 0;
+    for (; i + 8 <= n; i += 8) {
+        s0 = _mm256_add_pd(s0, _mm256_mul_pd(_mm256_loadu_pd(a + i),
+                                             _mm256_loadu_pd(b + i)));
+        s1 = _mm256_add_pd(s1, _mm256_mul_pd(_mm256_loadu_pd(a + i + 4),
+                                             _mm256_loadu_pd(b + i + 4)));
+    }
+    double sum = sum_lanes_avx(_mm256_add_pd(s0, s1));
+    for (; i < n; i++) {
+        sum += a[i] * b[i];
+    }
+    return sum;
+}
+
+__attribute__((target("avx"))) static double f64_sum_avx(const double *a,
+                                                          long n) {
+    __m256d s0 = _mm256_setzero_pd(), s1 = _mm256_setzero_pd();
+    long i = 0;
+    for (; i + 8 <= n; i += 8) {
+        s0 = _mm256_add_pd(s0, _mm256_loadu_pd(a + i));
+        s1 = _mm256_add_pd(s1, _mm256_loadu_pd(a + i + 4));
+    }
+    double sum = sum_lanes_avx(_mm256_add_pd(s0, s1));
+    for (; i < n; i++) {
+        sum += a[i];
+    }
+    return sum;
+}
+
+/* The least element, or with 'greatest' the greatest. Unordered lanes are
+ * collected apart, as vminpd and vmaxpd let a NaN through only sometimes. */
+__attribute__((target("avx"))) static double
+f64_extreme_avx(const double *a, long n, int greatest) {
+    __m256d m = _mm256_set1_pd(a[0]), nans = _mm256_setzero_pd();
+    long i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256d x = _mm256_loadu_pd(a + i);
+        nans = _mm256_or_pd(nans, _mm256_cmp_pd(x, x, _CMP_UNORD_Q));
+        m = greatest ? _mm256_max_pd(m, x) : _mm256_min_pd(m, x);
+    }
+    if (_mm256_movemask_pd(nans)) {
+        return NAN;
+    }
+
+    double lanes[4];
+    _mm256_storeu_pd(lanes, m);
+    double result = lanes[0];
+    for (int j = 1; j < 4; j++) {
+        if (greatest ? lanes[j] > result : lanes[j] < result) {
+            result = lanes[j];
+        }
+    }
+    for (; i < n; i++) {
+        if (isnan(a[i])) {
+            return NAN;
+        }
+        if (greatest ? a[i] > result : a[i] < result) {
+            result = a[i];
+        }
+    }
+    return result;
+}
+
+/* Overflow is caught as in s64_add(), a lane at a time. */
+__attribute__((target("avx2"))) static int
+s64_add_avx2(int64_t *dst, const int64_t *a, const int64_t *b, long n) {
+    __m256i overflow = _mm256_setzero_si256();
+    long i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256i x = _mm256_loadu_si256((const __m256i *)(a + i));
+        __m256i y = _mm256_loadu_si256((const __m256i *)(b + i));
+        __m256i r = _mm256_add_epi64(x, y);
+        overflow = _mm256_or_si256(
+            overflow, _mm256_and_si256(_mm256_xor_si256(x, r),
+                                       _mm256_xor_si256(y, r)));
+        _mm256_storeu_si256((__m256i *)(dst + i), r);
+    }
+    int overflowed = _mm256_movemask_pd(_mm256_castsi256_pd(overflow));
+    return s64_add(dst + i, a + i, b + i, n - i) || overflowed;
+}
+
+/* The SSE2 kernels, which the AVX ones above follow. */
+
+static void f64_add_sse2(double *dst, const double *a, const double *b,
+                         long n) {
+    long i = 0;
+    for (; i + 2 <= n; i += 2) {
+        __m128d x = _mm_loadu_pd(a + i), y = _mm_loadu_pd(b + i);
+        _mm_storeu_pd(dst + i, _mm_add_pd(x, y));
+    }
+    for (; i < n; i++) {
+        dst[i] = a[i] + b[i];
+    }
+}
+
+static void f64_mul_sse2(double *dst, const double *a, const double *b,
+                         long n) {
+    long i = 0;
+    for (; i + 2 <= n; i += 2) {
+        __m128d x = _mm_loadu_pd(a + i), y = _mm_loadu_pd(b + i);
+        _mm_storeu_pd(dst + i, _mm_mul_pd(x, y));
+    }
+    for (; i < n; i++) {
+        dst[i] = a[i] * b[i];
+    }
+}
+
+static void f64_scale_sse2(double *dst, const double *a, double k, long n) {
+    __m128d factor = _mm_set1_pd(k);
+    long i = 0;
+    for (; i + 2 <= n; i += 2) {
+        _mm_storeu_pd(dst + i, _mm_mul_pd(_mm_loadu_pd(a + i), factor));
+    }
+    for (; i < n; i++) {
+        dst[i] = a[i] * k;
+    }
+}
+
+static void f64_fill_sse2(double *dst, double x, long n) {
+    __m128d fill = _mm_set1_pd(x);
+    long i = 0;
+    for (; i + 2 <= n; i += 2) {
+        _mm_storeu_pd(dst + i, fill);
+    }
+    for (; i < n; i++) {
+        dst[i] = x;
+    }
+}
+
+static double sum_lanes_sse2(__m128d v) {
+    return _mm_cvtsd_f64(_mm_add_sd(v, _mm_unpackhi_pd(v, v)));
+}
+
+static double f64_dot_sse2(const double *a, const double *b, long n) {
+    __m128d s0 = _mm_setzero_pd(), s1 = _mm_setzero_pd();
+    long i = 0;
+    for (; i + 4 <= n; i += 4) {
+        s0 = _mm_add_pd(s0, _mm_mul_pd(_mm_loadu_pd(a + i),
+                                       _mm_loadu_pd(b + i)));
+        s1 = _mm_add_pd(s1, _mm_mul_pd(_mm_loadu_pd(a + i + 2),
+                                       _mm_loadu_pd(b + i + 2)));
+    }
+    double sum = sum_lanes_sse2(_mm_add_pd(s0, s1));
+    for (; i < n; i++) {
+        sum += a[i] * b[i];
+    }
+    return sum;
+}
+
+static double f64_sum_sse2(const double *a, long n) {
+    __m128d s0 = _mm_setzero_pd(), s1 = _mm_setzero_pd();
+    long i = 0;
+    for (; i + 4 <= n; i += 4) {
+        s0 = _mm_add_pd(s0, _mm_loadu_pd(a + i));
+        s1 = _mm_add_pd(s1, _mm_loadu_pd(a + i + 2));
+    }
+    double sum = sum_lanes_sse2(_mm_add_pd(s0, s1));
+    for (; i < n; i++) {
+        sum += a[i];
+    }
+    return sum;
+}
+
+static double f64_extreme_sse2(const double *a, long n, int greatest) {
+    __m128d m = _mm_set1_pd(a[0]), nans = _mm_setzero_pd();
+    long i = 0;
+    for (; i + 2 <= n; i += 2) {
+        __m128d x = _mm_loadu_pd(a + i);
+        nans = _mm_or_pd(nans, _mm_cmpunord_pd(x, x));
+        m = greatest ? _mm_max_pd(m, x) : _mm_min_pd(m, x);
+    }
+    if (_mm_movemask_pd(nans)) {
+        return NAN;
+    }
+
+    double lanes[2];
+    _mm_storeu_pd(lanes, m);
+    double result =
+        greatest ? (lanes[1] > lanes[0] ? lanes[1] : lanes[0])
+                 : (lanes[1] < lanes[0] ? lanes[1] : lanes[0]);
+    for (; i < n; i++) {
+        if (isnan(a[i])) {
+            return NAN;
+        }
+        if (greatest ? a[i] > result : a[i] < result) {
+            result = a[i];
+        }
+    }
+    return result;
+}
+
+static int s64_add_sse2(int64_t *dst, const int64_t *a, const int64_t *b,
+                        long n) {
+    __m128i overflow = _mm_setzero_si128();
+    long i = 0;
+    for (; i + 2 <= n; i += 2) {
+        __m128i x = _mm_loadu_si128((const __m128i *)(a + i));
+        __m128i y = _mm_loadu_si128((const __m128i *)(b + i));
+        __m128i r = _mm_add_epi64(x, y);
+        overflow = _mm_or_si128(
+            overflow, _mm_and_si128(_mm_xor_si128(x, r), _mm_xor_si128(y, r)));
+        _mm_storeu_si128((__m128i *)(dst + i), r);
+    }
+    int overflowed = _mm_movemask_pd(_mm_castsi128_pd(overflow));
+    return s64_add(dst + i, a + i, b + i, n - i) || overflowed;
+}
+
+#endif
+
+/* doubles ----------------------------------------------------------------- */
+
+void f64_add(double *dst, const double *a, const double *b, long n) {
+#ifdef X86_KERNELS
+    if (cpu_avx_level() >= 1) {
+        f64_add_avx(dst, a, b, n);
+    } else {
+        f64_add_sse2(dst, a, b, n);
+    }
+#else
+    for (long i = 0; i < n; i++) {
+        dst[i] = a[i] + b[i];
+    }
+#endif
+}
+
+void f64_mul(double *dst, const double *a, const double *b, long n) {
+#ifdef X86_KERNELS
+    if (cpu_avx_level() >= 1) {
+        f64_mul_avx(dst, a, b, n);
+    } else {
+        f64_mul_sse2(dst, a, b, n);
+    }
+#else
+    for (long i = 0; i < n; i++) {
+        dst[i] = a[i] * b[i];
+    }
+#endif
+}
+
+void f64_scale(double *dst, const double *a, double k, long n) {
+#ifdef X86_KERNELS
+    if (cpu_avx_level() >= 1) {
+        f64_scale_avx(dst, a, k, n);
+    } else {
+        f64_scale_sse2(dst, a, k, n);
+    }
+#else
+    for (long i = 0; i < n; i++) {
+        dst[i] = a[i] * k;
+    }
+#endif
+}
+
+void f64_fill(double *dst, double x, long n) {
+#ifdef X86_KERNELS
+    if (cpu_avx_level() >= 1) {
+        f64_fill_avx(dst, x, n);
+    } else {
+        f64_fill_sse2(dst, x, n);
+    }
+#else
+    for (long i = 0; i < n; i++) {
+        dst[i] = x;
+    }
+#endif
+}
+
+double f64_dot(const double *a, const double *b, long n) {
+#ifdef X86_KERNELS
+    return cpu_avx_level() >= 1 ? f64_dot_avx(a, b, n) : f64_dot_sse2(a, b, n);
+#else
+    double sum = 0;
+    for (long i = 0; i < n; i++) {
+        sum += a[i] * b[i];
+    }
+    return sum;
+#endif
+}
+
+double f64_sum(const double *a, long n) {
+#ifdef X86_KERNELS
+    return cpu_avx_level() >= 1 ? f64_sum_avx(a, n) : f64_sum_sse2(a, n);
+#else
+    double sum = 0;
+    for (long i = 0; i < n; i++) {
+        sum += a[i];
+    }
+    return sum;
+#endif
+}
+
+static double f64_extreme(const double *a, long n, int greatest) {
+#ifdef X86_KERNELS
+    return cpu_avx_level() >= 1 ? f64_extreme_avx(a, n, greatest)
+                                : f64_extreme_sse2(a, n, greatest);
+#else
+    double result = a[0];
+    for (long i = 0; i < n; i++) {
+        if (isnan(a[i])) {
+            return NAN;
+        }
+        if (greatest ? a[i] > result : a[i] < result) {
+            result = a[i];
+        }
+    }
+    return result;
+#endif
+}
+
+double f64_min(const double *a, long n) { return f64_extreme(a, n, 0); }
+double f64_max(const double *a, long n) { return f64_extreme(a, n, 1); }
+
+/* integers ---------------------------------------------------------------- */
+
+/* The sum wraps, and has overflowed where it differs in sign from both
+ * addends, which leaves the sign bit set in (x ^ r) & (y ^ r). */
+int s64_add(int64_t *dst, const int64_t *a, const int64_t *b, long n) {
+#ifdef X86_KERNELS
+    if (n >= 4) {
+        return cpu_avx_level() >= 2 ? s64_add_avx2(dst, a, b, n)
+                                    : s64_add_sse2(dst, a, b, n);
+    }
+#endif
+    uint64_t overflow = 0;
+    for (long i = 0; i < n; i++) {
+        uint64_t x = a[i], y = b[i], r = x + y;
+        overflow |= (x ^ r) & (y ^ r);
+        dst[i] = (int64_t)r;
+    }
+    return overflow >> 63;
+}
+
+/* There is no multiplication of 64-bit lanes before AVX-512, so these
+ * take an element at a time. */
+int s64_mul(int64_t *dst, const int64_t *a, const int64_t *b, long n) {
+    int overflow = 0;
+    for (long i = 0; i < n; i++) {
+        overflow |= __builtin_mul_overflow(a[i], b[i], &dst[i]);
+    }
+    return overflow;
+}
+
+int s64_scale(int64_t *dst, const int64_t *a, int64_t k, long n) {
+    int overflow = 0;
+    for (long i = 0; i < n; i++) {
+        overflow |= __builtin_mul_overflow(a[i], k, &dst[i]);
+    }
+    return overflow;
+}
+
+void s64_fill(int64_t *dst, int64_t x, long n) {
+    for (long i = 0; i < n; i++) {
+        dst[i] = x;
+    }
+}
+
+/* Products fit in 128 bits, but their sum can overflow it. */
+int s64_dot(const int64_t *a, const int64_t *b, long n, __int128 *result) {
+    __int128 sum = 0;
+    for (long i = 0; i < n; i++) {
+        if (__builtin_add_overflow(sum, (__int128)a[i] * b[i], &sum)) {
+            return 1;
+        }
+    }
+    *result = sum;
+    return 0;
+}
+
+/* can't overflow short of 2^64 elements */
+__int128 s64_sum(const int64_t *a, long n) {
+    __int128 sum = 0;
+    for (long i = 0; i < n; i++) {
+        sum += a[i];
+    }
+    return sum;
+}
+
+int64_t s64_min(const int64_t *a, long n) {
+    int64_t result = a[0];
+    for (long i = 1; i < n; i++) {
+        if (a[i] < result) {
+            result = a[i];
+        }
+    }
+    return result;
+}
+
+int64_t s64_max(const int64_t *a, long n) {
+    int64_t result = a[0];
+    for (long i = 1; i < n; i++) {
+        if (a[i] > result) {
+            result = a[i];
+        }
+    }
+    return result;
+}
@@ -0,0 +1,38 @@
+#ifndef NUMVEC_H
+#define NUMVEC_H
+
+#include <stdint.h>
+
+/*
+ * Kernels over the unboxed storage of f64vectors and s64vectors. On x86-64
+ * the double kernels run four lanes at a time with AVX where the processor
+ * has it and two with SSE2 otherwise, as does adding integers with AVX2
+ * or SSE2; everywhere else, or when built with FIG_NO_SIMD, they are plain
+ * loops. Sums and dot products of doubles are added up in an order that
+ * depends on the kernel, so they can differ in the last bits between
+ * machines.
+ *
+ * The destination of an element-wise kernel may be one of its sources.
+ * The integer kernels return nonzero if a result overflowed 64 bits, having
+ * already written whatever they got to.
+ */
+void f64_add(double *dst, const double *a, const double *b, long n);
+void f64_mul(double *dst, const double *a, const double *b, long n);
+void f64_scale(double *dst, const double *a, double k, long n);
+void f64_fill(double *dst, double x, long n);
+double f64_dot(const double *a, const double *b, long n);
+double f64_sum(const double *a, long n);
+/* NaN if any element is, and undefined for no elements */
+double f64_min(const double *a, long n);
+double f64_max(const double *a, long n);
+
+int s64_add(int64_t *dst, const int64_t *a, const int64_t *b, long n);
+int s64_mul(int64_t *dst, const int64_t *a, const int64_t *b, long n);
+int s64_scale(int64_t *dst, const int64_t *a, int64_t k, long n);
+void s64_fill(int64_t *dst, int64_t x, long n);
+int s64_dot(const int64_t *a, const int64_t *b, long n, __int128 *result);
+__int128 s64_sum(const int64_t *a, long n);
+int64_t s64_min(const int64_t *a, long n);
+int64_t s64_max(const int64_t *a, long n);
+
+#endif
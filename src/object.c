@@ -1,25 +1,69 @@
 #include "common.h"
+#include "compile.h"
 #include "numbers.h"
 #include "object.h"
 
+#include <inttypes.h>
 #include <math.h>
 #include <stdarg.h>
+#include <stddef.h>
+
+/* The end of 'field' in obj_t: an object is allocated only as far as the
+ * last field of its own member of the union. */
+#define LAYOUT(field) (offsetof(obj_t, field) + sizeof(((obj_t *)0)->field))
+
+static const size_t object_sizes[] = {
+    [OBJ_NUM] = LAYOUT(denom),
+    [OBJ_BIG] = LAYOUT(big),
+    [OBJ_RATIO] = LAYOUT(rdenom),
+    [OBJ_DOUBLE] = LAYOUT(dbl),
+    [OBJ_SYM] = LAYOUT(hash),
+    [OBJ_STR] = LAYOUT(base),
+    [OBJ_BUILDER] = LAYOUT(capacity),
+    [OBJ_PAIR] = LAYOUT(cdr),
+    [OBJ_VEC] = LAYOUT(size),
+    [OBJ_F64VEC] = LAYOUT(count),
+    [OBJ_S64VEC] = LAYOUT(count),
+    [OBJ_BOOL] = offsetof(obj_t, str),
+    [OBJ_CHAR] = offsetof(obj_t, str),
+    [OBJ_BUILTIN] = LAYOUT(list_proc),
+    [OBJ_FUN] = LAYOUT(code),
+    [OBJ_CODE] = LAYOUT(bytecode),
+    [OBJ_FRAME] = LAYOUT(nslots),
+    [OBJ_MACRO] = LAYOUT(uses),
+    [OBJ_NIL] = offsetof(obj_t, str),
+    [OBJ_ERR] = LAYOUT(err),
+};
+
+#define ERROR_ROOM 256
 
 obj_t *obj_new(VM *vm, object_type type) {
-    obj_t *object = malloc(sizeof(obj_t));
+    if (vm->obj_count >= vm->gc_threshold) {
+        if (gc_step(vm)) {
+            if (vm->obj_count >= vm->heap_max) {
+                /* leaves room to make the error */
+                vm->gc_threshold = vm->obj_count + ERROR_ROOM;
+                raise(vm, "heap exhausted: %d live objects", vm->obj_count);
+            }
+            vm->gc_threshold = vm->obj_count * vm->heap_growth;
+            if (vm->gc_threshold > vm->heap_max) {
+                vm->gc_threshold = vm->heap_max;
+            }
+        }
+    } else if (vm->young >= NURSERY_SIZE) {
+        gc_minor(vm);
+    }
 
+    obj_t *object = heap_alloc(&vm->heap, object_sizes[type]);
     object->type = type;
-    object->marked = 0;
 
-    if (vm->obj_count >= vm->gc_threshold) {
-        gc(vm);
-        vm->gc_threshold = vm->obj_count * 2;
+    /* an object made while marking is in progress must survive it */
+    if (vm->gc_phase == GC_MARKING) {
+        grey(vm, object);
     }
 
-    object->next = vm->alloc_list;
-    vm->alloc_list = object;
-
     vm->obj_count++;
+    vm->young++;
 
     return object;
 }
@@ -48,66 +92,247 @@ obj_t *mk_vec(VM *vm, obj_t **objects, int size) {
     return vec;
 }
 
-obj_t *mk_num_from_str(VM *vm, char *str, int is_decimal, int is_fractional) {
-    obj_t *num = obj_new(vm, OBJ_NUM);
+/* Makes an f64vector or s64vector of 'count' zeros. */
+obj_t *mk_numvec(VM *vm, object_type type, long count) {
+    obj_t *vec = obj_new(vm, type);
+    vec->f64 = calloc(count ? count : 1, sizeof(double));
+    vec->count = count;
+
+    push(vm, vec);
+    return vec;
+}
 
+/* Reads the literal at 'str', a decimal as the nearest double and any
+ * other number exactly. Literals too long for longs are read as bignums. */
+obj_t *mk_num_from_str(VM *vm, char *str, int is_decimal, int is_fractional) {
     if (is_decimal) {
-        strtok(str, ".");
-        char *f = strtok(NULL, ".");
+        return mk_double(vm, strtod(str, NULL));
+    }
 
-        long denom = (long) pow(10.0, (double) strlen(f));
+    int negative = *str == '-';
+    char *whole = str + negative;
+    int nwhole = strspn(whole, "0123456789");
+    char *part = whole + nwhole + is_fractional;
+    int npart = is_fractional ? strspn(part, "0123456789") : 0;
 
-        num->numer = (long) (strtod(str, NULL) * denom) + strtol(f, NULL, 10);
-        num->denom = denom;
+    if (nwhole <= 18 && npart <= 18) {
+        long numer = 0, denom = 0;
+        for (int i = 0; i < nwhole; i++) {
+            numer = numer * 10 + (whole[i] - '0');
+        }
+        for (int i = 0; i < npart; i++) {
+            denom = denom * 10 + (part[i] - '0');
+        }
+        return mk_num_from_long(vm, negative ? -numer : numer,
+                                is_fractional ? denom : 1);
     }
-    else if (is_fractional) {
-        char *numer = strtok(str, "/");
-        char *denom = strtok(NULL, "/");
 
-        num->numer = strtol(numer, NULL, 10);
-        num->denom = strtol(denom, NULL, 10);
-    }
-    else {
-        num->numer = strtol(str, NULL, 10);
-        num->denom = 1l;
+    big_t numer = big_from_digits(whole, nwhole);
+    big_t denom = is_fractional ? big_from_digits(part, npart)
+                                : big_from_long(1);
+    if (negative && numer.len) {
+        numer.sign = -1;
     }
 
-    num = reduce(vm, num);
-    push(vm, num);
-
-    return num;
+    if (big_is_zero(&denom)) {
+        big_free(&numer);
+        big_free(&denom);
+        raise(vm, "division by zero");
+    }
+    reduce_big(&numer, &denom);
+    return mk_ratio(vm, numer, denom);
 }
 
+/* Integers that fit are fixnums; only other numbers are allocated. */
 obj_t *mk_num_from_long(VM *vm, long numer, long denom) {
     if (denom == 0) {
         raise(vm, "division by zero");
     }
 
-    obj_t *num = obj_new(vm, OBJ_NUM);
+    /* whose sign can't be flipped in a long */
+    if (numer == LONG_MIN || denom == LONG_MIN) {
+        big_t n = big_from_long(numer), d = big_from_long(denom);
+        reduce_big(&n, &d);
+        return mk_ratio(vm, n, d);
+    }
+
+    reduce(&numer, &denom);
+    if (denom == 1) {
+        return mk_integer(vm, numer);
+    }
 
+    obj_t *num = obj_new(vm, OBJ_NUM);
     num->numer = numer;
     num->denom = denom;
 
-    num = reduce(vm, num);
+    push(vm, num);
+    return num;
+}
 
+obj_t *mk_integer(VM *vm, long n) {
+    if (!fits_fixnum(n)) {
+        return mk_bignum(vm, big_from_long(n));
+    }
+
+    obj_t *num = mk_fixnum(n);
     push(vm, num);
     return num;
 }
 
-char *num_to_string(obj_t *num) {
-    char *buf = malloc(sizeof(char) * MAX_STRING_LENGTH);
-    if (num->denom == 1) {
-        snprintf(buf, MAX_STRING_LENGTH - 1, "%li", num->numer);
+/* Takes over 'n', making a fixnum of it if it fits. */
+obj_t *mk_bignum(VM *vm, big_t n) {
+    long value;
+    if (big_to_long(&n, &value) && fits_fixnum(value)) {
+        big_free(&n);
+        return mk_integer(vm, value);
+    }
+
+    obj_t *num = obj_new(vm, OBJ_BIG);
+    num->big = n;
+
+    push(vm, num);
+    return num;
+}
+
+/* Takes over a fraction already in lowest terms with a positive
+ * denominator, making the smallest kind of number equal to it. */
+obj_t *mk_ratio(VM *vm, big_t numer, big_t denom) {
+    if (big_is_one(&denom)) {
+        big_free(&denom);
+        return mk_bignum(vm, numer);
+    }
+
+    obj_t *num;
+    long n, d;
+    if (big_to_long(&numer, &n) && big_to_long(&denom, &d)) {
+        big_free(&numer);
+        big_free(&denom);
+        num = obj_new(vm, OBJ_NUM);
+        num->numer = n;
+        num->denom = d;
     } else {
-        snprintf(buf, MAX_STRING_LENGTH - 1, "%li/%li", num->numer, num->denom);
+        num = obj_new(vm, OBJ_RATIO);
+        num->rnumer = numer;
+        num->rdenom = denom;
+    }
+
+    push(vm, num);
+    return num;
+}
+
+obj_t *mk_double(VM *vm, double d) {
+    obj_t *num = obj_new(vm, OBJ_DOUBLE);
+    num->dbl = d;
+
+    push(vm, num);
+    return num;
+}
+
+/* Writes the fewest digits that read back as 'd', with a point or an
+ * exponent so that they read back inexact. Magnitudes from 1e-7 up to
+ * 1e21 are written out in full, and others with an exponent. */
+static void format_double(char *buf, int size, double d) {
+    if (isnan(d)) {
+        snprintf(buf, size, "+nan.0");
+        return;
+    }
+    if (isinf(d)) {
+        snprintf(buf, size, d > 0 ? "+inf.0" : "-inf.0");
+        return;
+    }
+
+    /* as d.ddde[+-]xx */
+    char sci[32];
+    for (int precision = 1; precision <= 17; precision++) {
+        snprintf(sci, sizeof(sci), "%.*e", precision - 1, d);
+        if (strtod(sci, NULL) == d) {
+            break;
+        }
+    }
+
+    char digits[20], *p = sci;
+    int n = 0;
+    if (*p == '-') {
+        *buf++ = '-';
+        p++;
+    }
+    for (; *p != 'e'; p++) {
+        if (*p != '.') {
+            digits[n++] = *p;
+        }
+    }
+    int exponent = atoi(p + 1);
+
+    if (exponent < -7 || exponent >= 21) {
+        snprintf(buf, size - 1, "%c%s%.*se%d", digits[0], n > 1 ? "." : "",
+                 n - 1, digits + 1, exponent);
+        return;
+    }
+
+    /* the digits with the point moved 'exponent' places, padded with
+     * zeros on either side */
+    int point = exponent + 1;
+    if (point <= 0) {
+        *buf++ = '0';
+        *buf++ = '.';
+        for (int i = point; i < 0; i++) {
+            *buf++ = '0';
+        }
+        point = 0;
+    }
+    for (int i = 0; i < n || i < point; i++) {
+        if (i == point && point > 0) {
+            *buf++ = '.';
+        }
+        *buf++ = i < n ? digits[i] : '0';
+    }
+    if (n <= point) {
+        *buf++ = '.';
+        *buf++ = '0';
+    }
+    *buf = '\0';
+}
+
+char *num_to_string(obj_t *num) {
+    char *buf, *numer, *denom;
+
+    switch (obj_type(num)) {
+    case OBJ_DOUBLE:
+        buf = malloc(sizeof(char) * MAX_STRING_LENGTH);
+        format_double(buf, MAX_STRING_LENGTH, num->dbl);
+        return buf;
+    case OBJ_BIG:
+        return big_to_string(&num->big);
+    case OBJ_RATIO:
+        numer = big_to_string(&num->rnumer);
+        denom = big_to_string(&num->rdenom);
+        buf = malloc(strlen(numer) + strlen(denom) + 2);
+        sprintf(buf, "%s/%s", numer, denom);
+        free(numer);
+        free(denom);
+        return buf;
+    default:
+        buf = malloc(sizeof(char) * MAX_STRING_LENGTH);
+        if (num_denom(num) == 1) {
+            snprintf(buf, MAX_STRING_LENGTH - 1, "%li", num_numer(num));
+        } else {
+            snprintf(buf, MAX_STRING_LENGTH - 1, "%li/%li", num_numer(num),
+                     num_denom(num));
+        }
+        return buf;
     }
-    return buf;
 }
 
 obj_t *mk_sym(VM *vm, char *name) {
     obj_t *object;
+    unsigned hash = table_hash(name);
 
-    if ((object = table_get(symbol_table, name))) {
+    if ((object = table_get(symbol_table, name, hash))) {
+        /* the table doesn't keep it alive, so a collection under way
+         * must be told it was found */
+        if (vm->gc_phase == GC_MARKING) {
+            grey(vm, object);
+        }
         push(vm, object);
         return object;
     }
@@ -115,21 +340,109 @@ obj_t *mk_sym(VM *vm, char *name) {
     object = obj_new(vm, OBJ_SYM);
     object->sym = malloc(sizeof(char) * (strlen(name) + 1));
     strcpy(object->sym, name);
+    object->value = NULL;
+    object->bound = 0;
+    object->hash = hash;
 
-    table_put(symbol_table, object->sym, object);
+    table_put(symbol_table, object);
 
     push(vm, object);
     return object;
 }
 
+/* A fresh symbol that is not in the symbol table, so no name read or
+ * written by the user can refer to it. */
+obj_t *mk_gensym(VM *vm, char *prefix) {
+    static int counter = 0;
+    char buf[MAX_STRING_LENGTH];
+    snprintf(buf, sizeof(buf), "%s%d", prefix, ++counter);
+
+    obj_t *object = obj_new(vm, OBJ_SYM);
+    object->sym = malloc(sizeof(char) * (strlen(buf) + 1));
+    strcpy(object->sym, buf);
+    object->value = NULL;
+    object->bound = 0;
+
+    push(vm, object);
+    return object;
+}
+
+/* A symbol that is not in the symbol table and names the global binding of
+ * 'symbol', whatever binds that name where the alias appears. It is kept
+ * unbound, with 'symbol' in its value. */
+obj_t *mk_alias(VM *vm, obj_t *symbol) {
+    obj_t *object = obj_new(vm, OBJ_SYM);
+    object->sym = strdup(symbol->sym);
+    object->hash = symbol->hash;
+    object->value = symbol;
+    object->bound = 0;
+
+    push(vm, object);
+    return object;
+}
+
+/* The symbol whose global binding 'symbol' refers to. */
+obj_t *unalias(obj_t *symbol) {
+    if (!symbol->bound && symbol->value && is_symbol(symbol->value)) {
+        return symbol->value;
+    }
+    return symbol;
+}
+
 obj_t *mk_string(VM *vm, char *str) {
+    return mk_string_len(vm, str, strlen(str));
+}
+
+obj_t *mk_string_len(VM *vm, char *bytes, int len) {
+    obj_t *object = obj_new(vm, OBJ_STR);
+    object->str = malloc(sizeof(char) * (len + 1));
+    memcpy(object->str, bytes, len);
+    object->str[len] = '\0';
+    object->len = len;
+    object->capacity = len + 1;
+    object->base = NULL;
+    push(vm, object);
+    return object;
+}
+
+/* Strings never change, so the characters of 'string' from 'start' on
+ * can be shared rather than copied. */
+obj_t *mk_string_view(VM *vm, obj_t *string, int start) {
     obj_t *object = obj_new(vm, OBJ_STR);
-    object->str = malloc(sizeof(char) * (strlen(str) + 1));
-    strcpy(object->str, str);
+    object->str = string->str + start;
+    object->len = string->len - start;
+    object->capacity = 0;
+    object->base = string->base ? string->base : string;
     push(vm, object);
     return object;
 }
 
+#define INITIAL_BUILDER_CAPACITY 32
+
+obj_t *mk_builder(VM *vm) {
+    obj_t *object = obj_new(vm, OBJ_BUILDER);
+    object->str = malloc(sizeof(char) * INITIAL_BUILDER_CAPACITY);
+    object->str[0] = '\0';
+    object->len = 0;
+    object->capacity = INITIAL_BUILDER_CAPACITY;
+    push(vm, object);
+    return object;
+}
+
+/* Appends by doubling the builder's storage as needed, so building a
+ * string of n characters copies O(n) of them in all. */
+void builder_append(obj_t *builder, char *bytes, int len) {
+    if (builder->len + len + 1 > builder->capacity) {
+        while (builder->len + len + 1 > builder->capacity) {
+            builder->capacity *= 2;
+        }
+        builder->str = realloc(builder->str, builder->capacity);
+    }
+    memcpy(builder->str + builder->len, bytes, len);
+    builder->len += len;
+    builder->str[builder->len] = '\0';
+}
+
 obj_t *mk_builtin(VM *vm, char *bname, builtin proc) {
     obj_t *object = obj_new(vm, OBJ_BUILTIN);
 
@@ -137,11 +450,27 @@ obj_t *mk_builtin(VM *vm, char *bname, builtin proc) {
     strcpy(object->bname, bname);
 
     object->proc = proc;
+    object->list_proc = NULL;
 
     push(vm, object);
     return object;
 }
 
+static obj_t *list_builtin_shim(VM *vm, int argc, obj_t **argv) {
+    obj_t *self = argv[-1];
+    obj_t *args = the_empty_list;
+    for (int i = argc - 1; i >= 0; i--) {
+        args = mk_cons(vm, argv[i], args);
+    }
+    return self->list_proc(vm, args);
+}
+
+obj_t *mk_list_builtin(VM *vm, char *bname, list_builtin proc) {
+    obj_t *object = mk_builtin(vm, bname, list_builtin_shim);
+    object->list_proc = proc;
+    return object;
+}
+
 obj_t *mk_fun(VM *vm, obj_t *env, obj_t *params, obj_t *body) {
     obj_t *object = obj_new(vm, OBJ_FUN);
 
@@ -150,27 +479,63 @@ obj_t *mk_fun(VM *vm, obj_t *env, obj_t *params, obj_t *body) {
     object->body = body;
     object->variadic = is_list(object->params) ? 0 : 1;
     object->fname = NULL;
+    object->code = NULL;
+
+    push(vm, object);
+    return object;
+}
+
+obj_t *mk_code(VM *vm) {
+    obj_t *object = obj_new(vm, OBJ_CODE);
+
+    code_t *code = malloc(sizeof(code_t));
+    code->name = NULL;
+    code->params = the_empty_list;
+    code->body = the_empty_list;
+    code->names = the_empty_list;
+    code->nparams = 0;
+    code->rest = 0;
+    code->nlocals = 0;
+    code->instrs = NULL;
+    code->count = 0;
+    code->capacity = 0;
+    code->consts = NULL;
+    code->nconsts = 0;
+    code->consts_capacity = 0;
+    code->ics = NULL;
+    code->nics = 0;
+    code->native = NULL;
+
+    object->bytecode = code;
 
     push(vm, object);
     return object;
 }
 
+obj_t *mk_macro(VM *vm, obj_t *name, obj_t *literals, obj_t *rules) {
+    obj_t *object = obj_new(vm, OBJ_MACRO);
+    object->mname = name;
+    object->literals = literals;
+    object->rules = rules;
+    object->uses = 0;
+    push(vm, object);
+    return object;
+}
+
 obj_t *mk_char(VM *vm, char c) {
-    obj_t *object = obj_new(vm, OBJ_CHAR);
-    object->character = c;
+    obj_t *object = (obj_t *)(((uintptr_t)(unsigned char)c << 3) | CHAR_TAG);
     push(vm, object);
     return object;
 }
 
 obj_t *mk_bool(VM *vm, int value) {
-    obj_t *object = obj_new(vm, OBJ_BOOL);
-    object->boolean = value;
+    obj_t *object = value ? IMM_TRUE : IMM_FALSE;
     push(vm, object);
     return object;
 }
 
 obj_t *mk_nil(VM *vm) {
-    obj_t *object = obj_new(vm, OBJ_NIL);
+    obj_t *object = IMM_NIL;
     push(vm, object);
     return object;
 }
@@ -185,126 +550,196 @@ obj_t *mk_err(VM *vm, char *msg) {
     return object;
 }
 
+obj_t *mk_frame(VM *vm, obj_t *parent, obj_t *names, int nslots) {
+    obj_t *frame = obj_new(vm, OBJ_FRAME);
+
+    frame->parent = parent;
+    frame->names = names;
+    frame->nslots = nslots;
+    frame->slots = nslots ? malloc(sizeof(obj_t *) * nslots) : NULL;
+
+    for (int i = 0; i < nslots; i++) {
+        frame->slots[i] = IMM_UNASSIGNED;
+    }
+
+    push(vm, frame);
+    return frame;
+}
+
 obj_t *mk_env(VM *vm) {
-    obj_t *frame = mk_cons(vm, the_empty_list, the_empty_list);
-    obj_t *env = mk_cons(vm, frame, the_empty_list);
-    return env;
+    return mk_frame(vm, the_empty_list, the_empty_list, 0);
 }
 
-void add_binding_to_frame(VM *vm, obj_t *frame, obj_t *symbol, obj_t *object) {
-    set_car(frame, mk_cons(vm, symbol, car(frame)));
-    set_cdr(frame, mk_cons(vm, object, cdr(frame)));
+static int frame_slot(obj_t *frame, obj_t *symbol) {
+    int slot = 0;
+    for (obj_t *names = frame->names; !is_the_empty_list(names);
+         names = cdr(names)) {
+        if (car(names) == symbol) {
+            return slot;
+        }
+        slot++;
+    }
+    return -1;
 }
 
-obj_t *env_define(VM *vm, obj_t *env, obj_t *symbol, obj_t *value) {
-    if (is_fun(value)) {
-        value->fname = symbol;
+/* The names list may be shared with a code object, so growing a frame
+ * copies it rather than appending in place. */
+static void add_binding_to_frame(VM *vm, obj_t *frame, obj_t *symbol,
+                                 obj_t *object) {
+    int n = frame->nslots;
+
+    obj_t *names = mk_cons(vm, symbol, the_empty_list);
+    for (int i = n - 1; i >= 0; i--) {
+        names = mk_cons(vm, list_ref(frame->names, i), names);
     }
 
-    obj_t *frame;
-    obj_t *symbols;
-    obj_t *values;
+    frame->slots = realloc(frame->slots, sizeof(obj_t *) * (n + 1));
+    frame->slots[n] = object;
+    frame->names = names;
+    frame->nslots = n + 1;
+    write_barrier(vm, frame, object);
+    write_barrier(vm, frame, names);
+}
 
-    frame = car(env);
-    symbols = car(frame);
-    values = cdr(frame);
+void frame_store(VM *vm, obj_t *frame, int slot, obj_t *value) {
+    frame->slots[slot] = value;
+    write_barrier(vm, frame, value);
+}
 
-    /* for variadic definitions */
-    if (!is_list(symbols)) {
-        add_binding_to_frame(vm, frame, symbol, value);
-        return NULL;
+/* The outermost frame binds nothing itself: top-level bindings live in
+ * the value cell of each symbol. */
+static int is_global_env(obj_t *env) {
+    return is_the_empty_list(env->parent);
+}
+
+obj_t *env_define(VM *vm, obj_t *env, obj_t *symbol, obj_t *value) {
+    if (value && is_fun(value)) {
+        value->fname = symbol;
+        write_barrier(vm, value, symbol);
     }
 
-    while (!is_the_empty_list(symbols)) {
-        if (car(symbols) == symbol) {
-            set_car(values, value);
-            return NULL;
+    if (is_global_env(env)) {
+        symbol = unalias(symbol);
+        if (symbol->bound && is_procedure(symbol->value)) {
+            vm->epoch++;
         }
-        symbols = cdr(symbols);
-        values = cdr(values);
+        symbol->value = value;
+        symbol->bound = 1;
+        write_barrier(vm, symbol, value);
+        return NULL;
     }
 
-    add_binding_to_frame(vm, frame, symbol, value);
+    int slot = frame_slot(env, symbol);
+    if (slot >= 0) {
+        frame_store(vm, env, slot, value);
+    } else {
+        add_binding_to_frame(vm, env, symbol, value);
+    }
 
     return NULL;
 }
 
 obj_t *env_set(VM *vm, obj_t *env, obj_t *symbol, obj_t *value) {
-    if (is_fun(value)) {
+    if (value && is_fun(value)) {
         value->fname = symbol;
+        write_barrier(vm, value, symbol);
+    }
+
+    while (!is_global_env(env)) {
+        int slot = frame_slot(env, symbol);
+        if (slot >= 0) {
+            frame_store(vm, env, slot, value);
+            return NULL;
+        }
+        env = env->parent;
     }
 
-    obj_t *frame;
-    obj_t *symbols;
-    obj_t *values;
+    symbol = unalias(symbol);
+    if (!symbol->bound) {
+        raise(vm, "unbound symbol '%s'", symbol->sym);
+    }
+    if (is_procedure(symbol->value)) {
+        vm->epoch++;
+    }
+    symbol->value = value;
+    write_barrier(vm, symbol, value);
 
-    while (!is_the_empty_list(env)) {
-        frame = car(env);
-        symbols = car(frame);
-        values = cdr(frame);
+    return NULL;
+}
 
-        while (!is_the_empty_list(symbols)) {
-            if (car(symbols) == symbol) {
-                set_car(values, value);
-                return NULL;
-            }
-            symbols = cdr(symbols);
-            values = cdr(values);
+obj_t *env_lookup(VM *vm, obj_t *env, obj_t *symbol) {
+    while (!is_global_env(env)) {
+        int slot = frame_slot(env, symbol);
+        if (slot >= 0) {
+            return env->slots[slot];
         }
-        env = cdr(env);
+        env = env->parent;
     }
 
-    raise(vm, "unbound symbol '%s'", symbol->sym);
+    symbol = unalias(symbol);
+    if (!symbol->bound) {
+        raise(vm, "unbound symbol '%s'", symbol->sym);
+    }
 
-    return NULL; /* unreachable */
+    return symbol->value;
 }
 
-obj_t *env_lookup(VM *vm, obj_t *env, obj_t *symbol) {
-    obj_t *frame;
-    obj_t *symbols;
-    obj_t *objects;
-
-    while (!is_the_empty_list(env)) {
-        frame = car(env);
-        symbols = car(frame);
-        objects = cdr(frame);
-
-        while (is_pair(symbols)) {
-            if (symbol == car(symbols)) {
-                return car(objects);
-            }
+obj_t *env_extend(VM *vm, obj_t *env, obj_t *symbols, obj_t *values) {
+    obj_t *names = symbols;
+    int n = 0;
 
-            symbols = cdr(symbols);
-            objects = cdr(objects);
-        }
+    /* the caller's argument list may be reachable from nowhere else */
+    int sp = vm->sp;
+    push(vm, values);
 
-        /* for variadic functions */
-        if (symbols == symbol) {
-            return objects;
-        }
+    while (is_pair(symbols)) {
+        symbols = cdr(symbols);
+        n++;
+    }
 
-        env = cdr(env);
+    /* a variadic parameter list binds its rest symbol like any other */
+    if (!is_the_empty_list(symbols)) {
+        obj_t *rest = mk_cons(vm, symbols, the_empty_list);
+        for (int i = n - 1; i >= 0; i--) {
+            rest = mk_cons(vm, list_ref(names, i), rest);
+        }
+        names = rest;
     }
 
-    raise(vm, "unbound symbol '%s'", symbol->sym);
+    obj_t *frame = mk_frame(vm, env, names, is_the_empty_list(symbols) ? n : n + 1);
 
-    return NULL; /* unreachable */
-}
+    for (int i = 0; i < n; i++) {
+        frame->slots[i] = car(values);
+        values = cdr(values);
+    }
+    if (!is_the_empty_list(symbols)) {
+        frame->slots[n] = values;
+    }
 
-obj_t *mk_frame(VM *vm, obj_t *symbols, obj_t *values) {
-    return mk_cons(vm, symbols, values);
+    vm->sp = sp;
+    push(vm, frame);
+    return frame;
 }
 
-obj_t *env_extend(VM *vm, obj_t *env, obj_t *symbols, obj_t *values) {
-    obj_t *frame = mk_frame(vm, symbols, values);
-    return mk_cons(vm, frame, env);
+obj_t *global_bindings(VM *vm) {
+    obj_t *bindings = the_empty_list;
+
+    for (size_t i = 0; i < symbol_table->size; i++) {
+        obj_t *symbol = symbol_table->slots[i];
+        if (symbol && symbol->bound) {
+            obj_t *binding = mk_cons(vm, symbol, symbol->value);
+            bindings = mk_cons(vm, binding, bindings);
+        }
+    }
+
+    return bindings;
 }
 
 int is_the_empty_list(obj_t *object) { return object == the_empty_list; }
 int is_false(obj_t *object) { return object == false; }
 int is_true(obj_t *object) { return !is_false(object); }
 
-int is_pair(obj_t *object) { return object->type == OBJ_PAIR; }
+int is_pair(obj_t *object) { return obj_type(object) == OBJ_PAIR; }
 
 int is_list(obj_t *object) {
     while (is_pair(object)) {
@@ -314,30 +749,93 @@ int is_list(obj_t *object) {
 }
 
 int is_vector(obj_t *object) {
-    return object->type == OBJ_VEC;
+    return obj_type(object) == OBJ_VEC;
 }
 
-int is_num(obj_t *object) { return object->type == OBJ_NUM; }
-int is_integer(obj_t *object) { return is_num(object) && object->denom == 1; }
-int is_symbol(obj_t *object) { return object->type == OBJ_SYM; }
+int is_num(obj_t *object) {
+    object_type type = obj_type(object);
+    return type == OBJ_NUM || type == OBJ_BIG || type == OBJ_RATIO ||
+           type == OBJ_DOUBLE;
+}
+
+/* true also of doubles with no fractional part */
+int is_integer(obj_t *object) {
+    switch (obj_type(object)) {
+    case OBJ_NUM:
+        return is_fixnum(object);
+    case OBJ_BIG:
+        return 1;
+    case OBJ_DOUBLE:
+        return isfinite(object->dbl) && object->dbl == floor(object->dbl);
+    default:
+        return 0;
+    }
+}
+
+int is_double(obj_t *object) { return obj_type(object) == OBJ_DOUBLE; }
+int is_symbol(obj_t *object) { return obj_type(object) == OBJ_SYM; }
 int is_boolean(obj_t *object) { return object == true || object == false; }
-int is_char(obj_t *object) { return object->type == OBJ_CHAR; }
-int is_string(obj_t *object) { return object->type == OBJ_STR; }
-int is_builtin(obj_t *object) { return object->type == OBJ_BUILTIN; }
-int is_fun(obj_t *object) { return object->type == OBJ_FUN; }
-int is_error(obj_t *object) { return object->type == OBJ_ERR; }
+int is_char(obj_t *object) { return obj_type(object) == OBJ_CHAR; }
+int is_string(obj_t *object) { return obj_type(object) == OBJ_STR; }
+int is_builder(obj_t *object) { return obj_type(object) == OBJ_BUILDER; }
+int is_builtin(obj_t *object) { return obj_type(object) == OBJ_BUILTIN; }
+int is_fun(obj_t *object) { return obj_type(object) == OBJ_FUN; }
+int is_code(obj_t *object) { return obj_type(object) == OBJ_CODE; }
+int is_frame(obj_t *object) { return obj_type(object) == OBJ_FRAME; }
+int is_macro(obj_t *object) { return obj_type(object) == OBJ_MACRO; }
+
+int is_procedure(obj_t *object) {
+    return object && (is_builtin(object) || is_fun(object));
+}
+int is_error(obj_t *object) { return obj_type(object) == OBJ_ERR; }
 
-static char *type_names[10] = {"number", "symbol", "string",
-                               "pair", "bool", "char", "builtin",
-                               "function", "nil", "error"};
+int is_eqv(obj_t *a, obj_t *b) {
+    if (a == b) {
+        return 1;
+    }
+    /* immediates are eqv only when they are the same word */
+    if (!a || !b || is_immediate(a) || is_immediate(b)) {
+        return 0;
+    }
+    if (a->type != b->type) {
+        return 0;
+    }
+    switch (a->type) {
+    case OBJ_NUM:
+        return a->numer == b->numer && a->denom == b->denom;
+    case OBJ_BIG:
+        return big_cmp(&a->big, &b->big) == 0;
+    case OBJ_RATIO:
+        return big_cmp(&a->rnumer, &b->rnumer) == 0 &&
+               big_cmp(&a->rdenom, &b->rdenom) == 0;
+    case OBJ_DOUBLE:
+        return a->dbl == b->dbl;
+    default:
+        return 0;
+    }
+}
+
+static char *type_names[] = {"number", "number", "number", "number",
+                             "symbol", "string", "builder",
+                             "pair", "vector", "f64vector", "s64vector",
+                             "bool", "char",
+                             "builtin", "function", "code", "frame",
+                             "macro", "nil", "error"};
 
 char *type_name(object_type type) {
-    if (type < 0 || type > 9) {
+    if (type < 0 || type > OBJ_ERR) {
         return "unknown";
     }
     return type_names[type];
 }
 
+obj_t *list_ref(obj_t *list, int k) {
+    while (k--) {
+        list = cdr(list);
+    }
+    return car(list);
+}
+
 int length(obj_t *object) {
     int l = 0;
     while (!is_the_empty_list(object)) {
@@ -351,16 +849,22 @@ int length(obj_t *object) {
 
 obj_t *car(obj_t *pair) { return pair->car; }
 obj_t *cdr(obj_t *pair) { return pair->cdr; }
-void set_car(obj_t *pair, obj_t *value) { pair->car = value; }
-void set_cdr(obj_t *pair, obj_t *value) { pair->cdr = value; }
+void set_car(obj_t *pair, obj_t *value) {
+    pair->car = value;
+    write_barrier(vm, pair, value);
+}
+
+void set_cdr(obj_t *pair, obj_t *value) {
+    pair->cdr = value;
+    write_barrier(vm, pair, value);
+}
 
 /* printing ---------------------------------------------------------------- */
 
 void print(obj_t *object);
 
-void print_rawstr(char *str) {
+void print_rawstr(char *str, int len) {
     printf("\"");
-    int len = strlen(str);
     for (int i = 0; i < len; i++) {
         switch (str[i]) {
         case '\n':
@@ -388,8 +892,8 @@ void print_cons(obj_t *object) {
     while (1) {
         print(car(p));
         obj_t *cdr_obj = cdr(p);
-        if (cdr_obj->type != OBJ_PAIR) {
-            if (cdr_obj->type != OBJ_NIL) {
+        if (!is_pair(cdr_obj)) {
+            if (!is_the_empty_list(cdr_obj)) {
                 printf(" . ");
                 print(cdr_obj);
             }
@@ -403,25 +907,29 @@ void print_cons(obj_t *object) {
 
 void print(obj_t *object) {
     if (object) {
-        switch (object->type) {
+        switch (obj_type(object)) {
         case OBJ_NUM:
-            if (object->denom == 1) {
-                printf("%li", object->numer);
-            } else {
-                double d = (double) object->numer / object->denom;
-                double l = round(d * 100000);
-                if (fabs(d * 100000 - l) > 0.1) {
-                    printf("%li/%li", object->numer, object->denom);
-                } else {
-                    printf("%g", d);
-                }
+            if (is_fixnum(object)) {
+                printf("%li", fixnum_value(object));
+                break;
             }
+            /* fall through */
+        case OBJ_BIG:
+        case OBJ_RATIO:
+        case OBJ_DOUBLE: {
+            char *digits = num_to_string(object);
+            fputs(digits, stdout);
+            free(digits);
             break;
+        }
         case OBJ_SYM:
             printf("%s", object->sym);
             break;
         case OBJ_STR:
-            print_rawstr(object->str);
+            print_rawstr(object->str, object->len);
+            break;
+        case OBJ_BUILDER:
+            printf("#<string-builder>");
             break;
         case OBJ_PAIR:
             print_cons(object);
@@ -436,18 +944,34 @@ void print(obj_t *object) {
             }
             printf(")");
             break;
+        case OBJ_F64VEC:
+            printf("#f64(");
+            for (long i = 0; i < object->count; i++) {
+                char digits[MAX_STRING_LENGTH];
+                format_double(digits, MAX_STRING_LENGTH, object->f64[i]);
+                printf(i ? " %s" : "%s", digits);
+            }
+            printf(")");
+            break;
+        case OBJ_S64VEC:
+            printf("#s64(");
+            for (long i = 0; i < object->count; i++) {
+                printf(i ? " %" PRId64 : "%" PRId64, object->s64[i]);
+            }
+            printf(")");
+            break;
         case OBJ_BOOL:
-            printf("%s", object->boolean ? "#t" : "#f");
+            printf("%s", object == IMM_TRUE ? "#t" : "#f");
             break;
         case OBJ_CHAR:
-            if (object->character == '\n')
+            if (char_value(object) == '\n')
                 printf("#\\newline");
-            else if (object->character == '\t')
+            else if (char_value(object) == '\t')
                 printf("#\\tab");
-            else if (object->character == ' ')
+            else if (char_value(object) == ' ')
                 printf("#\\space");
             else {
-                printf("#\\%c", object->character);
+                printf("#\\%c", char_value(object));
             }
             break;
         case OBJ_BUILTIN:
@@ -456,6 +980,15 @@ void print(obj_t *object) {
         case OBJ_FUN:
             printf("#<procedure>");
             break;
+        case OBJ_CODE:
+            printf("#<code>");
+            break;
+        case OBJ_FRAME:
+            printf("#<frame>");
+            break;
+        case OBJ_MACRO:
+            printf("#<macro '%s'>", object->mname->sym);
+            break;
         case OBJ_ERR:
             printf("Exception: %s", object->err);
             break;
@@ -473,18 +1006,47 @@ void println(obj_t *object) {
     putchar('\n');
 }
 
+/* Frees what an object owns outside the heap; its slot is the heap's. */
 void obj_delete(obj_t *object) {
-    if (object) {
-        if (is_symbol(object))
-            free(object->sym);
-        else if (is_string(object))
-            free(object->sym);
-        else if (is_builtin(object))
-            free(object->bname);
-        else if (is_error(object))
-            free(object->err);
-
-        free(object);
-        vm->obj_count--;
+    switch (object->type) {
+    case OBJ_BIG:
+        big_free(&object->big);
+        break;
+    case OBJ_RATIO:
+        big_free(&object->rnumer);
+        big_free(&object->rdenom);
+        break;
+    case OBJ_SYM:
+        free(object->sym);
+        break;
+    case OBJ_STR:
+        if (!object->base) {
+            free(object->str);
+        }
+        break;
+    case OBJ_BUILDER:
+        free(object->str);
+        break;
+    case OBJ_BUILTIN:
+        free(object->bname);
+        break;
+    case OBJ_ERR:
+        free(object->err);
+        break;
+    case OBJ_VEC:
+        free(object->objects);
+        break;
+    case OBJ_F64VEC:
+    case OBJ_S64VEC:
+        free(object->f64);
+        break;
+    case OBJ_CODE:
+        code_delete(object->bytecode);
+        break;
+    case OBJ_FRAME:
+        free(object->slots);
+        break;
+    default:
+        break;
     }
 }
@@ -1,44 +1,89 @@
 #ifndef OBJECT_H
 #define OBJECT_H
 
+#include "bignum.h"
 #include "table.h"
 #include "vm.h"
 
+#include <limits.h>
+#include <stdint.h>
+
 #define MAX_STRING_LENGTH 512
 
 typedef enum {
     OBJ_NUM,
+    OBJ_BIG,
+    OBJ_RATIO,
+    OBJ_DOUBLE,
     OBJ_SYM,
     OBJ_STR,
+    OBJ_BUILDER,
     OBJ_PAIR,
     OBJ_VEC,
+    OBJ_F64VEC,
+    OBJ_S64VEC,
     OBJ_BOOL,
     OBJ_CHAR,
     OBJ_BUILTIN,
     OBJ_FUN,
+    OBJ_CODE,
+    OBJ_FRAME,
+    OBJ_MACRO,
     OBJ_NIL,
     OBJ_ERR
 } object_type;
 
 typedef struct VM VM;
 
-typedef obj_t *(*builtin)(VM *vm, obj_t *object);
+/* Builtins receive their arguments in place on the VM stack, with the
+ * builtin itself at argv[-1]. Builtins that want a list are wrapped in a
+ * shim that conses one up. */
+typedef obj_t *(*builtin)(VM *vm, int argc, obj_t **argv);
+typedef obj_t *(*list_builtin)(VM *vm, obj_t *args);
 
+/* An object is allocated only as large as the header and its own member
+ * of the union, so a pair takes half the space of a closure and no field
+ * of another type may be touched. */
 struct obj_t {
     object_type type;
-    unsigned char marked;
-    obj_t *next;
     union {
+        /*
+         * Exact numbers are kept in their smallest form: an integer is a
+         * fixnum if it fits and a bignum otherwise, and a fraction, in
+         * lowest terms with a denominator above one, holds longs unless a
+         * part doesn't fit in one. Inexact numbers are doubles.
+         */
         struct {
             long numer;
             long denom;
         };
 
-        char *sym;
-        char *str;
+        big_t big;
+
+        struct {
+            big_t rnumer;
+            big_t rdenom;
+        };
 
-        int boolean;
-        char character;
+        double dbl;
+
+        /* a symbol carries the cell for its global binding */
+        struct {
+            char *sym;
+            obj_t *value;
+            int bound;
+            unsigned hash; /* of 'sym', see table.h */
+        };
+
+        /* A string owns the 'capacity' bytes at 'str', or has none and
+         * shares the storage of 'base' as a view of one of its suffixes.
+         * Either way str[len] is NUL. A builder is a string that grows. */
+        struct {
+            char *str;
+            int len;
+            int capacity;
+            obj_t *base;
+        };
 
         struct {
             obj_t *car;
@@ -50,9 +95,19 @@ struct obj_t {
             int size;
         };
 
+        /* f64vectors and s64vectors hold their elements unboxed */
+        struct {
+            union {
+                double *f64;
+                int64_t *s64;
+            };
+            long count;
+        };
+
         struct {
             char *bname;
             builtin proc;
+            list_builtin list_proc;
         };
 
         struct {
@@ -61,38 +116,149 @@ struct obj_t {
             obj_t *env;
             obj_t *params;
             obj_t *body;
+            obj_t *code;
+        };
+
+        struct code_t *bytecode;
+
+        struct {
+            obj_t *parent;
+            obj_t *names;
+            obj_t **slots;
+            int nslots;
+        };
+
+        struct {
+            obj_t *mname;
+            obj_t *literals;
+            obj_t *rules;
+            int uses;
         };
 
         char *err;
     };
 };
 
+/*
+ * Integers that fit in a fixnum, characters, booleans and the empty list
+ * are immediates: the value is held in the pointer word itself, tagged in
+ * low bits that an object on the heap, aligned to GRANULE, has clear.
+ *
+ *   ...xxx1  fixnum, the integer shifted left one bit
+ *   ...x010  character, shifted left three bits
+ *   ...x110  #f, #t, the empty list or the unassigned marker
+ *
+ * Nothing is allocated for them, so only obj_type() and the accessors
+ * below may look at an object that could be one.
+ */
+#define TAG_MASK 7
+#define CHAR_TAG 2
+#define CONST_TAG 6
+
+#define IMM_FALSE ((obj_t *)(uintptr_t)(0 << 3 | CONST_TAG))
+#define IMM_TRUE ((obj_t *)(uintptr_t)(1 << 3 | CONST_TAG))
+#define IMM_NIL ((obj_t *)(uintptr_t)(2 << 3 | CONST_TAG))
+/* held by a frame slot whose variable has not been defined yet; never a
+ * value a program can see */
+#define IMM_UNASSIGNED ((obj_t *)(uintptr_t)(3 << 3 | CONST_TAG))
+
+#define FIXNUM_MAX (LONG_MAX >> 1)
+#define FIXNUM_MIN (LONG_MIN >> 1)
+
+static inline int is_immediate(obj_t *object) {
+    return ((uintptr_t)object & TAG_MASK) != 0;
+}
+
+static inline int is_fixnum(obj_t *object) { return (uintptr_t)object & 1; }
+
+static inline obj_t *mk_fixnum(long n) {
+    return (obj_t *)(((uintptr_t)n << 1) | 1);
+}
+
+static inline long fixnum_value(obj_t *object) {
+    return (long)((intptr_t)object >> 1);
+}
+
+static inline int fits_fixnum(long n) {
+    return n >= FIXNUM_MIN && n <= FIXNUM_MAX;
+}
+
+static inline object_type obj_type(obj_t *object) {
+    uintptr_t bits = (uintptr_t)object;
+    if (bits & 1) {
+        return OBJ_NUM;
+    }
+    switch (bits & TAG_MASK) {
+    case CHAR_TAG:
+        return OBJ_CHAR;
+    case CONST_TAG:
+        return object == IMM_NIL ? OBJ_NIL : OBJ_BOOL;
+    default:
+        return object->type;
+    }
+}
+
+/* only for fixnums and fractions of longs */
+static inline long num_numer(obj_t *num) {
+    return is_fixnum(num) ? fixnum_value(num) : num->numer;
+}
+
+static inline long num_denom(obj_t *num) {
+    return is_fixnum(num) ? 1 : num->denom;
+}
+
+static inline char char_value(obj_t *c) {
+    return (char)((uintptr_t)c >> 3);
+}
+
 typedef struct VM VM;
 
+/* Allocates an object with its fields unset. Unlike the constructors
+ * below it leaves the stack alone. */
+obj_t *obj_new(VM *vm, object_type type);
+
 obj_t *mk_cons(VM *vm, obj_t *car, obj_t *cdr);
 obj_t *mk_vec(VM *vm, obj_t **objects, int size);
+obj_t *mk_numvec(VM *vm, object_type type, long count);
 
 obj_t *mk_num_from_str(VM *vm, char *str, int is_decimal, int is_fractional);
 obj_t *mk_num_from_long(VM *vm, long numer, long denom);
+obj_t *mk_integer(VM *vm, long n);
+obj_t *mk_bignum(VM *vm, big_t n);
+obj_t *mk_ratio(VM *vm, big_t numer, big_t denom);
+obj_t *mk_double(VM *vm, double d);
 char *num_to_string(obj_t *object);
 
 obj_t *mk_sym(VM *vm, char *bname);
+obj_t *mk_gensym(VM *vm, char *prefix);
+obj_t *mk_alias(VM *vm, obj_t *symbol);
+obj_t *unalias(obj_t *symbol);
 obj_t *mk_string(VM *vm, char *str);
+obj_t *mk_string_len(VM *vm, char *bytes, int len);
+obj_t *mk_string_view(VM *vm, obj_t *string, int start);
+obj_t *mk_builder(VM *vm);
+void builder_append(obj_t *builder, char *bytes, int len);
 
 obj_t *mk_char(VM *vm, char c);
 obj_t *mk_bool(VM *vm, int value);
 
 obj_t *mk_builtin(VM *vm, char *name, builtin proc);
+obj_t *mk_list_builtin(VM *vm, char *name, list_builtin proc);
 obj_t *mk_fun(VM *vm, obj_t *env, obj_t *params, obj_t *body);
+obj_t *mk_code(VM *vm);
+obj_t *mk_macro(VM *vm, obj_t *name, obj_t *literals, obj_t *rules);
 
 obj_t *mk_nil(VM *vm);
 obj_t *mk_err(VM *vm, char *msg);
 
+obj_t *mk_frame(VM *vm, obj_t *parent, obj_t *names, int nslots);
 obj_t *mk_env(VM *vm);
 obj_t *env_lookup(VM *vm, obj_t *env, obj_t *symbol);
 obj_t *env_define(VM *vm, obj_t *env, obj_t *symbol, obj_t *value);
 obj_t *env_set(VM *vm, obj_t *env, obj_t *symbol, obj_t *value);
+void frame_store(VM *vm, obj_t *frame, int slot, obj_t *value);
 obj_t *env_extend(VM *vm, obj_t *env, obj_t *symbols, obj_t *values);
+obj_t *global_bindings(VM *vm);
 
 int is_the_empty_list(obj_t *object);
 int is_false(obj_t *c);
@@ -110,13 +276,20 @@ int is_symbol(obj_t *object);
 int is_boolean(obj_t *object);
 int is_char(obj_t *object);
 int is_string(obj_t *object);
+int is_builder(obj_t *object);
 int is_builtin(obj_t *object);
 int is_fun(obj_t *object);
+int is_code(obj_t *object);
+int is_frame(obj_t *object);
+int is_macro(obj_t *object);
+int is_procedure(obj_t *object);
 int is_error(obj_t *object);
+int is_eqv(obj_t *a, obj_t *b);
 
 char *type_name(object_type type);
 
 int length(obj_t *list);
+obj_t *list_ref(obj_t *list, int k);
 
 obj_t *car(obj_t *pair);
 obj_t *cdr(obj_t *pair);
@@ -1,4 +1,6 @@
+#include "compile.h"
 #include "eval.h"
+#include "expand.h"
 #include "read.h"
 
 #include <ctype.h>
@@ -45,7 +47,7 @@ int is_delim(int c) {
 }
 
 int is_initial(int c) {
-    char *allowed = "+-*/%!?<>=&^|@";
+    char *allowed = "+-*/%!?<>=&^|@_";
     return isalpha(c) || strchr(allowed, c);
 }
 
@@ -168,7 +170,16 @@ obj_t *read_string(VM *vm, Reader *rdr) {
     }
     str[i] = '\0';
 
-    return mk_string(vm, str);
+    return mk_string_len(vm, str, i);
+}
+
+/* Moves the character being read onto the end of 'num'. */
+static void take_char(VM *vm, Reader *rdr, char *num, int *i) {
+    if (*i == MAX_STRING_LENGTH - 1) {
+        raise(vm, "string exceeds max length");
+    }
+    num[(*i)++] = rdr->cur;
+    get_next_char(rdr);
 }
 
 obj_t *read_number(VM *vm, Reader *rdr) {
@@ -176,27 +187,35 @@ obj_t *read_number(VM *vm, Reader *rdr) {
     int i = 0, is_decimal = 0, is_fractional = 0;
 
     if (rdr->cur == '-') {
-        num[i++] = rdr->cur;
-        get_next_char(rdr);
+        take_char(vm, rdr, num, &i);
     }
 
-    while (isdigit(rdr->cur) && i < MAX_STRING_LENGTH) {
-        num[i++] = rdr->cur;
-        get_next_char(rdr);
+    while (isdigit(rdr->cur)) {
+        take_char(vm, rdr, num, &i);
     }
 
-    if (i == MAX_STRING_LENGTH)
-        raise(vm, "string exceeds max length");
-
     if (rdr->cur == '/' || rdr->cur == '.') {
         is_decimal = rdr->cur == '.';
         is_fractional = rdr->cur == '/';
 
-        num[i++] = rdr->cur;
-        get_next_char(rdr);
+        take_char(vm, rdr, num, &i);
         while (isdigit(rdr->cur)) {
-            num[i++] = rdr->cur;
-            get_next_char(rdr);
+            take_char(vm, rdr, num, &i);
+        }
+    }
+
+    /* an exponent makes a decimal */
+    if ((rdr->cur == 'e' || rdr->cur == 'E') && !is_fractional) {
+        is_decimal = 1;
+        take_char(vm, rdr, num, &i);
+        if (rdr->cur == '-' || rdr->cur == '+') {
+            take_char(vm, rdr, num, &i);
+        }
+        if (!isdigit(rdr->cur)) {
+            raise(vm, "invalid number syntax");
+        }
+        while (isdigit(rdr->cur)) {
+            take_char(vm, rdr, num, &i);
         }
     }
 
@@ -244,6 +263,15 @@ obj_t *read_list(VM *vm, Reader *rdr) {
 
     if (rdr->cur == '.') {
         get_next_char(rdr);
+
+        /* a symbol such as '...' rather than a dotted pair */
+        if (!is_delim(get_peek_char(rdr))) {
+            obj_t *symbol = read_symbol(vm, rdr);
+            cdr_obj = read_list(vm, rdr);
+            cdr_obj = mk_cons(vm, symbol, cdr_obj);
+            return mk_cons(vm, car_obj, cdr_obj);
+        }
+
         cdr_obj = read(vm, rdr);
 
         if (rdr->cur != ')') {
@@ -287,9 +315,17 @@ obj_t *read_block_comment(VM *vm, Reader *rdr) {
 }
 
 obj_t *read_file(VM *vm, char *fname) {
+    int sp = vm->sp;
+    int fp = vm->fp;
+
+    jmp_buf outer;
+    memcpy(outer, exc_env, sizeof(jmp_buf));
 
     if (setjmp(exc_env)) {
         println(exc);
+        vm->sp = sp;
+        vm->fp = fp;
+        memcpy(exc_env, outer, sizeof(jmp_buf));
         return NULL;
     }
 
@@ -310,6 +346,8 @@ obj_t *read_file(VM *vm, char *fname) {
         reader_delete(rdr);
     }
 
+    memcpy(exc_env, outer, sizeof(jmp_buf));
+
     return NULL;
 }
 
@@ -347,6 +385,8 @@ obj_t *read(VM *vm, Reader *rdr) {
         result = read_quote(vm, rdr, unquote_sym);
     } else if (rdr->cur == ')') {
         raise(vm, "unexpected ')'");
+    } else if (rdr->cur == '.' && !is_delim(get_peek_char(rdr))) {
+        result = read_symbol(vm, rdr);
     } else if (rdr->cur == '.') {
         raise(vm, "unexpected '.'");
     } else {
@@ -361,8 +401,16 @@ obj_t *interpret(VM *vm, Reader *rdr) {
     obj_t *ast = read(vm, rdr);
     popn(vm, vm->sp - sp);
 
-    sp = vm->sp;
-    obj_t *object = eval(vm, universe, ast);
+    /* keep the form reachable while it is expanded, compiled and run */
+    push(vm, ast);
+    ast = expand(vm, ast);
+
+    obj_t *object;
+    if (ast_eval) {
+        object = eval(vm, universe, ast);
+    } else {
+        object = execute(vm, compile(vm, ast), universe);
+    }
     popn(vm, vm->sp - sp);
 
     return object;
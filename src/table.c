@@ -1,79 +1,102 @@
 #include "table.h"
+#include "heap.h"
 
 #include <stdio.h>
 #include <string.h>
 
-entry_t *entry_new(obj_t *object) {
-    entry_t *entry = malloc(sizeof(entry_t));
-    entry->object = object;
-    entry->next = NULL;
-    return entry;
-}
-
 table_t *table_new(void) {
     table_t *table = malloc(sizeof(table_t));
-    table->size = MAX_TABLE_SIZE;
-
-    for (int i = 0; i < MAX_TABLE_SIZE; i++) {
-        table->store[i] = NULL;
-    }
-
+    table->size = INITIAL_TABLE_SIZE;
+    table->count = 0;
+    table->slots = calloc(table->size, sizeof(obj_t *));
     return table;
 }
 
-unsigned long hash(char *str) {
-    unsigned long hash = 5381;
+unsigned table_hash(char *key) {
+    unsigned hash = 5381;
     int c;
 
-    while ((c = *str++))
+    while ((c = *key++))
         hash = ((hash << 5) + hash) + c; /* hash * 33 + c */
 
     return hash;
 }
 
-void table_put(table_t *table, char *key, obj_t *value) {
-    unsigned long h = hash(key);
-    entry_t **entry = &table->store[h % table->size];
-    while (*entry) {
-       entry = &(*entry)->next;
+static void insert(obj_t **slots, size_t size, obj_t *symbol) {
+    size_t i = symbol->hash & (size - 1);
+    while (slots[i]) {
+        i = (i + 1) & (size - 1);
+    }
+    slots[i] = symbol;
+}
+
+/* Moves the symbols into 'size' fresh slots. */
+static void rehash(table_t *table, size_t size) {
+    obj_t **slots = calloc(size, sizeof(obj_t *));
+    for (size_t i = 0; i < table->size; i++) {
+        if (table->slots[i]) {
+            insert(slots, size, table->slots[i]);
+        }
+    }
+    free(table->slots);
+    table->slots = slots;
+    table->size = size;
+}
+
+void table_put(table_t *table, obj_t *symbol) {
+    if ((table->count + 1) * 4 > table->size * 3) {
+        rehash(table, table->size * 2);
     }
-    *entry = entry_new(value);
+    insert(table->slots, table->size, symbol);
+    table->count++;
 }
 
-obj_t *table_get(table_t *table, char *key) {
-    unsigned long h = hash(key);
-    entry_t *entry = table->store[h % table->size];
-    while (entry) {
-        if (strcmp(entry->object->sym, key) == 0) {
-            return entry->object;
+obj_t *table_get(table_t *table, char *key, unsigned hash) {
+    size_t i = hash & (table->size - 1);
+    for (obj_t *symbol; (symbol = table->slots[i]);
+         i = (i + 1) & (table->size - 1)) {
+        if (symbol->hash == hash && strcmp(symbol->sym, key) == 0) {
+            return symbol;
         }
-        entry = entry->next;
     }
 
     return NULL;
 }
 
-void table_print(table_t *table) {
-    for (int i = 0; i < MAX_TABLE_SIZE; i++) {
-        if (table->store[i]) {
-            println(table->store[i]->object);
-            entry_t *tmp = table->store[i]->next;
-            while (tmp) {
-                printf("\t%s\n", tmp->object->sym);
-                tmp = tmp->next;
-            }
+/* Drops the symbols the collector didn't mark, before they are swept.
+ * Slots can't simply be emptied without breaking the probe sequences
+ * that run through them, so the survivors are rehashed, into a smaller
+ * table if few are left. */
+void table_sweep(table_t *table) {
+    size_t dead = 0;
+    for (size_t i = 0; i < table->size; i++) {
+        obj_t *symbol = table->slots[i];
+        if (symbol && !heap_is_marked(symbol)) {
+            table->slots[i] = NULL;
+            dead++;
         }
     }
+    if (!dead) {
+        return;
+    }
+
+    table->count -= dead;
+    size_t size = table->size;
+    while (size > INITIAL_TABLE_SIZE && table->count * 4 < size) {
+        size /= 2;
+    }
+    rehash(table, size);
 }
 
-void table_delete(table_t *table) {
-    for (int i = 0; i < table->size; i++) {
-        entry_t *entry = table->store[i];
-        while (entry) {
-            entry_t *tmp = entry->next;
-            free(entry);
-            entry = tmp;
+void table_print(table_t *table) {
+    for (size_t i = 0; i < table->size; i++) {
+        if (table->slots[i]) {
+            printf("%zu\t%s\n", i, table->slots[i]->sym);
         }
     }
+}
+
+void table_delete(table_t *table) {
+    free(table->slots);
     free(table);
-}
\ No newline at end of file
+}
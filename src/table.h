@@ -5,29 +5,33 @@
 
 #include <stdlib.h>
 
-#define MAX_TABLE_SIZE 2048
+#define INITIAL_TABLE_SIZE 1024
 
 typedef struct obj_t obj_t;
 
-typedef struct entry_t {
-    obj_t *object;
-    struct entry_t *next;
-} entry_t;
-
-entry_t *entry_new(obj_t *object);
-
+/*
+ * The symbol table maps names to symbols by open addressing with linear
+ * probing. Each symbol carries the hash of its name, so probes compare
+ * hashes before names and growing the table rehashes nothing. Entries are
+ * weak: a symbol with no global binding that nothing else refers to is
+ * dropped by table_sweep() and collected.
+ */
 typedef struct table_t {
-    size_t size;
-    entry_t *store[MAX_TABLE_SIZE];
+    size_t size; /* slots, a power of two */
+    size_t count;
+    obj_t **slots;
 } table_t;
 
 table_t *table_new(void);
 
-void table_put(table_t *table, char *key, obj_t *value);
-obj_t *table_get(table_t *table, char *key);
+unsigned table_hash(char *key);
+
+void table_put(table_t *table, obj_t *symbol);
+obj_t *table_get(table_t *table, char *key, unsigned hash);
+void table_sweep(table_t *table);
 
 void table_print(table_t *table);
 
 void table_delete(table_t *table);
 
-#endif
\ No newline at end of file
+#endif
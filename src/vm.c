@@ -1,30 +1,69 @@
+#include "assert.h"
 #include "builtins.h"
 #include "common.h"
+#include "compile.h"
 #include "vm.h"
 
+#include <limits.h>
+#include <time.h>
+
 #define INITIAL_GC_THRESHOLD 500
+#define HEAP_GROWTH 2.0
+
+/* Reads a numeric setting from the environment, or returns 'fallback'
+ * when it is unset or not above 'min'. */
+static double env_setting(const char *name, double fallback, double min) {
+    char *value = getenv(name);
+    if (!value) {
+        return fallback;
+    }
+    double setting = strtod(value, NULL);
+    return setting > min ? setting : fallback;
+}
 
+/*
+ * The heap is tuned from the environment:
+ *
+ *   FIG_HEAP_INITIAL  objects allocated before the first major collection
+ *   FIG_HEAP_GROWTH   factor the live objects grow by before the next one
+ *   FIG_HEAP_MAX      live objects past which allocation raises an error
+ *   FIG_GC_TRACE      report every collection on stderr when set
+ */
 VM *vm_new() {
     VM *vm = malloc(sizeof(VM));
-    vm->alloc_list = NULL;
-    vm->gc_threshold = INITIAL_GC_THRESHOLD;
+    heap_init(&vm->heap);
+    vm->gc_threshold = env_setting("FIG_HEAP_INITIAL", INITIAL_GC_THRESHOLD, 0);
+    vm->heap_growth = env_setting("FIG_HEAP_GROWTH", HEAP_GROWTH, 1);
+    vm->heap_max = env_setting("FIG_HEAP_MAX", INT_MAX, 0);
+    vm->gc_trace = getenv("FIG_GC_TRACE") != NULL;
+    memset(&vm->gc_stats, 0, sizeof(gc_stats_t));
     vm->sp = 0;
+    vm->fp = 0;
     vm->obj_count = 0;
+    vm->young = 0;
+    vm->mark_stack = NULL;
+    vm->mark_sp = 0;
+    vm->mark_capacity = 0;
+    vm->gc_phase = GC_IDLE;
+    vm->gc_budget = 0;
+    vm->epoch = 1;
+    vm->expansions = 0;
+    vm->expand_usec = 0;
     return vm;
 }
 
 void push(VM *vm, obj_t *item) {
-    if (vm->obj_count >= MAX_STACK_SIZE) {
+    if (vm->sp >= MAX_STACK_SIZE) {
         fprintf(stderr, "stack overflow\n");
-        builtin_exit(vm, NULL);
+        builtin_exit(vm, 0, NULL);
     }
     vm->stack[vm->sp++] = item;
 }
 
 obj_t *pop(VM *vm) {
-    if (vm->obj_count == 0) {
+    if (vm->sp == 0) {
         fprintf(stderr, "stack underflow\n");
-        builtin_exit(vm, NULL);
+        builtin_exit(vm, 0, NULL);
     }
     return vm->stack[--vm->sp];
 }
@@ -43,56 +82,734 @@ void stack_print(VM *vm) {
     printf("=========================\n");
 }
 
-void mark(obj_t *object) {
-    if (!object || object->marked)
+#define TRACE_RUN 1024 /* list cells or vector elements traced at once */
+
+static void push_mark(VM *vm, obj_t *object, int from) {
+    if (vm->mark_sp == vm->mark_capacity) {
+        vm->mark_capacity = vm->mark_capacity ? vm->mark_capacity * 2 : 1024;
+        vm->mark_stack =
+            realloc(vm->mark_stack, sizeof(mark_entry_t) * vm->mark_capacity);
+        if (!vm->mark_stack) {
+            fprintf(stderr, "out of memory\n");
+            exit(1);
+        }
+    }
+    vm->mark_stack[vm->mark_sp].object = object;
+    vm->mark_stack[vm->mark_sp++].from = from;
+}
+
+/* Marks 'object' and, if it holds references, queues it to be traced. */
+void grey(VM *vm, obj_t *object) {
+    if (!object || is_immediate(object) || heap_is_marked(object))
         return;
 
-    if (is_pair(object)) {
-        mark(object->car);
-        mark(object->cdr);
-    } else if (is_fun(object)) {
-        mark(object->fname);
-        mark(object->params);
-        mark(object->body);
+    heap_mark(object);
+
+    /* Fields aren't read here: an object made while marking is greyed
+     * before its constructor has filled them in. */
+    switch (object->type) {
+    case OBJ_NUM:
+    case OBJ_BIG:
+    case OBJ_RATIO:
+    case OBJ_DOUBLE:
+    case OBJ_F64VEC:
+    case OBJ_S64VEC:
+    case OBJ_BUILDER:
+    case OBJ_BOOL:
+    case OBJ_CHAR:
+    case OBJ_BUILTIN:
+    case OBJ_NIL:
+    case OBJ_ERR:
+        return;
+    default:
+        push_mark(vm, object, 0);
     }
+}
 
-    object->marked = 1;
+/* Greys everything 'object' refers to and returns roughly how many
+ * references that took. A list is followed along its cdrs here rather
+ * than through the mark stack, so the stack only grows with how deeply
+ * cars nest. After TRACE_RUN cells of a list or elements of a vector the
+ * rest is queued, to keep slices of incremental marking short. */
+static long trace(VM *vm, obj_t *object, int from) {
+    long work = 1;
+
+    switch (object->type) {
+    case OBJ_NUM:
+    case OBJ_BIG:
+    case OBJ_RATIO:
+    case OBJ_DOUBLE:
+    case OBJ_F64VEC:
+    case OBJ_S64VEC:
+    case OBJ_BUILDER:
+    case OBJ_BOOL:
+    case OBJ_CHAR:
+    case OBJ_BUILTIN:
+    case OBJ_NIL:
+    case OBJ_ERR:
+        break;
+    case OBJ_STR:
+        /* the base of a view is never a view itself */
+        grey(vm, object->base);
+        break;
+    case OBJ_SYM:
+        grey(vm, object->value);
+        break;
+    case OBJ_PAIR:
+        for (;;) {
+            grey(vm, object->car);
+            obj_t *next = object->cdr;
+            if (!next || !is_pair(next) || heap_is_marked(next)) {
+                grey(vm, next);
+                break;
+            }
+            heap_mark(next);
+            if (work++ == TRACE_RUN) {
+                push_mark(vm, next, 0);
+                break;
+            }
+            object = next;
+        }
+        break;
+    case OBJ_VEC: {
+        int to = object->size - from > TRACE_RUN ? from + TRACE_RUN
+                                                  : object->size;
+        for (int i = from; i < to; i++) {
+            grey(vm, object->objects[i]);
+        }
+        if (to < object->size) {
+            push_mark(vm, object, to);
+        }
+        work += to - from;
+        break;
+    }
+    case OBJ_FUN:
+        grey(vm, object->fname);
+        grey(vm, object->env);
+        grey(vm, object->params);
+        grey(vm, object->body);
+        grey(vm, object->code);
+        break;
+    case OBJ_CODE:
+        grey(vm, object->bytecode->name);
+        grey(vm, object->bytecode->params);
+        grey(vm, object->bytecode->body);
+        grey(vm, object->bytecode->names);
+        for (int i = 0; i < object->bytecode->nconsts; i++) {
+            grey(vm, object->bytecode->consts[i]);
+        }
+        for (int i = 0; i < object->bytecode->nics; i++) {
+            grey(vm, object->bytecode->ics[i].fn);
+        }
+        break;
+    case OBJ_FRAME:
+        grey(vm, object->parent);
+        grey(vm, object->names);
+        for (int i = 0; i < object->nslots; i++) {
+            grey(vm, object->slots[i]);
+        }
+        break;
+    case OBJ_MACRO:
+        grey(vm, object->mname);
+        grey(vm, object->literals);
+        grey(vm, object->rules);
+        break;
+    }
+
+    return work;
 }
 
-void mark_all(VM *vm) {
-    mark(universe);
-    for (int i = 0; i < vm->sp; i++) {
-        mark(vm->stack[i]);
+/* Traces queued objects until everything reachable from them is marked.
+ * Marking stops at objects already marked: during a minor collection
+ * those are old, and the remembered set covers the young objects they
+ * were since given. */
+static void drain_marks(VM *vm) {
+    while (vm->mark_sp) {
+        mark_entry_t entry = vm->mark_stack[--vm->mark_sp];
+        trace(vm, entry.object, entry.from);
     }
 }
 
-void sweep(VM *vm) {
-    obj_t **object = &vm->alloc_list;
-    while (*object) {
-        if (!(*object)->marked) {
-            obj_t *unreached = *object;
-            *object = unreached->next;
-            obj_delete(unreached);
-        } else {
-            (*object)->marked = 0;
-            object = &(*object)->next;
+/* Symbols with a global binding are roots; the symbol table holds the
+ * rest weakly. */
+static void grey_roots(VM *vm) {
+    grey(vm, universe);
+    for (size_t i = 0; i < symbol_table->size; i++) {
+        obj_t *symbol = symbol_table->slots[i];
+        if (symbol && (symbol->bound || symbol->value)) {
+            grey(vm, symbol);
         }
     }
+    for (int i = 0; i < vm->sp; i++) {
+        grey(vm, vm->stack[i]);
+    }
+    for (int i = 0; i < vm->fp; i++) {
+        grey(vm, vm->frames[i].code);
+        grey(vm, vm->frames[i].env);
+    }
+}
+
+/* Traces the old objects given young ones since they were last traced. */
+static void trace_remembered(VM *vm) {
+    heap_t *heap = &vm->heap;
+    for (long i = 0; i < heap->nremembered; i++) {
+        trace(vm, heap->remembered[i], 0);
+    }
+    heap_forget_remembered(heap);
+}
+
+void mark_all(VM *vm) {
+    grey_roots(vm);
+    drain_marks(vm);
+}
+
+/* Counts the time since 'start' as a pause of the collector. */
+static void gc_paused(VM *vm, clock_t start) {
+    long usec = (long)(clock() - start) * 1000000 / CLOCKS_PER_SEC;
+    vm->gc_stats.pause_usec += usec;
+    vm->gc_stats.cycle_usec += usec;
+    if (usec > vm->gc_stats.max_pause_usec) {
+        vm->gc_stats.max_pause_usec = usec;
+    }
 }
 
+static void gc_finished(VM *vm, int major, long marked, long freed) {
+    gc_stats_t *stats = &vm->gc_stats;
+
+    if (major) {
+        stats->major++;
+    } else {
+        stats->minor++;
+    }
+    stats->marked += marked;
+    stats->freed += freed;
+
+    if (vm->gc_trace) {
+        fprintf(stderr,
+                "gc: %s #%ld: %ld usec, %ld marked, %ld freed, "
+                "%d objects, %ld KB heap\n",
+                major ? "major" : "minor", major ? stats->major : stats->minor,
+                stats->cycle_usec, marked, freed, vm->obj_count,
+                vm->heap.npages * (PAGE_SIZE / 1024));
+    }
+    stats->cycle_usec = 0;
+}
+
+/* Pages left unswept by the last collection are swept before marking,
+ * and the objects the new marks leave out are swept as allocation needs
+ * their slots. */
 void gc(VM *vm) {
+    clock_t start = clock();
+    int before = vm->obj_count;
+
+    heap_finish_sweep(&vm->heap);
+    heap_clear_marks(&vm->heap);
     mark_all(vm);
-    sweep(vm);
+    table_sweep(symbol_table);
+    vm->obj_count = heap_start_sweep(&vm->heap);
+    vm->young = 0;
+
+    gc_paused(vm, start);
+    gc_finished(vm, 1, vm->obj_count, before - vm->obj_count);
 }
 
-void cleanup(VM *vm) {
-    obj_t *object = vm->alloc_list;
-    while (object) {
-        obj_t *tmp = object->next;
-        obj_delete(object);
-        object = tmp;
+/* Collects only the objects allocated since the last collection: what the
+ * roots and the remembered old objects reach becomes old, and the rest is
+ * freed straight away. */
+void gc_minor(VM *vm) {
+    heap_t *heap = &vm->heap;
+    clock_t start = clock();
+
+    heap_finish_sweep(heap);
+    trace_remembered(vm);
+    mark_all(vm);
+    table_sweep(symbol_table);
+    long freed = heap_sweep_young(heap);
+    vm->obj_count -= freed;
+
+    gc_paused(vm, start);
+    gc_finished(vm, 0, vm->young - freed, freed);
+    vm->young = 0;
+}
+
+/*
+ * An incremental major collection does the work of gc() in slices of
+ * about gc_budget objects, one per allocation: first the pages left from
+ * the last collection are swept, then marking starts from the roots and
+ * the mark stack is drained a slice at a time. Meanwhile objects allocated
+ * are greyed, and the write barrier remembers marked objects that are
+ * given unmarked ones, which the next slice traces again. The roots have
+ * no barrier, so the last slice greys them once more before draining the
+ * stack for good.
+ */
+int gc_step(VM *vm) {
+    heap_t *heap = &vm->heap;
+
+    if (!vm->gc_budget) {
+        gc(vm);
+        return 1;
+    }
+
+    clock_t start = clock();
+
+    switch (vm->gc_phase) {
+    case GC_IDLE:
+        vm->gc_phase = GC_SWEEPING;
+        /* fall through */
+    case GC_SWEEPING:
+        if (heap_sweep_step(heap, vm->gc_budget)) {
+            heap_clear_marks(heap);
+            grey_roots(vm);
+            vm->gc_phase = GC_MARKING;
+        }
+        break;
+    case GC_MARKING:
+        trace_remembered(vm);
+        for (long work = 0; vm->mark_sp && work < vm->gc_budget;) {
+            mark_entry_t entry = vm->mark_stack[--vm->mark_sp];
+            work += trace(vm, entry.object, entry.from);
+        }
+        if (vm->mark_sp) {
+            break;
+        }
+        trace_remembered(vm);
+        mark_all(vm);
+
+        int before = vm->obj_count;
+        table_sweep(symbol_table);
+        vm->obj_count = heap_start_sweep(heap);
+        vm->young = 0;
+        vm->gc_phase = GC_IDLE;
+
+        gc_paused(vm, start);
+        gc_finished(vm, 1, vm->obj_count, before - vm->obj_count);
+        return 1;
+    }
+
+    gc_paused(vm, start);
+    return 0;
+}
+
+/* bytecode interpreter ---------------------------------------------------- */
+
+static frame_t *push_frame(VM *vm, obj_t *code, obj_t *env, int bp) {
+    if (vm->fp == MAX_FRAMES) {
+        raise(vm, "maximum recursion depth exceeded");
+    }
+
+    frame_t *frame = &vm->frames[vm->fp++];
+    frame->code = code;
+    frame->env = env;
+    frame->ip = code->bytecode->instrs;
+    frame->bp = bp;
+
+    return frame;
+}
+
+static obj_t *list_from_stack(VM *vm, int from, int n, obj_t *tail) {
+    for (int i = n - 1; i >= 0; i--) {
+        tail = mk_cons(vm, vm->stack[from + i], tail);
+    }
+    return tail;
+}
+
+/* Returns the frame 'depth' links out from 'env'. */
+static obj_t *frame_at(obj_t *env, int depth) {
+    while (depth--) {
+        env = env->parent;
+    }
+    return env;
+}
+
+static void check_arguments(VM *vm, obj_t *fn, int argc) {
+    code_t *code = fn->code->bytecode;
+
+    if (code->rest ? argc < code->nparams : argc != code->nparams) {
+        raise(vm, "incorrect number of arguments passed to '%s'",
+              fn->fname ? fn->fname->sym : "anonymous");
+    }
+}
+
+/* Builds the frame for a call to 'fn' on the argc values at stack[from],
+ * once check_arguments has accepted argc. */
+static obj_t *bind_arguments(VM *vm, obj_t *fn, int from, int argc) {
+    code_t *code = fn->code->bytecode;
+    obj_t *frame = mk_frame(vm, fn->env, code->names, code->nlocals);
+
+    for (int i = 0; i < code->nparams; i++) {
+        frame->slots[i] = vm->stack[from + i];
+    }
+    if (code->rest) {
+        /* consing can collect and leave the frame old */
+        obj_t *rest = list_from_stack(vm, from + code->nparams,
+                                      argc - code->nparams, the_empty_list);
+        frame_store(vm, frame, code->nparams, rest);
     }
 
+    return frame;
+}
+
+/* Whether every symbol in a folded constant's dependency list still holds
+ * the builtin the value was computed with. */
+static int folds_hold(obj_t *deps) {
+    for (; !is_the_empty_list(deps); deps = cdr(deps)) {
+        obj_t *symbol = car(car(deps));
+        if (!symbol->bound || symbol->value != cdr(car(deps))) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* Caches 'fn' in 'ic', which belongs to the code of the running frame. */
+static void fill_ic(VM *vm, ic_t *ic, obj_t *fn) {
+    ic->fn = fn;
+    write_barrier(vm, vm->frames[vm->fp - 1].code, fn);
+}
+
+/* Checks 'fn' can be called with argc arguments unless it is the procedure
+ * 'ic' was last filled with. */
+static void check_call(VM *vm, obj_t *fn, int argc, ic_t *ic) {
+    if (fn != ic->fn || ic->kind == IC_EMPTY) {
+        FIG_ASSERT(vm, is_procedure(fn), "cannot invoke object of type '%s'",
+                   fn ? type_name(obj_type(fn)) : "unspecified");
+        if (is_fun(fn)) {
+            check_arguments(vm, fn, argc);
+        }
+        if (fn != ic->fn) {
+            ic->epoch = 0;
+        }
+        fill_ic(vm, ic, fn);
+        ic->kind = is_builtin(fn) ? IC_BUILTIN : IC_CLOSURE;
+    }
+}
+
+/* Replaces the environment of 'frame' with a new one of nslots slots below
+ * 'parent', its first n slots popped off the stack. */
+static void new_env(VM *vm, frame_t *frame, obj_t *parent, obj_t *names,
+                    int nslots, int n) {
+    obj_t *env = mk_frame(vm, parent, names, nslots);
+    vm->sp -= n + 1;
+    for (int i = 0; i < n; i++) {
+        env->slots[i] = vm->stack[vm->sp + i];
+    }
+    frame->env = env;
+}
+
+/*
+ * The operations below are shared by the dispatch loop and by code compiled
+ * ahead of time, which calls them in place of the instructions.
+ */
+
+/* An internal definition or letrec variable was used before it was
+ * defined. */
+void vm_unassigned(VM *vm, obj_t *env, int slot) {
+    raise(vm, "unbound symbol '%s'", list_ref(env->names, slot)->sym);
+}
+
+void vm_callee(VM *vm, obj_t *symbol, ic_t *ic) {
+    if (ic->epoch != vm->epoch) {
+        if (!symbol->bound) {
+            raise(vm, "unbound symbol '%s'", symbol->sym);
+        }
+        if (symbol->value != ic->fn) {
+            fill_ic(vm, ic, symbol->value);
+            ic->kind = IC_EMPTY;
+        }
+        /* only a procedure's redefinition bumps the epoch */
+        ic->epoch = is_procedure(ic->fn) ? vm->epoch : 0;
+    }
+    push(vm, ic->fn);
+}
+
+int vm_folded(VM *vm, obj_t *folded, ic_t *ic) {
+    if (ic->epoch != vm->epoch) {
+        if (!folds_hold(cdr(folded))) {
+            return 0;
+        }
+        ic->epoch = vm->epoch;
+    }
+    push(vm, car(folded));
+    return 1;
+}
+
+void vm_enter(VM *vm, frame_t *frame, obj_t *names, int n, int nslots) {
+    new_env(vm, frame, frame->env, names, nslots, n);
+}
+
+void vm_rebind(VM *vm, frame_t *frame, int n) {
+    obj_t *env = frame->env;
+    new_env(vm, frame, env->parent, env->names, env->nslots, n);
+}
+
+void vm_closure(VM *vm, frame_t *frame, obj_t *lambda) {
+    obj_t *fn = mk_fun(vm, frame->env, lambda->bytecode->params,
+                       lambda->bytecode->body);
+    fn->code = lambda;
+    fn->fname = lambda->bytecode->name;
+}
+
+void vm_list(VM *vm, int n) {
+    int from = vm->sp - n - 1;
+    obj_t *list = list_from_stack(vm, from, n, vm->stack[vm->sp - 1]);
+    vm->sp = from;
+    push(vm, list);
+}
+
+void vm_call(VM *vm, int argc, ic_t *ic) {
+    int base = vm->sp - argc - 1;
+    obj_t *fn = vm->stack[base];
+
+    check_call(vm, fn, argc, ic);
+
+    if (ic->kind == IC_BUILTIN) {
+        obj_t *result = fn->proc(vm, argc, &vm->stack[base + 1]);
+        vm->sp = base;
+        push(vm, result);
+        return;
+    }
+
+    obj_t *env = bind_arguments(vm, fn, base + 1, argc);
+    vm->sp = base;
+    execute(vm, fn->code, env);
+}
+
+int vm_tail_call(VM *vm, frame_t *frame, int argc, ic_t *ic) {
+    int base = vm->sp - argc - 1;
+    obj_t *fn = vm->stack[base];
+
+    check_call(vm, fn, argc, ic);
+
+    if (ic->kind == IC_BUILTIN) {
+        obj_t *result = fn->proc(vm, argc, &vm->stack[base + 1]);
+        vm->sp = base;
+        push(vm, result);
+        return 0;
+    }
+
+    frame->env = bind_arguments(vm, fn, base + 1, argc);
+    frame->code = fn->code;
+    frame->ip = fn->code->bytecode->instrs;
+    vm->sp = frame->bp;
+    return 1;
+}
+
+obj_t *execute(VM *vm, obj_t *code, obj_t *env) {
+    int entry = vm->fp;
+
+    frame_t *frame = push_frame(vm, code, env, vm->sp);
+    int *ip;
+    obj_t **consts;
+    ic_t *ics;
+
+enter:
+    while (frame->code->bytecode->native) {
+        if (!frame->code->bytecode->native(vm, frame)) {
+            goto do_return;
+        }
+    }
+    ip = frame->ip;
+    consts = frame->code->bytecode->consts;
+    ics = frame->code->bytecode->ics;
+
+    for (;;) {
+        switch (*ip++) {
+        case OP_CONST:
+            push(vm, consts[*ip++]);
+            break;
+
+        case OP_LOCAL: {
+            obj_t *env = frame_at(frame->env, ip[0]);
+            if (env->slots[ip[1]] == IMM_UNASSIGNED) {
+                vm_unassigned(vm, env, ip[1]);
+            }
+            push(vm, env->slots[ip[1]]);
+            ip += 2;
+            break;
+        }
+
+        case OP_SET_LOCAL: {
+            obj_t *env = frame_at(frame->env, ip[0]);
+            if (env->slots[ip[1]] == IMM_UNASSIGNED) {
+                vm_unassigned(vm, env, ip[1]);
+            }
+            frame_store(vm, env, ip[1], vm->stack[vm->sp - 1]);
+            vm->stack[vm->sp - 1] = NULL;
+            ip += 2;
+            break;
+        }
+
+        case OP_STORE:
+            frame_store(vm, frame_at(frame->env, ip[0]), ip[1],
+                        vm->stack[--vm->sp]);
+            ip += 2;
+            break;
+
+        case OP_UNASSIGN:
+            frame->env->slots[*ip++] = IMM_UNASSIGNED;
+            break;
+
+        case OP_GLOBAL: {
+            obj_t *symbol = consts[*ip++];
+            if (!symbol->bound) {
+                raise(vm, "unbound symbol '%s'", symbol->sym);
+            }
+            push(vm, symbol->value);
+            break;
+        }
+
+        case OP_CALLEE:
+            vm_callee(vm, consts[ip[0]], &ics[ip[1]]);
+            ip += 2;
+            break;
+
+        case OP_SET_GLOBAL:
+            env_set(vm, universe, consts[*ip++], vm->stack[vm->sp - 1]);
+            vm->stack[vm->sp - 1] = NULL;
+            break;
+
+        case OP_DEFINE:
+            env_define(vm, universe, consts[*ip++], vm->stack[vm->sp - 1]);
+            vm->stack[vm->sp - 1] = NULL;
+            break;
+
+        case OP_POP:
+            vm->sp--;
+            break;
+
+        case OP_FOLDED:
+            if (vm_folded(vm, consts[ip[0]], &ics[ip[1]])) {
+                ip = frame->code->bytecode->instrs + ip[2];
+            } else {
+                ip += 3;
+            }
+            break;
+
+        case OP_JUMP:
+            ip = frame->code->bytecode->instrs + *ip;
+            break;
+
+        case OP_JUMP_IF_FALSE:
+            if (is_false(vm->stack[--vm->sp])) {
+                ip = frame->code->bytecode->instrs + *ip;
+            } else {
+                ip++;
+            }
+            break;
+
+        case OP_JUMP_IF_FALSE_OR_POP:
+            if (is_false(vm->stack[vm->sp - 1])) {
+                ip = frame->code->bytecode->instrs + *ip;
+            } else {
+                vm->sp--;
+                ip++;
+            }
+            break;
+
+        case OP_JUMP_IF_TRUE_OR_POP:
+            if (!is_false(vm->stack[vm->sp - 1])) {
+                ip = frame->code->bytecode->instrs + *ip;
+            } else {
+                vm->sp--;
+                ip++;
+            }
+            break;
+
+        case OP_JUMP_IF_EQV:
+            if (is_eqv(vm->stack[vm->sp - 1], consts[ip[0]])) {
+                ip = frame->code->bytecode->instrs + ip[1];
+            } else {
+                ip += 2;
+            }
+            break;
+
+        case OP_ENTER:
+            vm_enter(vm, frame, consts[ip[0]], ip[1], ip[2]);
+            ip += 3;
+            break;
+
+        case OP_REBIND:
+            vm_rebind(vm, frame, *ip++);
+            break;
+
+        case OP_LEAVE:
+            frame->env = frame->env->parent;
+            break;
+
+        case OP_CLOSURE:
+            vm_closure(vm, frame, consts[*ip++]);
+            break;
+
+        case OP_LIST:
+            vm_list(vm, *ip++);
+            break;
+
+        case OP_CALL:
+        case OP_TAIL_CALL: {
+            int tail = ip[-1] == OP_TAIL_CALL;
+            int argc = ip[0];
+            ic_t *ic = &ics[ip[1]];
+            int base = vm->sp - argc - 1;
+            obj_t *fn = vm->stack[base];
+            ip += 2;
+
+            check_call(vm, fn, argc, ic);
+
+            if (ic->kind == IC_BUILTIN) {
+                obj_t *result = fn->proc(vm, argc, &vm->stack[base + 1]);
+                vm->sp = base;
+                push(vm, result);
+                if (tail) {
+                    goto do_return;
+                }
+                break;
+            }
+
+            obj_t *fn_env = bind_arguments(vm, fn, base + 1, argc);
+
+            if (tail) {
+                vm->sp = frame->bp;
+                frame->code = fn->code;
+                frame->env = fn_env;
+                frame->ip = fn->code->bytecode->instrs;
+            } else {
+                frame->ip = ip;
+                vm->sp = base;
+                frame = push_frame(vm, fn->code, fn_env, base);
+            }
+            goto enter;
+        }
+
+        case OP_RETURN:
+        do_return: {
+            obj_t *result = vm->stack[vm->sp - 1];
+            vm->sp = frame->bp;
+            vm->fp--;
+            push(vm, result);
+
+            if (vm->fp == entry) {
+                return result;
+            }
+
+            frame = &vm->frames[vm->fp - 1];
+            ip = frame->ip;
+            consts = frame->code->bytecode->consts;
+            ics = frame->code->bytecode->ics;
+            break;
+        }
+
+        default:
+            raise(vm, "invalid opcode %d", ip[-1]);
+        }
+    }
+
+    return NULL; /* unreachable */
+}
+
+void cleanup(VM *vm) {
+    heap_delete(&vm->heap);
+
+    free(vm->mark_stack);
     free(vm);
     table_delete(symbol_table);
 }
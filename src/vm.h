@@ -1,18 +1,61 @@
 #ifndef VM_H
 #define VM_H
 
+#include "heap.h"
 #include "object.h"
 
 #define MAX_STACK_SIZE 8192
+#define MAX_FRAMES 4096
+#define NURSERY_SIZE 16384 /* allocations between minor collections */
 
 typedef struct obj_t obj_t;
 
+typedef struct frame_t {
+    obj_t *code;
+    obj_t *env;
+    int *ip;
+    int bp;
+} frame_t;
+
+typedef enum { GC_IDLE, GC_SWEEPING, GC_MARKING } gc_phase_t;
+
+/* a marked object still to be traced, from element 'from' if a vector */
+typedef struct mark_entry_t {
+    obj_t *object;
+    int from;
+} mark_entry_t;
+
+typedef struct gc_stats_t {
+    long minor;          /* collections of young objects only */
+    long major;          /* collections of the whole heap */
+    long pause_usec;     /* time spent collecting */
+    long max_pause_usec; /* longest single pause, or slice if incremental */
+    long cycle_usec;     /* time spent on the collection under way */
+    long marked;         /* objects found live, over all collections */
+    long freed;          /* objects found dead, over all collections */
+} gc_stats_t;
+
 typedef struct VM {
     int obj_count;
-    int gc_threshold;
+    int gc_threshold;   /* objects before the next major collection */
+    int young;          /* objects allocated since the last collection */
+    mark_entry_t *mark_stack;
+    int mark_sp;
+    int mark_capacity;
+    gc_phase_t gc_phase; /* of an incremental major collection */
+    long gc_budget;     /* objects per slice of one, or 0 to stop the world */
+    double heap_growth; /* gc_threshold over live objects after a major */
+    int heap_max;       /* live objects past which allocation fails */
+    int gc_trace;       /* report each collection on stderr */
+    gc_stats_t gc_stats;
+    long epoch;         /* see ic_t in compile.h */
+    long expansions;    /* macro uses expanded */
+    long expand_usec;   /* time spent expanding */
     int sp;
-    obj_t *alloc_list;
+    int fp;
+    heap_t heap;
     obj_t *stack[MAX_STACK_SIZE];
+    frame_t frames[MAX_FRAMES];
 } VM;
 
 VM *vm_new(void);
@@ -22,7 +65,28 @@ void popn(VM *vm, int n);
 
 void stack_print(VM *vm);
 
+obj_t *execute(VM *vm, obj_t *code, obj_t *env);
+
+/* Instructions that code compiled ahead of time leaves to the VM. */
+struct ic_t;
+void vm_unassigned(VM *vm, obj_t *env, int slot);
+void vm_callee(VM *vm, obj_t *symbol, struct ic_t *ic);
+int vm_folded(VM *vm, obj_t *folded, struct ic_t *ic);
+void vm_enter(VM *vm, frame_t *frame, obj_t *names, int n, int nslots);
+void vm_rebind(VM *vm, frame_t *frame, int n);
+void vm_closure(VM *vm, frame_t *frame, obj_t *lambda);
+void vm_list(VM *vm, int n);
+void vm_call(VM *vm, int argc, struct ic_t *ic);
+int vm_tail_call(VM *vm, frame_t *frame, int argc, struct ic_t *ic);
+
 void gc(VM *vm);
+void gc_minor(VM *vm);
+int gc_step(VM *vm);
+void grey(VM *vm, obj_t *object);
+
+static inline void write_barrier(VM *vm, obj_t *holder, obj_t *value) {
+    heap_write_barrier(&vm->heap, holder, value);
+}
 
 void cleanup(VM *vm);
 